@@ -0,0 +1,254 @@
+#ifndef ADMIN_H
+#define ADMIN_H
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "log.h"
+#include "profiler.h"
+#include "server.h"
+
+using namespace std;
+
+// Operator commands for a running server, over a Unix-domain socket (see
+// factoryctl):
+//
+//   sessions               one line per match: phase, clock, tick lag, RTTs
+//   show <id>              a match's whole GameState
+//   reset <id>             back to waiting for both players, as after a replay
+//   end <id>               end a match and disconnect both players
+//   log [debug|info|warn]  show or change the log threshold
+//   profile                start recording zones; again to write a trace
+//   stats                  the SIGUSR2 report
+//   handoff                from a new server taking over (FACTORY_TAKEOVER=1);
+//                          answered with handoff records, not text
+//
+// One command per connection: the reply follows, then the connection
+// closes. Commands are served one at a time by a thread of their own, never
+// on a shard. Inspection takes the same short snapshots as the stats
+// report, and reset and end are queued on the match's reactor like any of
+// its tasks, so the ticks of running matches carry on undisturbed.
+//
+// The socket is at FACTORY_ADMIN, /tmp/factory-<port>.sock by default, and
+// only the server's user may connect. FACTORY_ADMIN=off leaves it out.
+class AdminSocket {
+public:
+    // A client gets this long to send its command and take the reply
+    static const int CLIENT_TIMEOUT_SECONDS = 2;
+    static const size_t MAX_COMMAND = 256;
+
+    explicit AdminSocket(GameServer& gameServer) : server(gameServer), listenSocket(-1), wakeup{-1, -1} {}
+
+    ~AdminSocket() {
+        if (worker.joinable()) {
+            // The thread sleeps in poll(); closing our end of the pipe wakes it
+            close(wakeup[1]);
+            worker.join();
+            close(wakeup[0]);
+        }
+        if (listenSocket != -1) {
+            close(listenSocket);
+            unlink(path.c_str());
+        }
+    }
+
+    AdminSocket(const AdminSocket&) = delete;
+    AdminSocket& operator=(const AdminSocket&) = delete;
+
+    static string configuredPath(int port) {
+        const char* setting = getenv("FACTORY_ADMIN");
+        if (setting && *setting) return setting;
+        return "/tmp/factory-" + to_string(port) + ".sock";
+    }
+
+    // False if the socket could not be set up; the server runs on without
+    bool start() {
+        path = configuredPath(server.listeningPort());
+        if (path == "off") return true;
+
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path)) {
+            LOG(LogLevel::Warn) << "Admin socket path too long: " << path;
+            return false;
+        }
+        strcpy(address.sun_path, path.c_str());
+
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            perror("admin socket creation failed");
+            return false;
+        }
+        // A socket file nobody answers on is left over from a crash
+        if (connect(fd, (sockaddr*)&address, sizeof(address)) == 0) {
+            LOG(LogLevel::Warn) << "Another server has the admin socket " << path << ", running without one";
+            close(fd);
+            return false;
+        }
+        unlink(path.c_str());
+
+        if (bind(fd, (sockaddr*)&address, sizeof(address)) < 0 || chmod(path.c_str(), 0600) < 0 ||
+            listen(fd, 8) < 0 || pipe2(wakeup, O_CLOEXEC) < 0) {
+            perror("admin socket setup failed");
+            close(fd);
+            unlink(path.c_str());
+            return false;
+        }
+        listenSocket = fd;
+        worker = thread(&AdminSocket::serve, this);
+        LOG(LogLevel::Info) << "Admin socket at " << path;
+        return true;
+    }
+
+private:
+    GameServer& server;
+    string path;
+    int listenSocket;
+    int wakeup[2];  // closing the write end stops serve()
+    thread worker;
+
+    void serve() {
+        Profiler::nameThread("admin");
+        while (true) {
+            pollfd fds[2] = {{listenSocket, POLLIN, 0}, {wakeup[0], POLLIN, 0}};
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) continue;
+                perror("admin poll failed");
+                return;
+            }
+            if (fds[1].revents) return;
+            if (!(fds[0].revents & POLLIN)) continue;
+
+            int client = accept4(listenSocket, NULL, NULL, SOCK_CLOEXEC);
+            if (client < 0) continue;
+            timeval timeout = {CLIENT_TIMEOUT_SECONDS, 0};
+            setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+            string command;
+            if (!readCommand(client, command)) {
+                // nothing usable came
+            } else if (command == "handoff") {
+                handOff(client);
+            } else {
+                string reply = execute(command);
+                if (reply.empty() || reply.back() != '\n') reply += '\n';
+                writeAll(client, reply);
+            }
+            close(client);
+        }
+    }
+
+    // The new process opens its own admin socket at the same path once it
+    // has everything, so ours goes first
+    void handOff(int client) {
+        close(listenSocket);
+        listenSocket = -1;
+        unlink(path.c_str());
+        if (!server.handOff(client)) {
+            LOG(LogLevel::Warn) << "Handoff to the new server did not complete";
+        }
+    }
+
+    static bool readCommand(int client, string& command) {
+        char buffer[MAX_COMMAND];
+        while (command.size() < MAX_COMMAND) {
+            ssize_t received = recv(client, buffer, sizeof(buffer), 0);
+            if (received < 0 && errno == EINTR) continue;
+            if (received <= 0) return !command.empty();
+            command.append(buffer, received);
+            size_t end = command.find('\n');
+            if (end != string::npos) {
+                command.resize(end);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static void writeAll(int client, const string& reply) {
+        size_t sent = 0;
+        while (sent < reply.size()) {
+            ssize_t written = send(client, reply.data() + sent, reply.size() - sent, MSG_NOSIGNAL);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) return;
+            sent += written;
+        }
+    }
+
+    string execute(const string& command) {
+        istringstream words(command);
+        string verb, argument;
+        words >> verb >> argument;
+
+        if (verb == "sessions") {
+            vector<Session::Stats> matches = server.stats();
+            if (matches.empty()) return "no matches running";
+            string reply;
+            for (const Session::Stats& match : matches) reply += GameServer::describeMatch(match) + "\n";
+            return reply;
+        }
+        if (verb == "stats") return server.statsReport();
+        if (verb == "profile") {
+            bool wasRecording = Profiler::enabled();
+            string trace = Profiler::requestDump();
+            if (!wasRecording) return "profiling on, run profile again to write a trace";
+            if (trace.empty()) return "error: could not write a trace";
+            return "wrote profile trace to " + trace;
+        }
+        if (verb == "log") {
+            if (argument.empty()) return string("log level ") + logLevelName(logThreshold());
+            LogLevel level;
+            if (!parseLogLevel(argument.c_str(), level)) return "error: log level is debug, info or warn";
+            setLogThreshold(level);
+            LOG(LogLevel::Warn) << "Log level set to " << argument << " by the operator";
+            return "log level " + argument;
+        }
+        if (verb == "show" || verb == "reset" || verb == "end") {
+            char* end;
+            unsigned long long id = strtoull(argument.c_str(), &end, 10);
+            shared_ptr<Session> match = argument.empty() || *end ? nullptr : server.findMatch(id);
+            if (!match) return "error: no match " + argument;
+            if (verb == "show") return describeState(match->stats(), match->snapshot());
+            if (verb == "reset") {
+                match->requestReset();
+                return "resetting match " + argument;
+            }
+            match->requestEnd("ended by the operator");
+            return "ending match " + argument;
+        }
+        return "error: unknown command '" + verb + "'; try sessions, show <id>, reset <id>, end <id>, "
+               "log [debug|info|warn], profile or stats";
+    }
+
+    static string describeState(const Session::Stats& match, const GameState& state) {
+        ostringstream text;
+        text << boolalpha;
+        text << "session " << match.id << " (" << match.phase << ")\n"
+             << "pressure " << state.machine.pressure << " (target " << state.targetPressure << ")\n"
+             << "temperature " << state.machine.temperature << " (target " << state.targetTemperature << ")\n"
+             << "timeLeft " << state.timeLeft << "\n"
+             << "gameActive " << state.gameActive << ", gameWon " << state.gameWon << ", gameFailed "
+             << state.gameFailed << "\n"
+             << "mechanical: gear " << state.mechanical.gear << ", lever " << state.mechanical.lever << ", valve "
+             << state.mechanical.valve << ", dial " << state.mechanical.dial << "; ready " << state.mechanicalReady
+             << ", wants replay " << state.mechanicalWantsReplay << "\n"
+             << "electrical: switch " << state.electrical.switchA << ", button " << state.electrical.button
+             << "; ready " << state.electricalReady << ", wants replay " << state.electricalWantsReplay << "\n"
+             << "playAgainRequested " << state.playAgainRequested;
+        return text.str();
+    }
+};
+
+#endif // ADMIN_H
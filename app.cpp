@@ -1,26 +1,33 @@
-#include "electrical_client.cpp"
-#include "mechanical_client.cpp"
-#include "server.cpp"
+// Single-process build for kiosks and demos: the server and both stations
+// run in one process and talk over in-memory loopback transports instead of
+// TCP. Each client gets its own thread because an SFML window must be
+// polled from the thread that created it.
+#include "server.h"
+#include "mechanical_client.h"
+#include "electrical_client.h"
 
 int main() {
-    // Start the server in a separate thread
-    std::thread serverThread([]() {
-        GameServer server;
-        if (server.startServer()) {
-            server.gameLoop();
-        } else {
-            std::cout << "Failed to start server!\n";
-        }
-    });
-    serverThread.detach();
+    auto mechanicalLink = makeLoopbackPair();
+    auto electricalLink = makeLoopbackPair();
+
+    GameServer server(1);  // one match, so one shard
+    server.attachPlayers(move(mechanicalLink.first), move(electricalLink.first));
+    thread serverThread(&GameServer::gameLoop, &server);
 
-    // Start the mechanical client
-    MechanicalClient mechanicalClient;
-    mechanicalClient.run();
+    thread electricalThread([&electricalLink]() {
+        ElectricalClient electricalClient;
+        electricalClient.attachTransport(move(electricalLink.second));
+        electricalClient.run();
+    });
 
-    // Start the electrical client
-    ElectricalClient electricalClient;
-    electricalClient.run();
+    {
+        MechanicalClient mechanicalClient;
+        mechanicalClient.attachTransport(move(mechanicalLink.second));
+        mechanicalClient.run();
+    }
 
+    // Both clients shut their loopback ends down on exit, which ends the match
+    electricalThread.join();
+    serverThread.join();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,123 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+using namespace std;
+
+// Memory for one shard's long-lived objects (its sessions and its session
+// table). Blocks are carved from CHUNK_SIZE chunks and, once freed, kept on
+// a free list for their size class, so a shard that keeps starting and
+// ending matches reuses the same memory instead of going back to the
+// global heap, and that memory was first touched by the shard's own core.
+// Requests above MAX_BLOCK go straight to operator new.
+//
+// Chunks are only returned when the arena is destroyed, which must be
+// after everything allocated from it. Frees may come from any thread (the
+// last owner of a session is not always on its shard), hence the lock.
+class Arena {
+public:
+    static const size_t CHUNK_SIZE = 256 * 1024;
+    static const size_t ALIGNMENT = alignof(max_align_t);
+    static const size_t MAX_BLOCK = 4096;
+
+    Arena() : chunkUsed(CHUNK_SIZE), inUse(0) {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t size) {
+        if (size > MAX_BLOCK) return ::operator new(size);
+        size_t sizeClass = classOf(size);
+        lock_guard<mutex> lock(arenaMutex);
+        inUse += blockSize(sizeClass);
+        FreeBlock*& head = freeLists[sizeClass];
+        if (head) {
+            FreeBlock* block = head;
+            head = block->next;
+            return block;
+        }
+        if (chunkUsed + blockSize(sizeClass) > CHUNK_SIZE) {
+            chunks.emplace_back(new Chunk);
+            chunkUsed = 0;
+        }
+        void* block = chunks.back()->bytes + chunkUsed;
+        chunkUsed += blockSize(sizeClass);
+        return block;
+    }
+
+    void deallocate(void* pointer, size_t size) {
+        if (size > MAX_BLOCK) {
+            ::operator delete(pointer);
+            return;
+        }
+        size_t sizeClass = classOf(size);
+        lock_guard<mutex> lock(arenaMutex);
+        inUse -= blockSize(sizeClass);
+        FreeBlock* block = static_cast<FreeBlock*>(pointer);
+        block->next = freeLists[sizeClass];
+        freeLists[sizeClass] = block;
+    }
+
+    // Bytes handed out and not yet freed (rounded up to block sizes), and
+    // bytes held in chunks; large blocks are in neither
+    size_t bytesInUse() const {
+        lock_guard<mutex> lock(arenaMutex);
+        return inUse;
+    }
+    size_t bytesReserved() const {
+        lock_guard<mutex> lock(arenaMutex);
+        return chunks.size() * CHUNK_SIZE;
+    }
+
+private:
+    static const size_t CLASSES = MAX_BLOCK / ALIGNMENT;
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+    struct Chunk {
+        alignas(ALIGNMENT) unsigned char bytes[CHUNK_SIZE];
+    };
+
+    mutable mutex arenaMutex;
+    vector<unique_ptr<Chunk>> chunks;
+    size_t chunkUsed;  // in chunks.back()
+    FreeBlock* freeLists[CLASSES] = {};
+    size_t inUse;
+
+    static size_t classOf(size_t size) { return size == 0 ? 0 : (size - 1) / ALIGNMENT; }
+    static size_t blockSize(size_t sizeClass) { return (sizeClass + 1) * ALIGNMENT; }
+};
+
+// Standard allocator over an Arena, for allocate_shared and containers
+template <typename T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+
+    explicit ArenaAllocator(Arena& owner) : arena(&owner) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t count) { return static_cast<T*>(arena->allocate(count * sizeof(T))); }
+    void deallocate(T* pointer, size_t count) { arena->deallocate(pointer, count * sizeof(T)); }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+
+private:
+    template <typename U>
+    friend class ArenaAllocator;
+
+    Arena* arena;
+};
+
+#endif // ARENA_H
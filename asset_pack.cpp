@@ -0,0 +1,149 @@
+// Packs asset directories into a single indexed archive (see assets.h).
+//
+//   asset_pack <output.pak> <root> <subdir>...   e.g. asset_pack assets.pak assets images audios
+//   asset_pack --verify <archive.pak>
+//
+// Entry names are relative to <root> ("images/gear.png"), so the clients look
+// assets up by the same names they used to open as loose files.
+#include "assets.h"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct PendingAsset {
+    string name;
+    vector<char> contents;
+    PakEntry entry;
+};
+
+static bool collectDirectory(const string& root, const string& subdir, vector<PendingAsset>& assets) {
+    string dirPath = root + "/" + subdir;
+    DIR* dir = opendir(dirPath.c_str());
+    if (!dir) {
+        perror(("cannot open " + dirPath).c_str());
+        return false;
+    }
+
+    while (dirent* item = readdir(dir)) {
+        if (item->d_name[0] == '.') continue;
+
+        string path = dirPath + "/" + item->d_name;
+        struct stat st;
+        if (stat(path.c_str(), &st) < 0 || !S_ISREG(st.st_mode)) continue;
+
+        ifstream file(path, ios::binary);
+        if (!file) {
+            cout << "Error: could not read " << path << "\n";
+            closedir(dir);
+            return false;
+        }
+
+        PendingAsset asset;
+        asset.name = subdir + "/" + item->d_name;
+        asset.contents.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+        assets.push_back(move(asset));
+    }
+    closedir(dir);
+    return true;
+}
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static int pack(const string& outputPath, const string& root, const vector<string>& subdirs) {
+    vector<PendingAsset> assets;
+    for (const auto& subdir : subdirs) {
+        if (!collectDirectory(root, subdir, assets)) return 1;
+    }
+
+    // The index is binary-searched by name hash at runtime
+    for (auto& asset : assets) {
+        asset.entry.nameHash = pakHash(asset.name.data(), asset.name.size());
+    }
+    sort(assets.begin(), assets.end(), [](const PendingAsset& a, const PendingAsset& b) {
+        return a.entry.nameHash != b.entry.nameHash ? a.entry.nameHash < b.entry.nameHash : a.name < b.name;
+    });
+
+    string names;
+    for (auto& asset : assets) {
+        asset.entry.nameOffset = names.size();
+        asset.entry.nameLength = asset.name.size();
+        names += asset.name;
+    }
+
+    PakHeader header;
+    memcpy(header.magic, PAK_MAGIC, sizeof(PAK_MAGIC));
+    header.version = PAK_VERSION;
+    header.entryCount = assets.size();
+    header.alignment = PAK_ALIGNMENT;
+    header.namesOffset = sizeof(PakHeader) + assets.size() * sizeof(PakEntry);
+    header.namesSize = names.size();
+
+    uint64_t offset = header.namesOffset + header.namesSize;
+    for (auto& asset : assets) {
+        offset = alignUp(offset, PAK_ALIGNMENT);
+        asset.entry.dataOffset = offset;
+        asset.entry.dataSize = asset.contents.size();
+        asset.entry.contentHash = pakHash(asset.contents.data(), asset.contents.size());
+        offset += asset.contents.size();
+    }
+    header.totalSize = offset;
+
+    ofstream out(outputPath, ios::binary | ios::trunc);
+    if (!out) {
+        cout << "Error: could not create " << outputPath << "\n";
+        return 1;
+    }
+
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const auto& asset : assets) {
+        out.write(reinterpret_cast<const char*>(&asset.entry), sizeof(PakEntry));
+    }
+    out.write(names.data(), names.size());
+
+    uint64_t written = header.namesOffset + header.namesSize;
+    const char padding[PAK_ALIGNMENT] = {};
+    for (const auto& asset : assets) {
+        out.write(padding, asset.entry.dataOffset - written);
+        out.write(asset.contents.data(), asset.contents.size());
+        written = asset.entry.dataOffset + asset.entry.dataSize;
+        cout << "  " << asset.name << " (" << asset.contents.size() << " bytes)\n";
+    }
+
+    if (!out) {
+        cout << "Error: failed writing " << outputPath << "\n";
+        return 1;
+    }
+    cout << "Packed " << assets.size() << " assets into " << outputPath << " (" << header.totalSize << " bytes)\n";
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc == 3 && string(argv[1]) == "--verify") {
+        AssetArchive archive;
+        if (!archive.open(argv[2])) {
+            cout << "Could not open " << argv[2] << "\n";
+            return 1;
+        }
+        if (!archive.verify()) return 1;
+        cout << argv[2] << ": " << archive.list("").size() << " assets OK\n";
+        return 0;
+    }
+
+    if (argc < 4) {
+        cout << "Usage: " << argv[0] << " <output.pak> <root> <subdir>...\n"
+             << "       " << argv[0] << " --verify <archive.pak>\n";
+        return 1;
+    }
+
+    return pack(argv[1], argv[2], vector<string>(argv + 3, argv + argc));
+}
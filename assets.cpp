@@ -0,0 +1,153 @@
+#include "assets.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+using namespace std;
+
+AssetArchive::AssetArchive() : base(nullptr), mappedSize(0), header(nullptr), entries(nullptr), names(nullptr) {}
+
+AssetArchive::~AssetArchive() {
+    close();
+}
+
+bool AssetArchive::open(const string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(PakHeader)) {
+        cout << "Warning: " << path << " is not a valid asset archive\n";
+        ::close(fd);
+        return false;
+    }
+
+    void* mapping = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        perror("mmap asset archive failed");
+        return false;
+    }
+
+    base = static_cast<const unsigned char*>(mapping);
+    mappedSize = st.st_size;
+    header = reinterpret_cast<const PakHeader*>(base);
+
+    // Validate everything up front so lookups never have to bounds-check.
+    // Sizes are checked against what is left after their offset, so that
+    // a corrupt offset cannot wrap the sum around.
+    bool valid = memcmp(header->magic, PAK_MAGIC, sizeof(PAK_MAGIC)) == 0 &&
+                 header->version == PAK_VERSION &&
+                 header->totalSize == mappedSize &&
+                 header->alignment != 0 &&
+                 sizeof(PakHeader) + (uint64_t)header->entryCount * sizeof(PakEntry) <= header->namesOffset &&
+                 header->namesOffset <= mappedSize &&
+                 header->namesSize <= mappedSize - header->namesOffset;
+
+    if (valid) {
+        entries = reinterpret_cast<const PakEntry*>(base + sizeof(PakHeader));
+        names = reinterpret_cast<const char*>(base + header->namesOffset);
+        for (uint32_t i = 0; i < header->entryCount && valid; i++) {
+            const PakEntry& entry = entries[i];
+            valid = (uint64_t)entry.nameOffset + entry.nameLength <= header->namesSize &&
+                    entry.dataOffset % header->alignment == 0 &&
+                    entry.dataOffset <= mappedSize &&
+                    entry.dataSize <= mappedSize - entry.dataOffset &&
+                    (i == 0 || entries[i - 1].nameHash <= entry.nameHash);
+        }
+    }
+
+    if (!valid) {
+        cout << "Warning: " << path << " is corrupt or from another version, ignoring it\n";
+        close();
+        return false;
+    }
+
+    // Assets are read once at startup; ask the kernel to start paging them in
+    madvise(mapping, mappedSize, MADV_WILLNEED);
+    return true;
+}
+
+void AssetArchive::close() {
+    if (base) {
+        munmap(const_cast<unsigned char*>(base), mappedSize);
+    }
+    base = nullptr;
+    mappedSize = 0;
+    header = nullptr;
+    entries = nullptr;
+    names = nullptr;
+}
+
+string AssetArchive::entryName(const PakEntry& entry) const {
+    return string(names + entry.nameOffset, entry.nameLength);
+}
+
+bool AssetArchive::find(const string& name, AssetData& out) const {
+    if (!base) return false;
+
+    uint64_t hash = pakHash(name.data(), name.size());
+    const PakEntry* end = entries + header->entryCount;
+    const PakEntry* it = lower_bound(entries, end, hash, [](const PakEntry& entry, uint64_t h) {
+        return entry.nameHash < h;
+    });
+
+    for (; it != end && it->nameHash == hash; ++it) {
+        if (it->nameLength == name.size() && memcmp(names + it->nameOffset, name.data(), name.size()) == 0) {
+            out.data = base + it->dataOffset;
+            out.size = it->dataSize;
+            return true;
+        }
+    }
+    return false;
+}
+
+vector<string> AssetArchive::list(const string& prefix) const {
+    vector<string> result;
+    if (!base) return result;
+
+    for (uint32_t i = 0; i < header->entryCount; i++) {
+        const PakEntry& entry = entries[i];
+        if (entry.nameLength >= prefix.size() && memcmp(names + entry.nameOffset, prefix.data(), prefix.size()) == 0) {
+            result.push_back(entryName(entry));
+        }
+    }
+    // Index order is hash order; callers expect something stable and readable
+    sort(result.begin(), result.end());
+    return result;
+}
+
+bool AssetArchive::verify() const {
+    if (!base) return false;
+
+    bool ok = true;
+    for (uint32_t i = 0; i < header->entryCount; i++) {
+        const PakEntry& entry = entries[i];
+        if (pakHash(base + entry.dataOffset, entry.dataSize) != entry.contentHash) {
+            cout << "Content hash mismatch: " << entryName(entry) << "\n";
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+AssetArchive& gameAssets() {
+    static AssetArchive archive;
+    // Static init runs exactly once even if several threads get here first
+    static const bool opened = [] {
+        if (!archive.open("assets.pak")) {
+            cout << "Warning: assets.pak not found - run 'make assets'\n";
+            return false;
+        }
+        return true;
+    }();
+    (void)opened;
+    return archive;
+}
@@ -0,0 +1,92 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// On-disk layout of assets.pak (built by `make assets`, see asset_pack.cpp):
+//   PakHeader | PakEntry[entryCount] (sorted by nameHash) | names | data...
+// Every data blob starts on a PAK_ALIGNMENT boundary so it can be handed
+// straight to SFML from the mapping.
+const char PAK_MAGIC[4] = {'F', 'P', 'A', 'K'};
+const uint32_t PAK_VERSION = 1;
+const uint32_t PAK_ALIGNMENT = 64;
+
+struct PakHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t entryCount;
+    uint32_t alignment;
+    uint64_t namesOffset;
+    uint64_t namesSize;
+    uint64_t totalSize;
+};
+
+struct PakEntry {
+    uint64_t nameHash;
+    uint64_t contentHash;
+    uint64_t dataOffset;
+    uint64_t dataSize;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+};
+
+// 64-bit FNV-1a, used for both the name index and the content hashes
+inline uint64_t pakHash(const void* data, size_t size) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+struct AssetData {
+    const void* data;
+    size_t size;
+};
+
+// Read-only view of a memory-mapped assets.pak. Lookups are a binary search
+// over the hashed index; the returned pointers stay valid until close().
+class AssetArchive {
+private:
+    const unsigned char* base;
+    size_t mappedSize;
+    const PakHeader* header;
+    const PakEntry* entries;
+    const char* names;
+
+    string entryName(const PakEntry& entry) const;
+
+public:
+    AssetArchive();
+    ~AssetArchive();
+    AssetArchive(const AssetArchive&) = delete;
+    AssetArchive& operator=(const AssetArchive&) = delete;
+
+    bool open(const string& path);
+    void close();
+    bool isOpen() const { return base != nullptr; }
+
+    bool find(const string& name, AssetData& out) const;
+    vector<string> list(const string& prefix) const;
+    bool verify() const;
+};
+
+// Process-wide archive, opened on first use from ./assets.pak
+AssetArchive& gameAssets();
+
+// Loads any SFML resource with a loadFromMemory(data, size) overload
+// (Texture, Image, SoundBuffer, Font) straight from the mapped archive
+template <typename Resource>
+bool loadAsset(Resource& resource, const string& name) {
+    AssetData asset;
+    return gameAssets().find(name, asset) && resource.loadFromMemory(asset.data, asset.size);
+}
+
+#endif // ASSETS_H
@@ -6,48 +6,113 @@
 // #include <map>
 // #include <cstdlib>
 #include "audio.h"
+#include "assets.h"
+#include "profiler.h"
+#include <cmath>
+#include <cstdint>
 using namespace sf;
 using namespace std;
 
-    AudioManager::AudioManager() : musicMuted(false), currentTrackIndex(0), randomMode(false), playlistActive(false), currentlyPlaying("") {
-    vector<pair<string, string>> soundFiles = {
-        {"Chester_Fries", "assets/audios/Chester_Fries.mp3"},
-        {"Fat_Tuesdays", "assets/audios/Fat_Tuesdays.mp3"},
-        {"ONO", "assets/audios/ONO.mp3"},
-        {"please", "assets/audios/please.mp3"},
-        {"Teaser", "assets/audios/Teaser.mp3"},
-        {"Toast", "assets/audios/Toast.mp3"},
-    };
-
-    // Build playlist from soundFiles
-    for (const auto& soundFile : soundFiles) {
-        playlist.push_back(soundFile.first);
+namespace {
+
+const unsigned EFFECT_SAMPLE_RATE = 44100;
+
+// A decaying tone over a decaying burst of noise, restarted every
+// `repeat` seconds if that is set (the ratchet of a gear)
+struct EffectShape {
+    double seconds;
+    double tone;  // Hz
+    double toneLevel;
+    double noiseLevel;
+    double decay;  // per second
+    double repeat;
+};
+
+// Indexed by SoundEffect
+const EffectShape EFFECT_SHAPES[SFX_COUNT] = {
+    {0.14, 95, 0.8, 0.35, 30, 0},       // lever: a low clunk
+    {0.18, 900, 0.3, 0.5, 90, 0.045},   // gear: ratchet clicks
+    {0.30, 0, 0, 0.35, 8, 0},           // valve: a hiss
+    {0.03, 2200, 0.5, 0.2, 180, 0},     // dial: a tick
+    {0.05, 1400, 0.5, 0.6, 120, 0},     // switch: a snap
+    {0.12, 660, 0.6, 0.05, 25, 0},      // button: a short beep
+};
+
+void synthesize(SoundBuffer& buffer, const EffectShape& shape) {
+    vector<Int16> samples(size_t(shape.seconds * EFFECT_SAMPLE_RATE));
+    uint32_t noise = 0x2545f491;  // fixed seed: every client sounds the same
+    for (size_t i = 0; i < samples.size(); i++) {
+        double t = double(i) / EFFECT_SAMPLE_RATE;
+        double since = shape.repeat > 0 ? fmod(t, shape.repeat) : t;
+        noise = noise * 1664525u + 1013904223u;
+        double white = (noise >> 8) / double(1 << 24) * 2 - 1;
+        double value = shape.toneLevel * sin(2 * M_PI * shape.tone * t) + shape.noiseLevel * white;
+        // The last 10 ms fade out so the end does not click
+        double fade = min(1.0, (shape.seconds - t) / 0.01);
+        value *= exp(-shape.decay * since) * fade;
+        samples[i] = Int16(max(-1.0, min(1.0, value)) * 0.8 * 32767);
     }
+    buffer.loadFromSamples(samples.data(), samples.size(), 1, EFFECT_SAMPLE_RATE);
+}
+
+}  // namespace
+
+    AudioManager::AudioManager() : musicMuted(false), currentTrackIndex(0), randomMode(false), playlistActive(false), currentlyPlaying("") {
+    // Every track packed under audios/ joins the playlist, named by its file stem
+    const string prefix = "audios/";
+    for (const auto& path : gameAssets().list(prefix)) {
+        string name = path.substr(prefix.size(), path.find_last_of('.') - prefix.size());
+        playlist.push_back(name);
 
-    // Load all sounds dynamically
-    for (const auto& soundFile : soundFiles) {
-        if (soundBuffers[soundFile.first].loadFromFile(soundFile.second)) {
-            sounds[soundFile.first].setBuffer(soundBuffers[soundFile.first]);
-            sounds[soundFile.first].setVolume(60);
-            cout << "Loaded sound: " << soundFile.first << "\n";
+        if (loadAsset(soundBuffers[name], path)) {
+            sounds[name].setBuffer(soundBuffers[name]);
+            sounds[name].setVolume(60);
+            cout << "Loaded sound: " << name << "\n";
         } else {
-            cout << "Warning: Could not load " << soundFile.first << " from " << soundFile.second << "\n";
+            cout << "Warning: Could not load " << name << " from " << path << "\n";
         }
     }
+    synthesizeEffects();
+}
+
+void AudioManager::synthesizeEffects() {
+    for (int effect = 0; effect < SFX_COUNT; effect++) {
+        synthesize(effectBuffers[effect], EFFECT_SHAPES[effect]);
+        for (Sound& voice : voices[effect]) {
+            voice.setBuffer(effectBuffers[effect]);
+            voice.setVolume(80);
+        }
+        nextVoice[effect] = 0;
+    }
+}
+
+void AudioManager::playEffect(SoundEffect effect) {
+    // Voices of an effect are started in turn, so the next one is the one
+    // that started longest ago: finished by now, or the one to cut off
+    Sound& voice = voices[effect][nextVoice[effect]];
+    nextVoice[effect] = (nextVoice[effect] + 1) % VOICES_PER_EFFECT;
+    voice.stop();
+    voice.play();
+}
+
+Sound* AudioManager::track(const string& name) {
+    if (name.empty()) return nullptr;
+    auto found = sounds.find(name);
+    return found == sounds.end() ? nullptr : &found->second;
 }
 
 void AudioManager::toggleMuteMusic() {
     musicMuted = !musicMuted;
     if (musicMuted) {
         // Stop current song if playing
-        if (!currentlyPlaying.empty() && sounds.find(currentlyPlaying) != sounds.end()) {
-            sounds[currentlyPlaying].pause();
+        if (Sound* current = track(currentlyPlaying)) {
+            current->pause();
         }
         cout << "Music muted\n";
     } else {
         // Resume current song if it was playing
-        if (!currentlyPlaying.empty() && sounds.find(currentlyPlaying) != sounds.end()) {
-            sounds[currentlyPlaying].play();
+        if (Sound* current = track(currentlyPlaying)) {
+            current->play();
         }
         cout << "Music unmuted\n";
     }
@@ -56,8 +121,8 @@ void AudioManager::toggleMuteMusic() {
 void AudioManager::playSound(const string& soundName) {
     if (musicMuted) return;
     
-    if (sounds.find(soundName) != sounds.end()) {
-        sounds[soundName].play();
+    if (Sound* sound = track(soundName)) {
+        sound->play();
     } else {
         cout << "Warning: Sound '" << soundName << "' not found\n";
     }
@@ -73,8 +138,8 @@ void AudioManager::playSound() {
     }
     
     // Stop current song if playing
-    if (!currentlyPlaying.empty() && sounds.find(currentlyPlaying) != sounds.end()) {
-        sounds[currentlyPlaying].stop();
+    if (Sound* current = track(currentlyPlaying)) {
+        current->stop();
     }
     
     // Play next song based on mode
@@ -83,8 +148,8 @@ void AudioManager::playSound() {
     }
     
     currentlyPlaying = playlist[currentTrackIndex];
-    if (sounds.find(currentlyPlaying) != sounds.end()) {
-        sounds[currentlyPlaying].play();
+    if (Sound* current = track(currentlyPlaying)) {
+        current->play();
         cout << "Now playing: " << currentlyPlaying << "\n";
     }
     
@@ -104,8 +169,8 @@ void AudioManager::startPlaylist(bool random) {
 
 void AudioManager::stopPlaylist() {
     playlistActive = false;
-    if (!currentlyPlaying.empty() && sounds.find(currentlyPlaying) != sounds.end()) {
-        sounds[currentlyPlaying].stop();
+    if (Sound* current = track(currentlyPlaying)) {
+        current->stop();
     }
     currentlyPlaying = "";
     cout << "Playlist stopped\n";
@@ -117,12 +182,12 @@ void AudioManager::nextTrack() {
 }
 
 bool AudioManager::isCurrentTrackFinished() {
-    if (currentlyPlaying.empty()) return true;
-    if (sounds.find(currentlyPlaying) == sounds.end()) return true;
-    return sounds[currentlyPlaying].getStatus() == Sound::Stopped;
+    Sound* current = track(currentlyPlaying);
+    return !current || current->getStatus() == Sound::Stopped;
 }
 
 void AudioManager::update() {
+    PROFILE_ZONE("AudioManager::update");
     // Auto-advance to next track when current one finishes
     if (playlistActive && isCurrentTrackFinished()) {
         playSound();
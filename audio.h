@@ -11,7 +11,22 @@
 using namespace sf;
 using namespace std;
 
+// Control sounds, by compile-time handle
+enum SoundEffect {
+    SFX_LEVER,
+    SFX_GEAR,
+    SFX_VALVE,
+    SFX_DIAL,
+    SFX_SWITCH,
+    SFX_BUTTON,
+    SFX_COUNT
+};
+
 class AudioManager {
+public:
+    // Voices per effect; a further play takes over the oldest of them
+    static const int VOICES_PER_EFFECT = 4;
+
 private:
     map<string, SoundBuffer> soundBuffers;
     map<string, Sound> sounds;
@@ -22,11 +37,23 @@ private:
     bool playlistActive;
     string currentlyPlaying;
 
+    // Effects are synthesized up front and every voice is bound to its
+    // buffer once, so playEffect() only restarts a voice: no lookup, no
+    // allocation (setBuffer() would register the voice with the buffer)
+    SoundBuffer effectBuffers[SFX_COUNT];
+    Sound voices[SFX_COUNT][VOICES_PER_EFFECT];
+    int nextVoice[SFX_COUNT];
+
+    Sound* track(const string& name);
+    void synthesizeEffects();
+
 public:
     AudioManager();
     void toggleMuteMusic();
     void playSound(const string& soundName);
     void playSound();
+    // Call on the frame of the input it answers
+    void playEffect(SoundEffect effect);
     void startPlaylist(bool random = false);
     void stopPlaylist();
     void nextTrack();
@@ -0,0 +1,112 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+#include "protocol.h"
+
+using namespace std;
+
+// Timestamps in PING/PONG and STATE lines: microseconds on the sender's
+// monotonic clock. The two ends' clocks share no epoch; ClockSync works
+// out the difference.
+inline int64_t monotonicMicros() {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Both sides ping each other this often; FACTORY_PING_MS overrides it
+inline chrono::milliseconds pingInterval() {
+    static const chrono::milliseconds interval = [] {
+        const char* setting = getenv("FACTORY_PING_MS");
+        long ms = setting ? atol(setting) : 0;
+        return chrono::milliseconds(ms >= 100 ? ms : 2000);
+    }();
+    return interval;
+}
+
+// The exchange, with t1..t4 as in NTP:
+//
+//   A -> B   PING|<t1>               t1 = A's clock when sent
+//   B -> A   PONG|<t1>|<t2>|<t3>     t2, t3 = B's clock on receipt, on reply
+//
+// and t4 = A's clock when the PONG arrives. Either side may start one.
+inline PongMessage pongFor(const PingMessage& ping, int64_t received) {
+    return {ping.sent, received, monotonicMicros()};
+}
+
+// Round-trip time and clock offset of one peer, from PING/PONG exchanges:
+//
+//   rtt    = (t4 - t1) - (t3 - t2)
+//   offset = ((t2 - t1) + (t3 - t4)) / 2     the peer's clock minus ours
+//
+// RTT is smoothed like TCP's SRTT and RTTVAR (RFC 6298). A single offset
+// is off by up to half the exchange's path asymmetry, and queueing makes
+// that worse, so like NTP's clock filter we trust the exchange with the
+// lowest RTT among the last FILTER_SIZE. Not thread-safe.
+class ClockSync {
+public:
+    static const int FILTER_SIZE = 8;
+
+    ClockSync() : samples(0), srtt(0), rttvar(0), latestRtt(0), currentOffset(0), nextSlot(0) {}
+
+    // pong answers one of our PINGs and arrived at t4
+    void addSample(const PongMessage& pong, int64_t t4) {
+        addSample(pong.sent, pong.received, pong.replied, t4);
+    }
+
+    void addSample(int64_t t1, int64_t t2, int64_t t3, int64_t t4) {
+        int64_t rtt = (t4 - t1) - (t3 - t2);
+        if (rtt < 0) rtt = 0;  // the peer took longer to answer than the whole exchange: clock noise
+        int64_t offset = ((t2 - t1) + (t3 - t4)) / 2;
+
+        if (samples == 0) {
+            srtt = rtt;
+            rttvar = rtt / 2;
+        } else {
+            int64_t error = rtt > srtt ? rtt - srtt : srtt - rtt;
+            rttvar += (error - rttvar) / 4;
+            srtt += (rtt - srtt) / 8;
+        }
+        latestRtt = rtt;
+
+        filter[nextSlot] = {rtt, offset};
+        nextSlot = (nextSlot + 1) % FILTER_SIZE;
+        samples++;
+        int stored = samples < FILTER_SIZE ? samples : FILTER_SIZE;
+        int best = 0;
+        for (int i = 1; i < stored; i++) {
+            if (filter[i].rtt < filter[best].rtt) best = i;
+        }
+        currentOffset = filter[best].offset;
+    }
+
+    bool synced() const { return samples > 0; }
+    int samplesTaken() const { return samples; }
+
+    // Microseconds; all 0 until synced()
+    int64_t smoothedRtt() const { return srtt; }
+    int64_t rttVariation() const { return rttvar; }
+    int64_t lastRtt() const { return latestRtt; }
+    int64_t offset() const { return currentOffset; }
+
+    // Our clock reading as the peer's clock would show it
+    int64_t toPeer(int64_t local) const { return local + currentOffset; }
+
+private:
+    struct Sample {
+        int64_t rtt;
+        int64_t offset;
+    };
+
+    int samples;
+    int64_t srtt;
+    int64_t rttvar;
+    int64_t latestRtt;
+    int64_t currentOffset;
+    Sample filter[FILTER_SIZE];
+    int nextSlot;
+};
+
+#endif // CLOCK_SYNC_H
@@ -0,0 +1,139 @@
+#ifndef ELECTRICAL_CLIENT_H
+#define ELECTRICAL_CLIENT_H
+
+#include <SFML/Graphics.hpp>
+// #include "audio.cpp"
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include "game_client.h"
+
+using namespace std;
+
+class ElectricalClient : public GameClient<ElectricalClient> {
+    friend class GameClient<ElectricalClient>;
+
+public:
+    static constexpr const char* roleName = "Electrical";
+
+private:
+    bool debugMode;
+    
+    // UI Elements
+    sf::RectangleShape switchButton;
+    sf::RectangleShape stabilizeButton;
+    sf::Text statusText;
+    sf::Text switchText;
+    sf::Text buttonText;
+
+    struct LocalControls {
+        string switchA = "Off";
+        string button = "Idle";
+    } controls;
+
+    void initializeGraphics() {
+        // Initialize switch button
+        switchButton.setSize(sf::Vector2f(100, 50));
+        switchButton.setPosition(100, 300);
+        switchButton.setFillColor(sf::Color::Red);
+        
+        // Initialize stabilize button
+        stabilizeButton.setSize(sf::Vector2f(100, 50));
+        stabilizeButton.setPosition(300, 300);
+        stabilizeButton.setFillColor(sf::Color::Blue);
+        
+        // Initialize text elements
+        statusText.setFont(font);
+        statusText.setCharacterSize(24);
+        statusText.setFillColor(sf::Color::White);
+        statusText.setPosition(10, 10);
+        
+        switchText.setFont(font);
+        switchText.setString("Switch: OFF");
+        switchText.setPosition(100, 360);
+        
+        buttonText.setFont(font);
+        buttonText.setString("Button: IDLE");
+        buttonText.setPosition(300, 360);
+    }
+
+    void handleEvents() {
+        PROFILE_ZONE("ElectricalClient::handleEvents");
+        sf::Event event;
+        while (window.pollEvent(event)) {
+            if (event.type == sf::Event::Closed)
+                window.close();
+            
+            if (event.type == sf::Event::MouseButtonPressed) {
+                // Switch toggle
+                if (event.mouseButton.button == sf::Mouse::Left) {
+                    sf::Vector2i mousePos = sf::Mouse::getPosition(window);
+                    if (switchButton.getGlobalBounds().contains(mousePos.x, mousePos.y)) {
+                        controls.switchA = (controls.switchA == "Off") ? "On" : "Off";
+                        playEffect(SFX_SWITCH);
+                        sendElectricalUpdate(controls.switchA, controls.button);
+                    }
+                    // Stabilize button
+                    if (stabilizeButton.getGlobalBounds().contains(mousePos.x, mousePos.y)) {
+                        controls.button = "Pressed";
+                        playEffect(SFX_BUTTON);
+                        sendElectricalUpdate(controls.switchA, controls.button);
+                    }
+                }
+            }
+            
+            if (event.type == sf::Event::MouseButtonReleased) {
+                if (event.mouseButton.button == sf::Mouse::Left) {
+                        controls.button = "Idle";
+                        sendElectricalUpdate(controls.switchA, controls.button);
+                    
+                }
+            }
+
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F3) {
+                toggleOverlay();
+            }
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F9) {
+                requestTraceDump();
+            }
+        }
+    }
+
+    void render() {
+        PROFILE_ZONE("ElectricalClient::render");
+        window.clear(sf::Color(50, 50, 50));
+        
+        // Update status text, predicted between ticks
+        StateMessage shown = displayedState();
+        stringstream ss;
+        ss << fixed << setprecision(1) << "Pressure: " << shown.pressure << "\n"
+           << "Temperature: " << shown.temperature << "\n"
+           << "Time Left: " << state.timeLeft;
+        statusText.setString(ss.str());
+        
+        // Update control texts
+        switchText.setString("Switch: " + controls.switchA);
+        buttonText.setString("Button: " + controls.button);
+        
+        // Draw everything
+        window.draw(statusText);
+        window.draw(switchButton);
+        window.draw(stabilizeButton);
+        window.draw(switchText);
+        window.draw(buttonText);
+        
+        presentFrame();
+    }
+
+public:
+    ElectricalClient() : debugMode(false) {
+        initializeGraphics();
+    }
+
+    void sendElectricalUpdate(const string& switchState, const string& buttonState) {
+        sendInput(ElectricalInputMessage{switchState, buttonState});
+    }
+};
+
+#endif // ELECTRICAL_CLIENT_H
@@ -0,0 +1,247 @@
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <pthread.h>
+#include <sched.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "profiler.h"
+#include "task.h"
+
+using namespace std;
+
+// Restricts a thread to one CPU; false if the kernel refused (the CPU is
+// not in our cpuset, say)
+inline bool pinThread(pthread_t thread, int cpu) {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    return pthread_setaffinity_np(thread, sizeof(cpus), &cpus) == 0;
+}
+
+// Double-ended queue of tasks in one ring that doubles when full and never
+// shrinks. Unlike deque, which frees and allocates a block whenever its
+// ends cross one, a queue that keeps filling and emptying at about the
+// same depth stops touching the heap once it has grown to that depth.
+class TaskRing {
+public:
+    typedef InlineTask Task;
+
+    TaskRing() : head(0), count(0) {}
+
+    bool empty() const { return count == 0; }
+
+    void push_back(Task task) {
+        if (count == slots.size()) grow();
+        slots[(head + count) & (slots.size() - 1)] = move(task);
+        count++;
+    }
+
+    Task pop_back() {
+        count--;
+        return move(slots[(head + count) & (slots.size() - 1)]);
+    }
+
+    Task pop_front() {
+        Task task = move(slots[head]);
+        head = (head + 1) & (slots.size() - 1);
+        count--;
+        return task;
+    }
+
+private:
+    vector<Task> slots;  // size is 0 or a power of two
+    size_t head;
+    size_t count;
+
+    void grow() {
+        vector<Task> bigger(max<size_t>(16, slots.size() * 2));
+        for (size_t i = 0; i < count; i++) bigger[i] = move(slots[(head + i) & (slots.size() - 1)]);
+        slots.swap(bigger);
+        head = 0;
+    }
+};
+
+// Fixed pool of worker threads with one task deque per worker. A worker
+// pushes and pops the back of its own deque (newest first, still warm in
+// its cache) and, when that runs dry, steals the oldest task from the
+// front of another worker's deque. Workers with nothing to do anywhere
+// park on a condition variable instead of spinning.
+//
+// Tasks submitted from a worker stay on that worker's deque; tasks from
+// any other thread are spread round-robin over per-worker inboxes, which
+// run oldest first. Recursive splitting (submit half of a range, keep the
+// other half) therefore balances itself, while an event loop feeding a
+// pool (a shard's reactor) has its readiness, timer and tick tasks run in
+// the order they came: a new read never gets ahead of an older tick.
+class Executor {
+public:
+    typedef InlineTask Task;
+
+    // name labels the workers' tracks in profiler traces
+    explicit Executor(size_t threads = thread::hardware_concurrency(), const string& name = "worker")
+        : stopping(false), queued(0), unfinished(0), parked(0), nextQueue(0), completed(0) {
+        threads = max<size_t>(1, threads);
+        for (size_t i = 0; i < threads; i++) queues.emplace_back(new WorkQueue());
+        for (size_t i = 0; i < threads; i++) workers.emplace_back(&Executor::workerLoop, this, i, name);
+    }
+
+    // Runs every task already submitted, then joins the workers
+    ~Executor() {
+        waitIdle();
+        {
+            lock_guard<mutex> lock(parkMutex);
+            stopping = true;
+        }
+        parkCondition.notify_all();
+        for (thread& worker : workers) worker.join();
+    }
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    void submit(Task task) {
+        unfinished.fetch_add(1);
+
+        bool fromWorker = currentIndex() >= 0 && current() == this;
+        size_t target = fromWorker ? currentIndex() : nextQueue.fetch_add(1, memory_order_relaxed) % queues.size();
+
+        // Counted before it is visible so queued never underflows. Pairs
+        // with the parked/queued check in workerLoop(): either the worker
+        // sees the task or we see the worker and wake it.
+        queued.fetch_add(1);
+        {
+            WorkQueue& queue = *queues[target];
+            lock_guard<mutex> lock(queue.lock);
+            (fromWorker ? queue.tasks : queue.inbox).push_back(move(task));
+        }
+        if (parked.load() > 0) {
+            lock_guard<mutex> lock(parkMutex);
+            parkCondition.notify_one();
+        }
+    }
+
+    // Blocks until every submitted task (including ones they submit) ran.
+    // Not for use from inside a task.
+    void waitIdle() {
+        unique_lock<mutex> lock(idleMutex);
+        idleCondition.wait(lock, [this] { return unfinished.load() == 0; });
+    }
+
+    size_t threadCount() const { return workers.size(); }
+
+    // Tasks finished since the pool started
+    uint64_t tasksRun() const { return completed.load(memory_order_relaxed); }
+
+    // Keeps every worker on one CPU
+    bool pinTo(int cpu) {
+        bool pinned = true;
+        for (thread& worker : workers) pinned = pinThread(worker.native_handle(), cpu) && pinned;
+        return pinned;
+    }
+
+    // Index of the calling worker in its executor, -1 on other threads
+    static int workerIndex() { return currentIndex(); }
+
+private:
+    struct WorkQueue {
+        mutex lock;
+        TaskRing tasks;  // submitted by this worker, newest first
+        TaskRing inbox;  // submitted by other threads, oldest first
+    };
+
+    vector<unique_ptr<WorkQueue>> queues;
+    vector<thread> workers;
+
+    mutex parkMutex;
+    condition_variable parkCondition;
+    bool stopping;
+
+    atomic<size_t> queued;      // tasks sitting in some deque
+    atomic<size_t> unfinished;  // submitted but not yet completed
+    atomic<size_t> parked;
+    atomic<size_t> nextQueue;
+    atomic<uint64_t> completed;
+
+    mutex idleMutex;
+    condition_variable idleCondition;
+
+    static Executor*& current() {
+        static thread_local Executor* executor = nullptr;
+        return executor;
+    }
+
+    static int& currentIndex() {
+        static thread_local int index = -1;
+        return index;
+    }
+
+    bool popLocal(size_t index, Task& task) {
+        WorkQueue& queue = *queues[index];
+        lock_guard<mutex> lock(queue.lock);
+        if (!queue.tasks.empty()) {
+            task = queue.tasks.pop_back();
+        } else if (!queue.inbox.empty()) {
+            task = queue.inbox.pop_front();
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    bool steal(size_t thief, Task& task) {
+        for (size_t offset = 1; offset < queues.size(); offset++) {
+            WorkQueue& victim = *queues[(thief + offset) % queues.size()];
+            unique_lock<mutex> lock(victim.lock, try_to_lock);
+            if (!lock.owns_lock()) continue;
+            if (!victim.inbox.empty()) {
+                task = victim.inbox.pop_front();
+            } else if (!victim.tasks.empty()) {
+                task = victim.tasks.pop_front();
+            } else {
+                continue;
+            }
+            return true;
+        }
+        return false;
+    }
+
+    void workerLoop(size_t index, string name) {
+        current() = this;
+        currentIndex() = index;
+        Profiler::nameThread(name + " " + to_string(index));
+
+        Task task;
+        while (true) {
+            if (popLocal(index, task) || steal(index, task)) {
+                queued.fetch_sub(1);
+                task();
+                task = nullptr;
+                completed.fetch_add(1, memory_order_relaxed);
+                if (unfinished.fetch_sub(1) == 1) {
+                    lock_guard<mutex> lock(idleMutex);
+                    idleCondition.notify_all();
+                }
+                continue;
+            }
+
+            // A steal can miss a task behind a contended lock, so only park
+            // once nothing is queued anywhere
+            unique_lock<mutex> lock(parkMutex);
+            parked.fetch_add(1);
+            parkCondition.wait(lock, [this] { return stopping || queued.load() > 0; });
+            parked.fetch_sub(1);
+            if (stopping && queued.load() == 0) return;
+        }
+    }
+};
+
+#endif // EXECUTOR_H
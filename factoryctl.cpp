@@ -0,0 +1,106 @@
+// Command line for a running server's admin socket (see admin.h):
+//
+//   ./factoryctl sessions
+//   ./factoryctl show 12
+//   ./factoryctl reset 12
+//   ./factoryctl end 12
+//   ./factoryctl log debug
+//   ./factoryctl profile
+//   ./factoryctl stats
+//
+// The socket is found the way the server picks it: FACTORY_ADMIN, else
+// /tmp/factory-<FACTORY_PORT>.sock with port 8888 by default. -s <path>
+// overrides both. Exits 1 if the server could not be reached or answered
+// with an error.
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+static string defaultPath() {
+    const char* setting = getenv("FACTORY_ADMIN");
+    if (setting && *setting) return setting;
+    const char* portSetting = getenv("FACTORY_PORT");
+    int port = portSetting ? atoi(portSetting) : 0;
+    if (port <= 0 || port >= 65536) port = 8888;
+    return "/tmp/factory-" + to_string(port) + ".sock";
+}
+
+static void usage() {
+    cout << "usage: factoryctl [-s socket] <command>\n"
+            "  sessions               list running matches\n"
+            "  show <id>              dump a match's game state\n"
+            "  reset <id>             reset a match to waiting for both players\n"
+            "  end <id>               end a match\n"
+            "  log [debug|info|warn]  show or set the log level\n"
+            "  profile                start profiling; again to write a trace\n"
+            "  stats                  the full stats report\n";
+}
+
+int main(int argc, char** argv) {
+    string path = defaultPath();
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "-s") == 0) {
+        path = argv[2];
+        first = 3;
+    }
+    if (first >= argc || strcmp(argv[first], "-h") == 0 || strcmp(argv[first], "--help") == 0) {
+        usage();
+        return first >= argc ? 1 : 0;
+    }
+
+    string command;
+    for (int i = first; i < argc; i++) {
+        if (i > first) command += ' ';
+        command += argv[i];
+    }
+    command += '\n';
+
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(address.sun_path)) {
+        cout << "Socket path too long: " << path << "\n";
+        return 1;
+    }
+    strcpy(address.sun_path, path.c_str());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        perror("socket creation failed");
+        return 1;
+    }
+    if (connect(fd, (sockaddr*)&address, sizeof(address)) < 0) {
+        cout << "Cannot reach the server at " << path << ": " << strerror(errno) << "\n";
+        close(fd);
+        return 1;
+    }
+    if (send(fd, command.data(), command.size(), MSG_NOSIGNAL) != ssize_t(command.size())) {
+        perror("send failed");
+        close(fd);
+        return 1;
+    }
+
+    // The server closes the connection after its reply
+    string reply;
+    char buffer[4096];
+    ssize_t received;
+    while ((received = recv(fd, buffer, sizeof(buffer), 0)) != 0) {
+        if (received < 0) {
+            if (errno == EINTR) continue;
+            perror("recv failed");
+            break;
+        }
+        reply.append(buffer, received);
+    }
+    close(fd);
+
+    cout << reply;
+    return reply.empty() || reply.compare(0, 6, "error:") == 0 ? 1 : 0;
+}
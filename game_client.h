@@ -0,0 +1,485 @@
+#ifndef GAME_CLIENT_H
+#define GAME_CLIENT_H
+
+#include <SFML/Graphics.hpp>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <chrono>
+#include "clock_sync.h"
+#include "lockstep.h"
+#include "menus.h"
+#include "perf_overlay.h"
+#include "prediction.h"
+#include "profiler.h"
+#include "protocol.h"
+#include "transport.h"
+
+using namespace std;
+
+// Shared client core: the server connection, the state mailbox and the
+// menu/wait/play loop. Role is the concrete client (CRTP) and supplies
+//   static constexpr const char* roleName;
+//   void handleEvents();
+//   void render();
+// and optionally updateSpriteStates(). Calls go through role() so they are
+// resolved at compile time, no virtual dispatch in the frame loop.
+template <typename Role>
+class GameClient {
+protected:
+    atomic<bool> connected;
+    bool gameStart;
+    bool newGame;
+
+    // Render-thread copy of the latest state, refreshed once per frame
+    StateMessage state;
+
+    Menus menus;
+    CountingWindow window;
+    sf::Font font;
+    sf::Text waitingText;
+    PerfOverlay overlay;
+
+    Role& role() { return static_cast<Role&>(*this); }
+
+    // Default for roles without animated sprites
+    void updateSpriteStates() {}
+
+    // Called from the render thread and, for PINGs and PONGs, the receive
+    // thread
+    template <typename Message>
+    bool send(const Message& message) {
+        shared_ptr<Transport> current = currentTransport();
+        lock_guard<mutex> lock(sendMutex);
+        encode(message, outgoing);
+        return sendLocked(*current, outgoing);
+    }
+
+    // A MECH or ELEC from the role: numbered, and fed to the prediction
+    template <typename Input>
+    bool sendInput(Input input) {
+        input.seq = ++inputSeq;
+        predictor.sent(input);
+        encode(input, lastInput);
+        shared_ptr<Transport> current = currentTransport();
+        lock_guard<mutex> lock(sendMutex);
+        return sendLocked(*current, lastInput);
+    }
+
+    // A control's sound, from the input handler so it lands on the frame
+    // of the click or key rather than when the server's answer arrives
+    void playEffect(SoundEffect effect) { menus.audio().playEffect(effect); }
+
+    // Ends a frame in place of window.display(): the overlay (F3) goes on
+    // top of whatever the role drew
+    void presentFrame() {
+        overlay.frameFinished(window.takeDrawCalls());
+        if (overlay.visible()) overlay.draw(window, networkStats());
+        window.display();
+    }
+
+    void toggleOverlay() { overlay.toggle(); }
+
+    // The state to draw gauges and readouts from: pressure and temperature
+    // as predicted for this frame from the latest state and the controls
+    // (see prediction.h), so they respond to an input straight away and
+    // glide between ticks
+    StateMessage displayedState() { return predictor.shown(monotonicMicros()); }
+
+    // F9: the first press starts recording zones, later ones write a trace
+    void requestTraceDump() {
+        bool wasRecording = Profiler::enabled();
+        string path = Profiler::requestDump();
+        if (!wasRecording) {
+            cout << "Profiling on, press F9 again to write a trace\n";
+        } else if (!path.empty()) {
+            cout << "Wrote profile trace to " << path << "\n";
+        }
+    }
+
+private:
+    // How long we keep trying to get back into a match after losing the
+    // connection; the server holds our seat a little longer than this
+    static constexpr int RESUME_WINDOW_SECONDS = 25;
+
+    // Replaced by the receive thread when it reconnects
+    mutex transportMutex;
+    shared_ptr<Transport> transport;
+    mutex sendMutex;  // transports take one sender at a time
+    string outgoing;  // encoded line being sent, under sendMutex
+    string serverAddress;  // empty for in-process transports
+
+    // Written by the receive thread, taken by the render thread: the latest
+    // state and the latest controls the server passed on for each station
+    mutex mailboxMutex;
+    StateMessage mailbox;
+    int64_t mailboxAt;  // when mailbox arrived, our clock
+    bool mailboxFresh;
+    MechanicalInputMessage mailboxMechanical;
+    ElectricalInputMessage mailboxElectrical;
+    bool mechanicalFresh;
+    bool electricalFresh;
+
+    // Render thread only
+    Predictor predictor;
+    uint32_t inputSeq;  // of the latest input we sent
+    string lastInput;   // and its line, to send again after a RESUME
+    atomic<bool> resumed;  // set by the receive thread on reconnecting
+
+    // Receive thread only
+    string resumeToken;
+
+    // Lockstep mode, once the server has sent a LOCKSTEP: our copy of the
+    // match, and the state shown from it (the latest STATE, stepped since)
+    bool lockstep;
+    bool awaitingSeed;  // sent a DESYNC, ignoring steps until the reseed
+    LockstepSim lockstepSim;
+    StateMessage lockstepState;
+
+    // For the overlay, counted by whichever thread sends or receives
+    atomic<uint64_t> bytesIn;
+    atomic<uint64_t> bytesOut;
+
+    // Latency to the server, from our PINGs; fed by the receive thread
+    mutex clockMutex;
+    ClockSync clockSync;
+    int64_t lastStateAt;  // our clock when the latest STATE arrived; 0 before
+    int64_t lastPingAt;   // receive thread only
+
+    shared_ptr<Transport> currentTransport() {
+        lock_guard<mutex> lock(transportMutex);
+        return transport;
+    }
+
+    bool sendLocked(Transport& current, const string& line) {
+        if (!current.sendMessage(line)) {
+            cout << "Failed to send to server\n";
+            return false;
+        }
+        bytesOut += line.size() + 1;
+        return true;
+    }
+
+    void handleMessage(const string& message) {
+        PROFILE_ZONE("GameClient::handleMessage");
+        bytesIn += message.size() + 1;
+        if (hasTag<StateMessage>(message)) {
+            int64_t now = monotonicMicros();
+            {
+                lock_guard<mutex> lock(clockMutex);
+                lastStateAt = now;
+            }
+            StateMessage parsed;
+            if (decode(message, parsed)) {
+                lockstepState = parsed;
+                lockstepSim.seed(parsed);
+                lock_guard<mutex> lock(mailboxMutex);
+                mailbox = parsed;
+                mailboxAt = now;
+                mailboxFresh = true;
+            } else {
+                cout << "Bad game state, expected " << layout<StateMessage>() << "\n";
+            }
+            return;
+        }
+
+        if (handleLockstep(message)) return;
+
+        WelcomeMessage welcome;
+        PingMessage ping;
+        PongMessage pong;
+        LobbyMessage lobby;
+        if (decode(message, welcome)) {
+            resumeToken = welcome.token;
+        } else if (decode(message, ping)) {
+            // The server's heartbeat; it drops players that stop answering
+            send(pongFor(ping, monotonicMicros()));
+        } else if (decode(message, pong)) {
+            lock_guard<mutex> lock(clockMutex);
+            clockSync.addSample(pong, monotonicMicros());
+        } else if (decode(message, lobby)) {
+            if (lobby.status == "RESUME_FAILED") {
+                cout << "The match is gone, cannot resume\n";
+                resumeToken.clear();
+            } else if (lobby.status == "BAD_VERSION") {
+                cout << "The server speaks another protocol version, update the game\n";
+            } else if (lobby.status == "DRAINING") {
+                cout << "The server is restarting, try again in a moment\n";
+            }
+        }
+    }
+
+    // The lockstep lines, and the MECH and ELEC the server passes on in
+    // either mode; false for any other message
+    bool handleLockstep(const string& message) {
+        LockstepMessage seed;
+        MechanicalInputMessage mechanical;
+        ElectricalInputMessage electrical;
+        StepMessage step;
+        StateHashMessage hash;
+        if (decode(message, seed)) {
+            // The STATE, MECH and ELEC that come next finish the seed
+            lockstep = true;
+            awaitingSeed = false;
+            lockstepSim.setTick(seed.tick);
+        } else if (decode(message, mechanical)) {
+            lockstepSim.setMechanical(controlsOf(mechanical));
+            // Applied by the next STEP, whose state then includes it
+            lockstepState.mechanicalSeq = mechanical.seq;
+            lock_guard<mutex> lock(mailboxMutex);
+            mailboxMechanical = mechanical;
+            mechanicalFresh = true;
+        } else if (decode(message, electrical)) {
+            lockstepSim.setElectrical(controlsOf(electrical));
+            lockstepState.electricalSeq = electrical.seq;
+            lock_guard<mutex> lock(mailboxMutex);
+            mailboxElectrical = electrical;
+            electricalFresh = true;
+        } else if (decode(message, step)) {
+            if (!lockstep || awaitingSeed) return true;
+            if (step.tick != lockstepSim.tick() + 1) {
+                requestSeed(step.tick, "missed a step");
+                return true;
+            }
+            lockstepSim.step();
+            lockstepSim.fill(lockstepState);
+            lockstepState.serverTime = step.serverTime;
+            int64_t now = monotonicMicros();
+            {
+                lock_guard<mutex> lock(clockMutex);
+                lastStateAt = now;
+            }
+            lock_guard<mutex> lock(mailboxMutex);
+            mailbox = lockstepState;
+            mailboxAt = now;
+            mailboxFresh = true;
+        } else if (decode(message, hash)) {
+            if (!lockstep || awaitingSeed) return true;
+            if (hash.tick != lockstepSim.tick() || hash.hash != lockstepSim.hash()) requestSeed(hash.tick, "state hash differs");
+        } else {
+            return hasTag<StepMessage>(message) || hasTag<StateHashMessage>(message) || hasTag<LockstepMessage>(message);
+        }
+        return true;
+    }
+
+    void requestSeed(uint32_t tick, const char* reason) {
+        cout << "Out of sync with the server at step " << tick << " (" << reason << "), resyncing\n";
+        awaitingSeed = true;
+        send(DesyncMessage{tick});
+    }
+
+    // After a dropped connection: reconnect and take our seat back with the
+    // token from WELCOME. The server then resends the full state.
+    bool resumeSession() {
+        if (resumeToken.empty() || serverAddress.empty()) return false;
+        cout << "Connection lost, trying to resume the match...\n";
+
+        auto deadline = chrono::steady_clock::now() + chrono::seconds(RESUME_WINDOW_SECONDS);
+        while (connected && chrono::steady_clock::now() < deadline) {
+            unique_ptr<Transport> fresh = connectTcp(serverAddress, 8888);
+            if (fresh && fresh->sendMessage(encode(ResumeMessage{resumeToken}))) {
+                {
+                    lock_guard<mutex> lock(transportMutex);
+                    transport = move(fresh);
+                }
+                resumed = true;
+                // Possibly a different route now
+                lock_guard<mutex> lock(clockMutex);
+                clockSync = ClockSync();
+                cout << "Reconnected to server\n";
+                return true;
+            }
+            this_thread::sleep_for(chrono::seconds(1));
+        }
+        return false;
+    }
+
+    void pollState() {
+        bool fresh;
+        int64_t at;
+        {
+            lock_guard<mutex> lock(mailboxMutex);
+            if (mechanicalFresh) predictor.serverControls(mailboxMechanical);
+            if (electricalFresh) predictor.serverControls(mailboxElectrical);
+            mechanicalFresh = false;
+            electricalFresh = false;
+            fresh = mailboxFresh;
+            if (fresh) state = mailbox;
+            at = mailboxAt;
+            mailboxFresh = false;
+        }
+        if (!fresh) return;
+
+        {
+            // The state was made at serverTime: on our clock, that excludes
+            // the trip here. Arrival time until the offset is known.
+            lock_guard<mutex> lock(clockMutex);
+            if (clockSync.synced() && state.serverTime != 0) at = state.serverTime - clockSync.offset();
+        }
+        predictor.authoritative(state, at);
+
+        // Whatever we sent while the connection was down never arrived
+        if (resumed.exchange(false) && predictor.unacknowledged() > 0) {
+            shared_ptr<Transport> current = currentTransport();
+            lock_guard<mutex> lock(sendMutex);
+            sendLocked(*current, lastInput);
+        }
+    }
+
+    void showWaitingScreen() {
+        window.clear(sf::Color(50, 50, 50));
+        window.draw(waitingText);
+        presentFrame();
+
+        // Handle window events while waiting
+        sf::Event event;
+        while (window.pollEvent(event)) {
+            if (event.type == sf::Event::Closed)
+                window.close();
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F3)
+                toggleOverlay();
+        }
+    }
+
+    // Receive thread, after every message: the server sends at least its
+    // own PINGs, so this keeps going as long as the connection does
+    void pingIfDue() {
+        int64_t now = monotonicMicros();
+        if (now - lastPingAt < chrono::duration_cast<chrono::microseconds>(pingInterval()).count()) return;
+        lastPingAt = now;
+        send(PingMessage{now});
+    }
+
+    NetworkStats networkStats() {
+        NetworkStats stats = {-1, -1, 0, false, bytesIn, bytesOut, predictor.unacknowledged()};
+        int64_t now = monotonicMicros();
+        lock_guard<mutex> lock(clockMutex);
+        if (clockSync.synced()) {
+            stats.rttMs = clockSync.smoothedRtt() / 1000.0;
+            stats.clockOffsetMs = clockSync.offset() / 1000.0;
+            stats.clockSynced = true;
+        }
+        // True age on the server's clock: includes the trip here
+        if (clockSync.synced() && state.serverTime != 0) {
+            stats.stateAgeMs = (clockSync.toPeer(now) - state.serverTime) / 1000.0;
+        } else if (lastStateAt != 0) {
+            stats.stateAgeMs = (now - lastStateAt) / 1000.0;
+        }
+        return stats;
+    }
+
+public:
+    GameClient()
+        : connected(false), gameStart(false), newGame(false), overlay(font), mailboxAt(0), mailboxFresh(false),
+          mechanicalFresh(false), electricalFresh(false), inputSeq(0), resumed(false), lockstep(false),
+          awaitingSeed(false), bytesIn(0), bytesOut(0), lastStateAt(0), lastPingAt(0) {
+        window.create(sf::VideoMode(800, 600), string("Machine Game - ") + Role::roleName);
+        window.setFramerateLimit(60);
+
+        if (!font.loadFromFile("/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf")) {
+            cout << "Error loading font\n";
+        }
+
+        waitingText.setFont(font);
+        waitingText.setString("Waiting for other player...");
+        waitingText.setCharacterSize(48);
+        waitingText.setFillColor(sf::Color::White);
+        waitingText.setPosition(150, 250);
+    }
+
+    bool connectToServer(const string& serverIP = "127.0.0.1") {
+        unique_ptr<Transport> tcp = connectTcp(serverIP, 8888);
+        if (!tcp) {
+            return false;
+        }
+        attachTransport(move(tcp));
+        serverAddress = serverIP;
+        // The server's lobby pairs us by the role we ask for here
+        if (!send(HelloMessage{Role::roleName, PROTOCOL_VERSION})) {
+            return false;
+        }
+        cout << "Connected to server as " << Role::roleName << " Player!\n";
+        return true;
+    }
+
+    // Used directly by the single-process build with a loopback endpoint
+    void attachTransport(unique_ptr<Transport> connection) {
+        lock_guard<mutex> lock(transportMutex);
+        transport = move(connection);
+        connected = true;
+    }
+
+    void receiveGameState() {
+        Profiler::nameThread("receive");
+        string message;
+        while (connected) {
+            if (currentTransport()->receiveMessage(message)) {
+                handleMessage(message);
+                pingIfDue();
+            } else if (!connected || !resumeSession()) {
+                cout << "Server disconnected\n";
+                connected = false;
+                break;
+            }
+        }
+    }
+
+    void showPlayAgainPrompt() {
+        cout << "=== PLAY AGAIN? ===\n";
+        cout << "Mechanical player wants replay: " << (state.mechanicalWantsReplay ? "YES" : "waiting...") << "\n";
+        cout << "Electrical player wants replay: " << (state.electricalWantsReplay ? "YES" : "waiting...") << "\n";
+        cout << "Type: 'replay yes' or 'replay no'\n\n";
+    }
+
+    void sendPlayerReady() {
+        send(ReadyMessage());
+    }
+
+    void sendPlayAgainResponse(bool wantsReplay) {
+        send(PlayAgainMessage{wantsReplay});
+    }
+
+    void run() {
+        thread receiveThread(&GameClient::receiveGameState, this);
+        Profiler::nameThread("render");
+
+        bool playerReady = false;  // Track if this player has clicked start
+
+        while (window.isOpen() && connected) {
+            pollState();
+
+            if (!playerReady) {
+                // Show menu until player clicks start
+                menus.MainMenu(window, font, gameStart, newGame);
+
+                if (gameStart) {
+                    // Player clicked start - they're now ready
+                    playerReady = true;
+                    sendPlayerReady();
+                    cout << Role::roleName << " player is ready! Waiting for the other player...\n";
+                }
+            } else if (state.gameActive) {
+                // Both players ready and game is active - play normally
+                role().handleEvents();
+                role().updateSpriteStates();
+                role().render();
+            } else {
+                // Player is ready but game not active yet - show waiting screen
+                showWaitingScreen();
+            }
+        }
+
+        // Unblock the receive thread if we are leaving because the window closed
+        connected = false;
+        currentTransport()->shutdown();
+        if (receiveThread.joinable()) {
+            receiveThread.join();
+        }
+    }
+};
+
+#endif // GAME_CLIENT_H
@@ -0,0 +1,805 @@
+// Session gateway: the one address players connect to when the game runs as
+// several server processes ("backends"), on this host or others.
+//
+//   FACTORY_BACKENDS=10.0.0.2:8888,127.0.0.1:8889 ./gateway
+//
+// The gateway reads a new connection's first line and picks its backend:
+//
+//   HELLO|<role>|<version>   the backend where a player of the other role is
+//                            already waiting, else the one with the fewest
+//                            players, so both halves of a pair meet in the
+//                            same lobby
+//   RESUME|<token>           the backend that issued the token, from the
+//                            session directory
+//
+// Until the backend's WELCOME the gateway relays line by line. It records
+// the token in the directory, and it declines the backend's shared-memory
+// offer (see transport.cpp), which is meant for the gateway itself and not
+// for the player behind it. That is all it ever parses. From WELCOME on,
+// both directions are moved with splice() through a pipe, so game traffic
+// is not copied into this process at all. A local backend is therefore
+// proxied the same way as a remote one, and any backend, local or remote,
+// can take any new player.
+//
+// A backend that refuses connections, or answers LOBBY|DRAINING (a server
+// that got SIGTERM), is skipped for BACKEND_RETRY and the player is quietly
+// sent elsewhere. For a rolling restart, drain a backend on the console:
+// it gets no new players but keeps serving its matches and their resumes,
+// and the gateway says when its last player is gone.
+//
+// Console (stdin): drain <backend>, undrain <backend>, status. A backend
+// is named by its position in FACTORY_BACKENDS (from 0) or as host:port.
+// SIGUSR2 also logs the status; SIGINT and SIGTERM stop the gateway.
+//
+// FACTORY_PORT is where players connect (default 8888); FACTORY_BACKENDS
+// defaults to a single server on 127.0.0.1:8889.
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "log.h"
+#include "protocol.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+const chrono::seconds HELLO_TIMEOUT(10);       // same as the lobby's
+const chrono::seconds BACKEND_RETRY(5);        // a refusing backend is skipped this long
+const chrono::minutes DIRECTORY_TTL(10);       // tokens untouched this long are forgotten
+const size_t MAX_GREETING = 4096;              // bytes a client may send before WELCOME
+const size_t MAX_LINE = 4096;                  // from a backend, before WELCOME
+const size_t SPLICE_CHUNK = 64 * 1024;
+
+struct Link;
+
+struct Backend {
+    string name;  // host:port
+    sockaddr_in address;
+    bool draining = false;        // by the operator, until undrained
+    Clock::time_point downUntil;  // refused us or is draining itself
+    size_t links = 0;             // players connected through us
+    list<Link*> waiting[2];       // by role: sent HELLO, no partner routed here since
+    uint64_t routed = 0;
+};
+
+// One direction of a link: bytes the gateway still has to write (before
+// WELCOME, and what arrived along with it), then a pipe spliced through
+struct Flow {
+    string pending;
+    size_t pendingSent = 0;
+    int pipe[2] = {-1, -1};
+    size_t inPipe = 0;
+    bool eof = false;   // the source is done
+    bool shut = false;  // and everything reached the destination
+};
+
+const uint32_t UNREGISTERED = ~0u;
+
+// A player's connection and the gateway's connection to its backend
+struct Link {
+    enum Phase { ROUTING, CONNECTING, HANDSHAKE, SPLICING };
+
+    uint64_t id;
+    int client;
+    int backend = -1;
+    Backend* target = nullptr;
+    Phase phase = ROUTING;
+    int role = -1;  // 0 Mechanical, 1 Electrical, -1 resuming
+    bool inQueue = false;
+    list<Link*>::iterator queued;  // in target->waiting[role], while inQueue
+    string resumeToken;
+    string greeting;       // all the client sent before WELCOME, to replay elsewhere
+    string backendLine;    // partial line from the backend, before WELCOME
+    set<Backend*> tried;   // for this HELLO, so a rerouted player cannot loop
+    Flow toBackend, toClient;
+    uint32_t clientEvents = UNREGISTERED, backendEvents = UNREGISTERED;  // with epoll
+    Clock::time_point admitted;
+};
+
+class Gateway {
+public:
+    Gateway(int listenPort, vector<Backend> backendList)
+        : port(listenPort), backends(move(backendList)), epollFd(-1), listenFd(-1), signalFd(-1),
+          running(false), nextLink(1) {}
+
+    ~Gateway() {
+        while (!links.empty()) closeLink(*links.begin()->second, nullptr);
+        if (listenFd != -1) close(listenFd);
+        if (signalFd != -1) close(signalFd);
+        if (epollFd != -1) close(epollFd);
+    }
+
+    bool start() {
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd < 0) {
+            perror("epoll_create1 failed");
+            return false;
+        }
+
+        listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listenFd < 0) {
+            perror("socket creation failed");
+            return false;
+        }
+        int opt = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = INADDR_ANY;
+        address.sin_port = htons(port);
+        if (bind(listenFd, (sockaddr*)&address, sizeof(address)) < 0 || listen(listenFd, SOMAXCONN) < 0) {
+            perror("bind failed");
+            return false;
+        }
+        watchControl(listenFd, LISTENER);
+
+        sigset_t signals;
+        sigemptyset(&signals);
+        sigaddset(&signals, SIGINT);
+        sigaddset(&signals, SIGTERM);
+        sigaddset(&signals, SIGUSR2);
+        sigprocmask(SIG_BLOCK, &signals, NULL);
+        signalFd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (signalFd >= 0) watchControl(signalFd, SIGNALS);
+
+        // Anything but a terminal or a pipe (e.g. /dev/null) cannot be watched
+        fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+        watchControl(STDIN_FILENO, CONSOLE);
+
+        LOG(LogLevel::Info) << "Gateway on port " << port << " for " << backends.size() << " backend"
+                            << (backends.size() == 1 ? "" : "s") << ": " << backendNames();
+        return true;
+    }
+
+    void run() {
+        running = true;
+        epoll_event events[256];
+        Clock::time_point lastSweep = Clock::now();
+        while (running) {
+            int count = epoll_wait(epollFd, events, 256, 1000);
+            if (count < 0 && errno != EINTR) {
+                perror("epoll_wait failed");
+                return;
+            }
+            for (int i = 0; i < count; i++) dispatch(events[i]);
+
+            if (Clock::now() - lastSweep >= chrono::seconds(1)) {
+                sweep();
+                lastSweep = Clock::now();
+            }
+        }
+    }
+
+private:
+    // epoll_event.data: link id << 2 | side, or a control fd
+    enum Side { CLIENT = 0, BACKEND = 1, CONTROL = 2 };
+    enum Control { LISTENER, SIGNALS, CONSOLE };
+
+    int port;
+    vector<Backend> backends;
+    int epollFd;
+    int listenFd;
+    int signalFd;
+    string consoleLine;
+    bool running;
+
+    uint64_t nextLink;
+    unordered_map<uint64_t, unique_ptr<Link>> links;
+
+    struct DirectoryEntry {
+        Backend* backend;
+        Clock::time_point touched;  // WELCOME or a disconnect, whichever was last
+    };
+    unordered_map<string, DirectoryEntry> directory;
+    Clock::time_point lastPurge;
+
+    bool watchControl(int fd, Control which) {
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u64 = uint64_t(which) << 2 | CONTROL;
+        return epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0;
+    }
+
+    string backendNames() const {
+        string names;
+        for (const Backend& backend : backends) names += (names.empty() ? "" : ", ") + backend.name;
+        return names;
+    }
+
+    void dispatch(const epoll_event& event) {
+        uint64_t id = event.data.u64 >> 2;
+        Side side = Side(event.data.u64 & 3);
+        if (side == CONTROL) {
+            if (id == LISTENER) acceptPlayers();
+            else if (id == SIGNALS) readSignals();
+            else readConsole();
+            return;
+        }
+
+        auto found = links.find(id);
+        if (found == links.end()) return;  // closed earlier in this batch
+        Link& link = *found->second;
+        bool alive;
+        if (side == CLIENT) alive = clientReady(link, event.events);
+        else alive = backendReady(link, event.events);
+        if (alive) updateEvents(link);
+    }
+
+    void acceptPlayers() {
+        while (true) {
+            int fd = accept4(listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept player failed");
+                return;
+            }
+            int opt = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+            unique_ptr<Link> link(new Link);
+            link->id = nextLink++;
+            link->client = fd;
+            link->admitted = Clock::now();
+            Link& added = *link;
+            links[added.id] = move(link);
+            updateEvents(added);
+        }
+    }
+
+    // Registers the events each side of link waits for now
+    void updateEvents(Link& link) {
+        bool splicing = link.phase == Link::SPLICING;
+        bool relaying = link.phase == Link::HANDSHAKE || splicing;
+        auto idle = [](const Flow& flow) { return flow.pending.size() == flow.pendingSent && flow.inPipe == 0; };
+
+        uint32_t client = 0, backend = 0;
+        if (link.phase == Link::ROUTING) client |= EPOLLIN;
+        if (relaying && !link.toBackend.eof && (!splicing || idle(link.toBackend))) client |= EPOLLIN;
+        if (relaying && !idle(link.toClient)) client |= EPOLLOUT;
+        if (relaying && !link.toClient.eof && (!splicing || idle(link.toClient))) backend |= EPOLLIN;
+        if (link.phase == Link::CONNECTING || (relaying && !idle(link.toBackend))) backend |= EPOLLOUT;
+
+        setEvents(link.client, link.id << 2 | CLIENT, link.clientEvents, client);
+        if (link.backend != -1) setEvents(link.backend, link.id << 2 | BACKEND, link.backendEvents, backend);
+    }
+
+    void setEvents(int fd, uint64_t data, uint32_t& registered, uint32_t wanted) {
+        if (wanted == registered) return;
+        epoll_event event = {};
+        event.events = wanted;
+        event.data.u64 = data;
+        epoll_ctl(epollFd, registered == UNREGISTERED ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &event);
+        registered = wanted;
+    }
+
+    bool clientReady(Link& link, uint32_t events) {
+        if (link.phase == Link::ROUTING) return readGreeting(link);
+
+        if ((events & (EPOLLERR | EPOLLHUP)) && !(events & EPOLLIN)) {
+            closeLink(link, "client connection failed");
+            return false;
+        }
+        if ((events & EPOLLOUT) && !pump(link, link.toClient, link.backend, link.client)) return false;
+        if (events & EPOLLIN) {
+            if (link.phase == Link::HANDSHAKE) return relayGreeting(link);
+            if (!pump(link, link.toBackend, link.client, link.backend)) return false;
+        }
+        return finishIfDone(link);
+    }
+
+    bool backendReady(Link& link, uint32_t events) {
+        if (link.phase == Link::CONNECTING) return connected(link);
+
+        if ((events & (EPOLLERR | EPOLLHUP)) && !(events & EPOLLIN)) {
+            closeLink(link, "backend connection failed");
+            return false;
+        }
+        if ((events & EPOLLOUT) && !pump(link, link.toBackend, link.client, link.backend)) return false;
+        if (events & EPOLLIN) {
+            if (link.phase == Link::HANDSHAKE) return readBackendLines(link);
+            if (!pump(link, link.toClient, link.backend, link.client)) return false;
+        }
+        return finishIfDone(link);
+    }
+
+    // Until the first full line, which decides the backend
+    bool readGreeting(Link& link) {
+        char buffer[1024];
+        ssize_t count = recv(link.client, buffer, sizeof(buffer), 0);
+        if (count == 0 || (count < 0 && errno != EAGAIN && errno != EINTR)) {
+            closeLink(link, nullptr);
+            return false;
+        }
+        if (count < 0) return true;
+        link.greeting.append(buffer, count);
+
+        size_t end = link.greeting.find('\n');
+        if (end == string::npos) {
+            if (link.greeting.size() <= MAX_LINE) return true;
+            return reject(link, "BAD_HELLO", "no HELLO");
+        }
+
+        string_view first(link.greeting.data(), end);
+        if (!first.empty() && first.back() == '\r') first.remove_suffix(1);
+        HelloMessage hello;
+        ResumeMessage resume;
+        if (decode(first, hello)) {
+            // A bad version still goes through, for the backend to answer
+            if (hello.role == "Mechanical") link.role = 0;
+            else if (hello.role == "Electrical") link.role = 1;
+            else return reject(link, "BAD_HELLO", "unknown role");
+        } else if (decode(first, resume) && !resume.token.empty()) {
+            link.resumeToken = resume.token;
+        } else {
+            return reject(link, "BAD_HELLO", "no HELLO");
+        }
+        return route(link);
+    }
+
+    // Picks the backend and starts connecting; false if link was closed
+    bool route(Link& link) {
+        Backend* target = nullptr;
+        if (link.role < 0) {
+            auto found = directory.find(link.resumeToken);
+            if (found == directory.end()) return reject(link, "RESUME_FAILED", "unknown resume token");
+            target = found->second.backend;  // even if draining: its matches go on
+        } else {
+            target = pickBackend(link);
+            if (!target) return reject(link, "DRAINING", "no backend available");
+        }
+
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            perror("socket creation failed");
+            closeLink(link, nullptr);
+            return false;
+        }
+        int opt = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+
+        link.backend = fd;
+        link.backendEvents = UNREGISTERED;
+        link.target = target;
+        link.tried.insert(target);
+        target->links++;
+        target->routed++;
+        if (link.role >= 0) {
+            // The lobby pairs a HELLO with whoever waits for it right away
+            list<Link*>& partners = target->waiting[1 - link.role];
+            if (!partners.empty()) {
+                partners.front()->inQueue = false;
+                partners.pop_front();
+            } else {
+                target->waiting[link.role].push_back(&link);
+                link.queued = prev(target->waiting[link.role].end());
+                link.inQueue = true;
+            }
+        }
+
+        link.phase = Link::CONNECTING;
+        if (connect(fd, (sockaddr*)&target->address, sizeof(target->address)) < 0 && errno != EINPROGRESS) {
+            return backendFailed(link, strerror(errno));
+        }
+        updateEvents(link);
+        return true;
+    }
+
+    // With a partner of the other role waiting there if anywhere, else the
+    // least loaded; never a draining backend or one that refused us lately
+    Backend* pickBackend(const Link& link) {
+        Clock::time_point now = Clock::now();
+        Backend* best = nullptr;
+        for (Backend& backend : backends) {
+            if (backend.draining || backend.downUntil > now || link.tried.count(&backend)) continue;
+            if (!best) {
+                best = &backend;
+                continue;
+            }
+            size_t partners = backend.waiting[1 - link.role].size();
+            size_t bestPartners = best->waiting[1 - link.role].size();
+            if (partners != bestPartners ? partners > bestPartners : backend.links < best->links) best = &backend;
+        }
+        return best;
+    }
+
+    bool connected(Link& link) {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        getsockopt(link.backend, SOL_SOCKET, SO_ERROR, &error, &length);
+        if (error != 0) return backendFailed(link, strerror(error));
+
+        link.phase = Link::HANDSHAKE;
+        link.toBackend.pending = link.greeting;
+        link.toBackend.pendingSent = 0;
+        return pump(link, link.toBackend, link.client, link.backend) && finishIfDone(link);
+    }
+
+    // The backend cannot be reached, or is draining: a new player goes
+    // elsewhere, a resuming one has lost its match
+    bool backendFailed(Link& link, const char* reason) {
+        Backend& backend = *link.target;
+        if (backend.downUntil <= Clock::now()) {
+            LOG(LogLevel::Warn) << "Backend " << backend.name << " " << reason << ", skipping it for "
+                                << BACKEND_RETRY.count() << " s";
+        }
+        backend.downUntil = Clock::now() + BACKEND_RETRY;
+        detachBackend(link);
+
+        if (link.role < 0) return reject(link, "RESUME_FAILED", "backend gone");
+        link.toBackend = Flow();
+        link.toClient = Flow();
+        link.backendLine.clear();
+        return route(link);
+    }
+
+    void detachBackend(Link& link) {
+        if (link.backend == -1) return;
+        close(link.backend);  // also removes it from epoll
+        link.backend = -1;
+        link.backendEvents = UNREGISTERED;
+        link.target->links--;
+        leaveQueue(link);
+        reportIfDrained(*link.target);
+    }
+
+    void leaveQueue(Link& link) {
+        if (!link.inQueue) return;
+        link.target->waiting[link.role].erase(link.queued);
+        link.inQueue = false;
+    }
+
+    // Client bytes before WELCOME: relayed, and kept in case the player has
+    // to be sent to another backend
+    bool relayGreeting(Link& link) {
+        char buffer[1024];
+        ssize_t count = recv(link.client, buffer, sizeof(buffer), 0);
+        if (count < 0) {
+            if (errno == EAGAIN || errno == EINTR) return true;
+            closeLink(link, nullptr);
+            return false;
+        }
+        if (count == 0) {
+            closeLink(link, nullptr);  // gave up waiting
+            return false;
+        }
+        link.greeting.append(buffer, count);
+        if (link.greeting.size() > MAX_GREETING) {
+            closeLink(link, "client sent too much before its match");
+            return false;
+        }
+        link.toBackend.pending.append(buffer, count);
+        return pump(link, link.toBackend, link.client, link.backend) && finishIfDone(link);
+    }
+
+    // Backend lines before WELCOME
+    bool readBackendLines(Link& link) {
+        char buffer[4096];
+        ssize_t count = recv(link.backend, buffer, sizeof(buffer), 0);
+        if (count < 0) {
+            if (errno == EAGAIN || errno == EINTR) return true;
+            closeLink(link, "backend connection failed");
+            return false;
+        }
+        if (count == 0) {
+            // Closed on its own terms (a refused HELLO, a failed RESUME): pass
+            // on what it said, then hang up on the player
+            link.toClient.eof = true;
+            return pump(link, link.toClient, link.backend, link.client) && finishIfDone(link);
+        }
+        link.backendLine.append(buffer, count);
+
+        size_t start = 0, end;
+        while ((end = link.backendLine.find('\n', start)) != string::npos) {
+            string_view line(link.backendLine.data() + start, end - start);
+            if (line.compare(0, 10, "SHM_OFFER|") == 0) {
+                link.toBackend.pending += "SHM_REJECT\n";
+            } else if (line == "LOBBY|DRAINING") {
+                return backendFailed(link, "is draining");
+            } else {
+                WelcomeMessage welcome;
+                if (decode(line, welcome)) {
+                    welcomed(link, welcome.token);
+                    link.toClient.pending.append(link.backendLine, start, string::npos);
+                    link.backendLine.clear();
+                    return startSplicing(link);
+                }
+                link.toClient.pending.append(link.backendLine, start, end + 1 - start);
+            }
+            start = end + 1;
+        }
+        link.backendLine.erase(0, start);
+        if (link.backendLine.size() > MAX_LINE) {
+            closeLink(link, "backend sent an overlong line");
+            return false;
+        }
+        return pump(link, link.toBackend, link.client, link.backend) &&
+               pump(link, link.toClient, link.backend, link.client) && finishIfDone(link);
+    }
+
+    void welcomed(Link& link, const string& token) {
+        directory[token] = {link.target, Clock::now()};
+        link.resumeToken = token;
+        leaveQueue(link);  // in case it was paired with a player we did not route
+        link.greeting.clear();
+        link.greeting.shrink_to_fit();
+    }
+
+    bool startSplicing(Link& link) {
+        for (Flow* flow : {&link.toBackend, &link.toClient}) {
+            if (pipe2(flow->pipe, O_NONBLOCK | O_CLOEXEC) < 0) {
+                perror("pipe2 failed");
+                closeLink(link, nullptr);
+                return false;
+            }
+        }
+        link.phase = Link::SPLICING;
+        return pump(link, link.toBackend, link.client, link.backend) &&
+               pump(link, link.toClient, link.backend, link.client) && finishIfDone(link);
+    }
+
+    // Writes what flow holds to `to`, and while splicing moves whatever
+    // `from` has through the pipe, until either side would block. False if
+    // the link was closed.
+    bool pump(Link& link, Flow& flow, int from, int to) {
+        while (flow.pendingSent < flow.pending.size()) {
+            ssize_t sent = send(to, flow.pending.data() + flow.pendingSent, flow.pending.size() - flow.pendingSent,
+                                MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EAGAIN || errno == EINTR) return true;
+                closeLink(link, nullptr);
+                return false;
+            }
+            flow.pendingSent += sent;
+        }
+        flow.pending.clear();
+        flow.pendingSent = 0;
+
+        while (link.phase == Link::SPLICING) {
+            if (flow.inPipe > 0) {
+                ssize_t moved = splice(flow.pipe[0], NULL, to, NULL, flow.inPipe, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                if (moved < 0) {
+                    if (errno == EAGAIN || errno == EINTR) return true;
+                    closeLink(link, nullptr);
+                    return false;
+                }
+                flow.inPipe -= moved;
+                continue;
+            }
+            if (flow.eof) break;
+            ssize_t moved = splice(from, NULL, flow.pipe[1], NULL, SPLICE_CHUNK, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (moved == 0) {
+                flow.eof = true;
+            } else if (moved < 0) {
+                if (errno == EAGAIN || errno == EINTR) break;
+                closeLink(link, nullptr);
+                return false;
+            } else {
+                flow.inPipe += moved;
+            }
+        }
+
+        if (flow.eof && flow.inPipe == 0 && !flow.shut) {
+            ::shutdown(to, SHUT_WR);
+            flow.shut = true;
+        }
+        return true;
+    }
+
+    // Closes link once both directions have ended; false if it did
+    bool finishIfDone(Link& link) {
+        if (!link.toBackend.shut || !link.toClient.shut) return true;
+        closeLink(link, nullptr);
+        return false;
+    }
+
+    bool reject(Link& link, const char* status, const char* reason) {
+        string line = encode(LobbyMessage{status}) + "\n";
+        ssize_t sent = send(link.client, line.data(), line.size(), MSG_NOSIGNAL);
+        (void)sent;
+        closeLink(link, reason);
+        return false;
+    }
+
+    void closeLink(Link& link, const char* reason) {
+        if (reason) {
+            LOG(LogLevel::Info) << "Gateway dropped a player: " << reason;
+        }
+        detachBackend(link);
+        close(link.client);
+        for (Flow* flow : {&link.toBackend, &link.toClient}) {
+            if (flow->pipe[0] != -1) close(flow->pipe[0]);
+            if (flow->pipe[1] != -1) close(flow->pipe[1]);
+        }
+        // A resume is only possible for a while after the disconnect
+        if (!link.resumeToken.empty()) {
+            auto found = directory.find(link.resumeToken);
+            if (found != directory.end()) found->second.touched = Clock::now();
+        }
+        links.erase(link.id);
+    }
+
+    void reportIfDrained(const Backend& backend) {
+        if (backend.draining && backend.links == 0) {
+            LOG(LogLevel::Info) << "Backend " << backend.name
+                                << " drained: no players left; SIGTERM lets it finish its held matches and exit";
+        }
+    }
+
+    // Once a second: players that never said HELLO, forgotten tokens
+    void sweep() {
+        Clock::time_point now = Clock::now();
+        vector<Link*> late;
+        for (auto& entry : links) {
+            if (entry.second->phase == Link::ROUTING && now - entry.second->admitted >= HELLO_TIMEOUT) {
+                late.push_back(entry.second.get());
+            }
+        }
+        for (Link* link : late) reject(*link, "TIMEOUT", "no HELLO in time");
+
+        if (now - lastPurge < chrono::minutes(1)) return;
+        lastPurge = now;
+        for (auto entry = directory.begin(); entry != directory.end();) {
+            if (now - entry->second.touched >= DIRECTORY_TTL) entry = directory.erase(entry);
+            else ++entry;
+        }
+    }
+
+    void readSignals() {
+        signalfd_siginfo info;
+        while (read(signalFd, &info, sizeof(info)) == sizeof(info)) {
+            if (info.ssi_signo == SIGUSR2) {
+                LOG(LogLevel::Info) << "Status:\n" << status();
+            } else {
+                LOG(LogLevel::Info) << "Gateway stopping";
+                running = false;
+            }
+        }
+    }
+
+    void readConsole() {
+        char buffer[256];
+        ssize_t count = read(STDIN_FILENO, buffer, sizeof(buffer));
+        if (count <= 0) {
+            if (count < 0 && (errno == EAGAIN || errno == EINTR)) return;
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, STDIN_FILENO, NULL);  // stdin closed, run on
+            return;
+        }
+        consoleLine.append(buffer, count);
+        size_t end;
+        while ((end = consoleLine.find('\n')) != string::npos) {
+            string command = consoleLine.substr(0, end);
+            consoleLine.erase(0, end + 1);
+            runCommand(command);
+        }
+    }
+
+    void runCommand(const string& line) {
+        istringstream words(line);
+        string command, name;
+        words >> command >> name;
+        if (command.empty()) return;
+        if (command == "status") {
+            cout << status() << flush;
+            return;
+        }
+        if (command != "drain" && command != "undrain") {
+            cout << "Commands: drain <backend>, undrain <backend>, status\n" << flush;
+            return;
+        }
+
+        Backend* backend = findBackend(name);
+        if (!backend) {
+            cout << "No backend " << name << "; there are: " << backendNames() << "\n" << flush;
+            return;
+        }
+        backend->draining = command == "drain";
+        LOG(LogLevel::Info) << "Backend " << backend->name << (backend->draining ? " draining, " : " back in service, ")
+                            << backend->links << " players connected";
+        reportIfDrained(*backend);
+    }
+
+    Backend* findBackend(const string& name) {
+        for (size_t i = 0; i < backends.size(); i++) {
+            if (backends[i].name == name || to_string(i) == name) return &backends[i];
+        }
+        return nullptr;
+    }
+
+    string status() {
+        ostringstream report;
+        Clock::time_point now = Clock::now();
+        size_t spliced = 0;
+        for (auto& entry : links) spliced += entry.second->phase == Link::SPLICING;
+        report << links.size() << " players connected (" << spliced << " in matches), " << directory.size()
+               << " resume tokens known\n";
+        for (size_t i = 0; i < backends.size(); i++) {
+            const Backend& backend = backends[i];
+            report << "backend " << i << " " << backend.name << ": "
+                   << (backend.draining ? "draining" : backend.downUntil > now ? "down" : "up") << ", "
+                   << backend.links << " players, waiting " << backend.waiting[0].size() << " mechanical "
+                   << backend.waiting[1].size() << " electrical, " << backend.routed << " routed\n";
+        }
+        return report.str();
+    }
+};
+
+// "host:port,host:port"; false on any entry that does not resolve
+static bool parseBackends(const string& list, vector<Backend>& backends) {
+    stringstream entries(list);
+    string entry;
+    while (getline(entries, entry, ',')) {
+        if (entry.empty()) continue;
+        size_t colon = entry.rfind(':');
+        int backendPort = colon == string::npos ? 0 : atoi(entry.c_str() + colon + 1);
+        if (backendPort <= 0 || backendPort >= 65536) {
+            cout << "Backend " << entry << " needs host:port\n";
+            return false;
+        }
+
+        addrinfo hints = {};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* found = nullptr;
+        int error = getaddrinfo(entry.substr(0, colon).c_str(), NULL, &hints, &found);
+        if (error != 0) {
+            cout << "Cannot resolve backend " << entry << ": " << gai_strerror(error) << "\n";
+            return false;
+        }
+        Backend backend;
+        backend.name = entry;
+        backend.address = *reinterpret_cast<sockaddr_in*>(found->ai_addr);
+        backend.address.sin_port = htons(backendPort);
+        freeaddrinfo(found);
+        backends.push_back(backend);
+    }
+    return !backends.empty();
+}
+
+int main() {
+    const char* portSetting = getenv("FACTORY_PORT");
+    int port = portSetting ? atoi(portSetting) : 8888;
+    const char* backendSetting = getenv("FACTORY_BACKENDS");
+
+    vector<Backend> backends;
+    if (!parseBackends(backendSetting ? backendSetting : "127.0.0.1:8889", backends)) {
+        cout << "No usable backends in FACTORY_BACKENDS\n";
+        return 1;
+    }
+
+    // Two sockets and two pipes per player
+    rlimit files;
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0 && files.rlim_cur < files.rlim_max) {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+    Gateway gateway(port, move(backends));
+    if (!gateway.start()) {
+        cout << "Failed to start gateway!\n";
+        return 1;
+    }
+    gateway.run();
+    return 0;
+}
@@ -0,0 +1,242 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "protocol.h"
+
+using namespace std;
+
+// Zero-downtime restarts. A new server process started with
+// FACTORY_TAKEOVER=1 connects to the running one's admin socket (see
+// AdminSocket) and sends "handoff". The old process stops accepting,
+// freezes every match between two ticks and answers on that connection
+// with one record per thing it hands over:
+//
+//   LISTENER|<shard>                        + that shard's listening socket
+//   MATCH|<id>|<shard>|...                  a match's whole state
+//   SEAT|<match>|<role>|<shard>|<kind>      + a player's connection
+//   WAITING|<shard>|<role>|<msLeft>|<kind>  + a lobby client's connection
+//   END|<matches>|<waiting>
+//
+// A record is a 4-byte length, then a line in the protocol's layout (see
+// protocol.h), a newline and a tail of raw bytes: for SEAT and WAITING,
+// what the old process had received on the connection but not handled
+// yet. Descriptors go along as SCM_RIGHTS on their record, so the kernel
+// duplicates them into the new process; the old one then just closes its
+// copies and exits. Neither side ever shuts a socket down, nothing the
+// clients sent is lost and everything the old process sent has gone out
+// first, so to the players the server never went away. The next tick
+// comes when it was due.
+//
+// Record layouts are private to one build and the one after it; there is
+// no version check beyond the tags.
+
+// A shard's SO_REUSEPORT listening socket. The new process maps shards by
+// index, modulo its own count.
+struct HandoffListener {
+    static constexpr const char* TAG = "LISTENER";
+    int shard = 0;
+
+    static constexpr auto fields() { return make_tuple(field("shard", &HandoffListener::shard)); }
+};
+
+// Everything a Session needs to carry on
+struct HandoffMatch {
+    static constexpr const char* TAG = "MATCH";
+    uint64_t id = 0;
+    int shard = 0;
+    string mechanicalToken;
+    string electricalToken;
+    string gear;
+    string lever;
+    string valve;
+    int dial = 5;
+    uint32_t mechanicalSeq = 0;
+    string switchA;
+    string button;
+    uint32_t electricalSeq = 0;
+    double pressure = 0;
+    double temperature = 0;
+    double targetPressure = 0;
+    double targetTemperature = 0;
+    int timeLeft = 0;
+    bool gameActive = false;
+    bool gameWon = false;
+    bool gameFailed = false;
+    bool mechanicalReady = false;
+    bool electricalReady = false;
+    bool playAgainRequested = false;
+    bool mechanicalWantsReplay = false;
+    bool electricalWantsReplay = false;
+    int64_t tickInMs = -1;     // until the next tick; -1 if none is scheduled
+    int64_t phaseLeftMs = -1;  // until the READY or PLAY_AGAIN timeout; -1 while playing
+    bool lockstep = false;
+    uint32_t lockstepTick = 0;
+    bool mechanicalChanged = false;  // still to go out with the next STEP
+    bool electricalChanged = false;
+
+    static constexpr auto fields() {
+        return make_tuple(
+            field("id", &HandoffMatch::id), field("shard", &HandoffMatch::shard),
+            field("mechanicalToken", &HandoffMatch::mechanicalToken),
+            field("electricalToken", &HandoffMatch::electricalToken), field("gear", &HandoffMatch::gear),
+            field("lever", &HandoffMatch::lever), field("valve", &HandoffMatch::valve),
+            field("dial", &HandoffMatch::dial), field("mechanicalSeq", &HandoffMatch::mechanicalSeq),
+            field("switchA", &HandoffMatch::switchA), field("button", &HandoffMatch::button),
+            field("electricalSeq", &HandoffMatch::electricalSeq), field("pressure", &HandoffMatch::pressure),
+            field("temperature", &HandoffMatch::temperature),
+            field("targetPressure", &HandoffMatch::targetPressure),
+            field("targetTemperature", &HandoffMatch::targetTemperature),
+            field("timeLeft", &HandoffMatch::timeLeft), field("gameActive", &HandoffMatch::gameActive),
+            field("gameWon", &HandoffMatch::gameWon), field("gameFailed", &HandoffMatch::gameFailed),
+            field("mechanicalReady", &HandoffMatch::mechanicalReady),
+            field("electricalReady", &HandoffMatch::electricalReady),
+            field("playAgainRequested", &HandoffMatch::playAgainRequested),
+            field("mechanicalWantsReplay", &HandoffMatch::mechanicalWantsReplay),
+            field("electricalWantsReplay", &HandoffMatch::electricalWantsReplay),
+            field("tickInMs", &HandoffMatch::tickInMs), field("phaseLeftMs", &HandoffMatch::phaseLeftMs),
+            field("lockstep", &HandoffMatch::lockstep), field("lockstepTick", &HandoffMatch::lockstepTick),
+            field("mechanicalChanged", &HandoffMatch::mechanicalChanged),
+            field("electricalChanged", &HandoffMatch::electricalChanged));
+    }
+};
+
+// A connected player of the match sent just before. Players without one
+// are away: the new process gives them a fresh RESUME_GRACE.
+struct HandoffSeat {
+    static constexpr const char* TAG = "SEAT";
+    uint64_t match = 0;
+    int role = 0;   // 0 mechanical, 1 electrical
+    int shard = 0;  // whose reactor watches the connection
+    string kind;    // DetachedTransport::kind
+
+    static constexpr auto fields() {
+        return make_tuple(field("match", &HandoffSeat::match), field("role", &HandoffSeat::role),
+                          field("shard", &HandoffSeat::shard), field("kind", &HandoffSeat::kind));
+    }
+};
+
+// A client still in the lobby
+struct HandoffWaiting {
+    static constexpr const char* TAG = "WAITING";
+    int shard = 0;
+    int role = -1;  // as queued; -1 before its HELLO
+    int64_t msLeft = 0;  // until it times out
+    string kind;
+
+    static constexpr auto fields() {
+        return make_tuple(field("shard", &HandoffWaiting::shard), field("role", &HandoffWaiting::role),
+                          field("msLeft", &HandoffWaiting::msLeft), field("kind", &HandoffWaiting::kind));
+    }
+};
+
+// Nothing follows; the counts let the new process notice a short handoff
+struct HandoffEnd {
+    static constexpr const char* TAG = "END";
+    uint64_t matches = 0;
+    uint64_t waiting = 0;
+
+    static constexpr auto fields() {
+        return make_tuple(field("matches", &HandoffEnd::matches), field("waiting", &HandoffEnd::waiting));
+    }
+};
+
+const size_t MAX_HANDOFF_RECORD = 16 * 1024 * 1024;
+const size_t MAX_HANDOFF_FDS = 4;
+
+// One record on a blocking Unix stream socket; false if the channel failed
+inline bool sendHandoffRecord(int channel, const string& line, const string& tail, const vector<int>& fds) {
+    uint32_t length = line.size() + 1 + tail.size();
+    string record(reinterpret_cast<const char*>(&length), sizeof(length));
+    record += line;
+    record += '\n';
+    record += tail;
+
+    iovec part = {&record[0], record.size()};
+    msghdr msg = {};
+    msg.msg_iov = &part;
+    msg.msg_iovlen = 1;
+    char control[CMSG_SPACE(sizeof(int) * MAX_HANDOFF_FDS)] = {};
+    if (!fds.empty()) {
+        if (fds.size() > MAX_HANDOFF_FDS) return false;
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+        cmsghdr* header = CMSG_FIRSTHDR(&msg);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        memcpy(CMSG_DATA(header), fds.data(), sizeof(int) * fds.size());
+    }
+
+    // The descriptors ride on the first bytes; a partial send goes on plain
+    size_t sent = 0;
+    while (sent < record.size()) {
+        ssize_t written = sent == 0 ? sendmsg(channel, &msg, MSG_NOSIGNAL)
+                                    : send(channel, record.data() + sent, record.size() - sent, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        sent += written;
+    }
+    return true;
+}
+
+// Reads exactly size bytes, collecting any descriptors that come along
+// (close-on-exec)
+inline bool receiveHandoffBytes(int channel, char* buffer, size_t size, vector<int>& fds) {
+    size_t received = 0;
+    while (received < size) {
+        iovec part = {buffer + received, size - received};
+        char control[CMSG_SPACE(sizeof(int) * MAX_HANDOFF_FDS)];
+        msghdr msg = {};
+        msg.msg_iov = &part;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        ssize_t got = recvmsg(channel, &msg, MSG_CMSG_CLOEXEC);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) return false;
+        for (cmsghdr* header = CMSG_FIRSTHDR(&msg); header; header = CMSG_NXTHDR(&msg, header)) {
+            if (header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS) continue;
+            size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const int* passed = reinterpret_cast<const int*>(CMSG_DATA(header));
+            fds.insert(fds.end(), passed, passed + count);
+        }
+        if (msg.msg_flags & MSG_CTRUNC) return false;
+        received += got;
+    }
+    return true;
+}
+
+// The next record; false on EOF, a failed channel or something that is not
+// a record at all (a server that does not know "handoff" answers in text).
+// Descriptors received with a bad record are closed.
+inline bool receiveHandoffRecord(int channel, string& line, string& tail, vector<int>& fds) {
+    fds.clear();
+    uint32_t length = 0;
+    bool valid = receiveHandoffBytes(channel, reinterpret_cast<char*>(&length), sizeof(length), fds) &&
+                 length > 0 && length <= MAX_HANDOFF_RECORD;
+    string record;
+    if (valid) {
+        record.resize(length);
+        valid = receiveHandoffBytes(channel, &record[0], length, fds);
+    }
+    size_t newline = valid ? record.find('\n') : string::npos;
+    if (newline == string::npos) {
+        for (int fd : fds) close(fd);
+        fds.clear();
+        return false;
+    }
+    line.assign(record, 0, newline);
+    tail.assign(record, newline + 1, string::npos);
+    return true;
+}
+
+#endif // HANDOFF_H
@@ -0,0 +1,63 @@
+#include "heap_stats.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+using namespace std;
+
+// Each thread counts into its own cache line; the totals are summed on
+// demand. Threads are never many, so their slots are simply never reused.
+namespace {
+
+const size_t MAX_THREADS = 1024;
+
+struct alignas(64) ThreadCounts {
+    atomic<uint64_t> allocations;
+    atomic<uint64_t> frees;
+    atomic<uint64_t> bytes;
+};
+
+ThreadCounts counts[MAX_THREADS];
+atomic<size_t> threadsSeen(0);
+
+ThreadCounts& mine() {
+    // Threads past MAX_THREADS share the last slot; the counts stay right,
+    // they just contend
+    static thread_local ThreadCounts* slot = &counts[min(threadsSeen.fetch_add(1), MAX_THREADS - 1)];
+    return *slot;
+}
+
+void* allocate(size_t size) {
+    ThreadCounts& own = mine();
+    own.allocations.fetch_add(1, memory_order_relaxed);
+    own.bytes.fetch_add(size, memory_order_relaxed);
+    if (void* block = malloc(size ? size : 1)) return block;
+    throw bad_alloc();
+}
+
+void release(void* block) {
+    if (!block) return;
+    mine().frees.fetch_add(1, memory_order_relaxed);
+    free(block);
+}
+
+}  // namespace
+
+HeapStats heapStats() {
+    HeapStats total = {0, 0, 0};
+    size_t threads = min(threadsSeen.load(), MAX_THREADS);
+    for (size_t i = 0; i < threads; i++) {
+        total.allocations += counts[i].allocations.load(memory_order_relaxed);
+        total.frees += counts[i].frees.load(memory_order_relaxed);
+        total.bytes += counts[i].bytes.load(memory_order_relaxed);
+    }
+    return total;
+}
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void operator delete(void* block) noexcept { release(block); }
+void operator delete[](void* block) noexcept { release(block); }
+void operator delete(void* block, size_t) noexcept { release(block); }
+void operator delete[](void* block, size_t) noexcept { release(block); }
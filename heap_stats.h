@@ -0,0 +1,19 @@
+#ifndef HEAP_STATS_H
+#define HEAP_STATS_H
+
+#include <cstdint>
+
+using namespace std;
+
+// Global heap traffic, counted by the replacement operator new and delete
+// in heap_stats.cpp. Only programs that link heap_stats.o count anything;
+// in the others every field stays 0.
+struct HeapStats {
+    uint64_t allocations;
+    uint64_t frees;
+    uint64_t bytes;  // requested by all allocations so far
+};
+
+HeapStats heapStats();
+
+#endif // HEAP_STATS_H
@@ -0,0 +1,351 @@
+#include "lobby.h"
+#include "clock_sync.h"
+#include "log.h"
+#include "profiler.h"
+using namespace std;
+
+const chrono::milliseconds Lobby::HELLO_TIMEOUT(10 * 1000);
+const chrono::milliseconds Lobby::WAIT_TIMEOUT(5 * 60 * 1000);
+
+// Lines a waiting client may send before it is considered misbehaving
+const size_t MAX_BACKLOG = 32;
+
+static const char* roleName(int role) {
+    return role == 0 ? "Mechanical" : role == 1 ? "Electrical" : "resuming";
+}
+
+// Before a match a client sends a HELLO or RESUME, maybe a READY to be
+// kept for its session, and PINGs
+static FloodGuard::Kind kindOf(const string& line) {
+    if (hasTag<PingMessage>(line) || hasTag<PongMessage>(line)) return FloodGuard::TIMING;
+    if (hasTag<MechanicalInputMessage>(line) || hasTag<ElectricalInputMessage>(line)) return FloodGuard::INPUT;
+    if (hasTag<HelloMessage>(line) || hasTag<ResumeMessage>(line) || hasTag<ReadyMessage>(line) ||
+        hasTag<PlayAgainMessage>(line)) {
+        return FloodGuard::CONTROL;
+    }
+    return FloodGuard::OTHER;
+}
+
+Lobby::Lobby(MatchCallback matchCallback, ResumeCallback resumeCallback)
+    : onMatch(matchCallback), onResume(resumeCallback), nextClient(1), draining(false) {}
+
+Lobby::~Lobby() {
+    lock_guard<mutex> lock(lobbyMutex);
+    for (auto& entry : clients) {
+        entry.second.reactor->unwatch(entry.second.watch);
+        entry.second.reactor->cancel(entry.second.deadlineTimer);
+        releaseReaderLocked(entry.second);
+        entry.second.conn->shutdown();
+    }
+    clients.clear();
+}
+
+void Lobby::admit(unique_ptr<Transport> conn, Reactor& reactor) {
+    lock_guard<mutex> lock(lobbyMutex);
+    ClientId id = addLocked(move(conn), reactor);
+    setDeadlineLocked(id, clients[id], HELLO_TIMEOUT);
+}
+
+Lobby::ClientId Lobby::addLocked(unique_ptr<Transport> conn, Reactor& reactor) {
+    ClientId id = nextClient++;
+    Client& client = clients[id];
+    client.conn = move(conn);
+    client.reader = make_shared<Reader>();
+    client.reader->conn = client.conn.get();
+    client.reactor = &reactor;
+    client.role = NO_ROLE;
+    client.inQueue = false;
+    client.deadlineTimer = 0;
+    // May fire right away; the task then waits for lobbyMutex
+    client.watch = reactor.watchTransport(*client.conn, [this, id] { onReadable(id); });
+    return id;
+}
+
+size_t Lobby::waitingCount() const {
+    lock_guard<mutex> lock(lobbyMutex);
+    size_t count = 0;
+    for (const auto& queues : waiting) {
+        for (const auto& queue : queues) count += queue.second.size();
+    }
+    return count;
+}
+
+void Lobby::drain() {
+    lock_guard<mutex> lock(lobbyMutex);
+    draining = true;
+    vector<ClientId> waitingIds;
+    for (const auto& queues : waiting) {
+        for (const auto& queue : queues) waitingIds.insert(waitingIds.end(), queue.second.begin(), queue.second.end());
+    }
+    for (ClientId id : waitingIds) {
+        sendLocked(clients[id], encode(LobbyMessage{"DRAINING"}));
+        dropLocked(id, "server draining");
+    }
+}
+
+vector<Lobby::HandedOffClient> Lobby::handOff() {
+    lock_guard<mutex> lock(lobbyMutex);
+    vector<ClientId> order;
+    for (const auto& queues : waiting) {
+        for (const auto& queue : queues) order.insert(order.end(), queue.second.begin(), queue.second.end());
+    }
+    for (const auto& entry : clients) {
+        if (!entry.second.inQueue) order.push_back(entry.first);
+    }
+
+    vector<HandedOffClient> handedOff;
+    Clock::time_point now = Clock::now();
+    for (ClientId id : order) {
+        Client& client = clients[id];
+        client.reactor->unwatch(client.watch);
+        client.reactor->cancel(client.deadlineTimer);
+        vector<string> unseen = releaseReaderLocked(client);
+        HandedOffClient out;
+        out.role = client.role == NO_ROLE ? -1 : client.role;
+        out.reactor = client.reactor;
+        out.timeLeft = max(chrono::milliseconds(0), chrono::duration_cast<chrono::milliseconds>(client.deadline - now));
+        if (!client.conn->detach(out.conn)) {
+            LOG(LogLevel::Info) << "Lobby dropped a " << (client.role == NO_ROLE ? "new" : roleName(client.role))
+                                << " client: its connection cannot be handed over";
+            client.conn->shutdown();
+            continue;
+        }
+        // The new lobby reads them again and keeps them the same way
+        string backlog;
+        for (const string& line : client.backlog) backlog += line + '\n';
+        for (const string& line : unseen) backlog += line + '\n';
+        out.conn.unread.insert(0, backlog);
+        handedOff.push_back(move(out));
+    }
+    clients.clear();
+    for (auto& queues : waiting) queues.clear();
+    return handedOff;
+}
+
+void Lobby::adoptHandedOff(unique_ptr<Transport> conn, Reactor& reactor, int role, chrono::milliseconds timeLeft) {
+    lock_guard<mutex> lock(lobbyMutex);
+    ClientId id = addLocked(move(conn), reactor);
+    Client& client = clients[id];
+    if (role == MECHANICAL || role == ELECTRICAL) {
+        client.role = Role(role);
+        list<ClientId>& queue = waiting[role][&reactor];
+        queue.push_back(id);
+        client.queued = prev(queue.end());
+        client.inQueue = true;
+    }
+    setDeadlineLocked(id, client, timeLeft);
+    // Lines handed over already sit in the transport, where no readiness
+    // reports them
+    reactor.runAfter(chrono::milliseconds(0), [this, id] { onReadable(id); });
+}
+
+void Lobby::onReadable(ClientId id) {
+    PROFILE_ZONE("Lobby::onReadable");
+    shared_ptr<Reader> reader;
+    {
+        lock_guard<mutex> lock(lobbyMutex);
+        auto found = clients.find(id);
+        if (found == clients.end()) return;  // paired or dropped meanwhile
+        reader = found->second.reader;
+    }
+
+    // Drain everything: once the client moves to a session, its watch
+    // only fires for new data
+    RecvStatus status;
+    bool flooded = false;
+    {
+        lock_guard<mutex> lock(reader->lock);
+        if (!reader->conn) return;  // paired or dropped meanwhile
+        string line;
+        while ((status = reader->conn->tryReceive(line)) == RecvStatus::Message) {
+            FloodGuard::Kind kind = kindOf(line);
+            FloodGuard::Verdict verdict = reader->flood.admit(kind, Clock::now());
+            if (verdict == FloodGuard::DISCONNECT) {
+                flooded = true;
+                break;
+            }
+            if (verdict == FloodGuard::OVER_LIMIT) continue;
+            // Clients may measure the connection before they have a match
+            PingMessage ping;
+            if (kind == FloodGuard::TIMING && decode(line, ping)) {
+                reader->conn->sendMessage(encode(pongFor(ping, monotonicMicros())));
+                continue;
+            }
+            reader->lines.push_back(move(line));
+        }
+    }
+
+    Player pair[2];
+    string resumeToken;
+    {
+        lock_guard<mutex> lock(lobbyMutex);
+        auto found = clients.find(id);
+        if (found == clients.end()) return;  // its lines went along with it
+        Client& client = found->second;
+        if (flooded) {
+            dropLocked(id, "kept flooding");
+            return;
+        }
+
+        vector<string> lines;
+        {
+            lock_guard<mutex> readerLock(reader->lock);
+            lines.swap(reader->lines);
+        }
+        for (string& line : lines) {
+            if (client.role != NO_ROLE) {
+                if (client.backlog.size() >= MAX_BACKLOG) {
+                    dropLocked(id, "sent too much while waiting");
+                    return;
+                }
+                client.backlog.push_back(move(line));
+                continue;
+            }
+
+            HelloMessage hello;
+            ResumeMessage resume;
+            if (decode(line, hello)) {
+                if (hello.version != PROTOCOL_VERSION) {
+                    sendLocked(client, encode(LobbyMessage{"BAD_VERSION"}));
+                    dropLocked(id, "built for another protocol version");
+                    return;
+                }
+                if (draining) {
+                    sendLocked(client, encode(LobbyMessage{"DRAINING"}));
+                    dropLocked(id, "server draining");
+                    return;
+                }
+                if (hello.role == roleName(MECHANICAL)) client.role = MECHANICAL;
+                if (hello.role == roleName(ELECTRICAL)) client.role = ELECTRICAL;
+            } else if (decode(line, resume) && !resume.token.empty()) {
+                client.role = RESUMING;
+                client.resumeToken = move(resume.token);
+            }
+            if (client.role == NO_ROLE) {
+                sendLocked(client, encode(LobbyMessage{"BAD_HELLO"}));
+                dropLocked(id, "no HELLO");
+                return;
+            }
+        }
+        if (status == RecvStatus::Closed) {
+            dropLocked(id, "disconnected");
+            return;
+        }
+
+        if (client.role == NO_ROLE || client.inQueue) {
+            client.reactor->rearm(client.watch);
+            return;
+        }
+
+        Role role = client.role;
+        if (role == RESUMING) {
+            resumeToken = client.resumeToken;
+            pair[0] = takeLocked(id);
+        } else {
+            Role other = role == MECHANICAL ? ELECTRICAL : MECHANICAL;
+            list<ClientId>* partners = partnersLocked(other, client.reactor);
+            if (!partners) {
+                list<ClientId>& queue = waiting[role][client.reactor];
+                queue.push_back(id);
+                client.queued = prev(queue.end());
+                client.inQueue = true;
+                setDeadlineLocked(id, client, WAIT_TIMEOUT);
+                sendLocked(client, encode(LobbyMessage{"WAITING"}));
+                client.reactor->rearm(client.watch);
+                LOG(LogLevel::Info) << roleName(role) << " player connected, waiting for a partner ("
+                                    << queue.size() << " in queue)";
+                return;
+            }
+
+            pair[other] = takeLocked(partners->front());
+            pair[role] = takeLocked(id);
+            LOG(LogLevel::Info) << roleName(role) << " player connected, paired with a waiting "
+                                << roleName(other) << " player";
+        }
+    }
+
+    if (!resumeToken.empty()) {
+        resumePlayer(resumeToken, pair[0]);
+    } else {
+        onMatch(move(pair[MECHANICAL]), move(pair[ELECTRICAL]));
+    }
+}
+
+void Lobby::resumePlayer(const string& token, Player& player) {
+    if (onResume(token, player)) return;
+
+    LOG(LogLevel::Info) << "Lobby dropped a resuming client: unknown or expired token, or refused";
+    player.conn->sendMessage(encode(LobbyMessage{"RESUME_FAILED"}));
+    player.conn->shutdown();
+}
+
+void Lobby::expire(ClientId id) {
+    lock_guard<mutex> lock(lobbyMutex);
+    auto found = clients.find(id);
+    if (found == clients.end()) return;
+    Client& client = found->second;
+    // Cancelling loses the race against a timer that already fired, so an
+    // earlier deadline's task (HELLO) may still arrive after a later one
+    if (client.deadline > Clock::now()) return;
+
+    sendLocked(client, encode(LobbyMessage{"TIMEOUT"}));
+    dropLocked(id, client.role == NO_ROLE ? "no HELLO in time" : "no partner in time");
+}
+
+void Lobby::setDeadlineLocked(ClientId id, Client& client, chrono::milliseconds timeout) {
+    if (client.deadlineTimer) client.reactor->cancel(client.deadlineTimer);
+    client.deadline = Clock::now() + timeout;
+    client.deadlineTimer = client.reactor->runAfter(timeout, [this, id] { expire(id); });
+}
+
+list<Lobby::ClientId>* Lobby::partnersLocked(Role role, Reactor* reactor) {
+    auto local = waiting[role].find(reactor);
+    if (local != waiting[role].end() && !local->second.empty()) return &local->second;
+
+    // Ids grow with every admit, so the smallest head connected first
+    list<ClientId>* oldest = nullptr;
+    for (auto& queue : waiting[role]) {
+        if (!queue.second.empty() && (!oldest || queue.second.front() < oldest->front())) oldest = &queue.second;
+    }
+    return oldest;
+}
+
+void Lobby::sendLocked(Client& client, const string& line) {
+    lock_guard<mutex> lock(client.reader->lock);
+    if (client.reader->conn) client.reader->conn->sendMessage(line);
+}
+
+// Keeps the client's read task off its connection from here on; returns
+// the lines that task read but nobody has handled yet
+vector<string> Lobby::releaseReaderLocked(Client& client) {
+    lock_guard<mutex> lock(client.reader->lock);
+    client.reader->conn = nullptr;
+    return move(client.reader->lines);
+}
+
+Lobby::Player Lobby::takeLocked(ClientId id) {
+    auto found = clients.find(id);
+    Client& client = found->second;
+    client.reactor->unwatch(client.watch);
+    client.reactor->cancel(client.deadlineTimer);
+    if (client.inQueue) waiting[client.role][client.reactor].erase(client.queued);
+    for (string& line : releaseReaderLocked(client)) client.backlog.push_back(move(line));
+
+    Player player = {move(client.conn), move(client.backlog), client.reactor};
+    clients.erase(found);
+    return player;
+}
+
+void Lobby::dropLocked(ClientId id, const char* reason) {
+    auto found = clients.find(id);
+    Client& client = found->second;
+    LOG(LogLevel::Info) << "Lobby dropped a " << (client.role == NO_ROLE ? "new" : roleName(client.role))
+                        << " client: " << reason;
+
+    client.reactor->unwatch(client.watch);
+    client.reactor->cancel(client.deadlineTimer);
+    if (client.inQueue) waiting[client.role][client.reactor].erase(client.queued);
+    releaseReaderLocked(client);
+    client.conn->shutdown();
+    clients.erase(found);
+}
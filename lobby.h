@@ -0,0 +1,147 @@
+#ifndef LOBBY_H
+#define LOBBY_H
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "rate_limit.h"
+#include "reactor.h"
+#include "transport.h"
+
+using namespace std;
+
+// Where accepted connections wait for a partner. A client's first line
+// declares the role it wants and its PROTOCOL_VERSION (see protocol.h):
+//
+//   client -> server   HELLO|Mechanical|<version>   or   HELLO|Electrical|<version>
+//   server -> client   LOBBY|WAITING      (no partner yet)
+//   server -> client   LOBBY|BAD_VERSION  (built for another version; then closes)
+//   server -> client   LOBBY|DRAINING     (the server is shutting down; then closes)
+//
+// or, to take back a seat in a running match (see Session),
+//
+//   client -> server   RESUME|<token>
+//   server -> client   LOBBY|RESUME_FAILED   (unknown token; then closes)
+//
+// Each role has a FIFO queue per reactor (per shard of the server). A
+// client is paired the moment its HELLO arrives: with the head of the other
+// role's queue on its own reactor if anyone is waiting there, so that both
+// connections are on one shard already, otherwise with whoever has waited
+// longest on any (the server then moves one of them, see server.h). Matching, leaving the queue and timing out cost the same no
+// matter how many are waiting. A client stays watched by the reactor that
+// admitted it, and its deadlines run there too.
+// Waiting clients stay watched, so one that hangs up is dropped at once,
+// and anything it sends meanwhile (typically READY) is kept and handed to
+// its session. PINGs are answered on the spot instead.
+//
+// lobbyMutex is shared by every shard, so a client's read task drains its
+// connection before taking it: each line is checked against the client's
+// FloodGuard (rate_limit.h) on its tag, PINGs are answered, and lines over
+// their limit, PINGs included, are dropped. A client that keeps it up is
+// disconnected. Only what is left is handled under lobbyMutex.
+class Lobby {
+public:
+    struct Player {
+        unique_ptr<Transport> conn;
+        vector<string> backlog;  // lines received after HELLO, in order
+        Reactor* reactor = nullptr;  // the one conn was admitted on
+    };
+    typedef function<void(Player mechanical, Player electrical)> MatchCallback;
+    // True if the token's session took the player (and its connection)
+    typedef function<bool(const string& token, Player& player)> ResumeCallback;
+
+    static const chrono::milliseconds HELLO_TIMEOUT;
+    static const chrono::milliseconds WAIT_TIMEOUT;
+
+    // Callbacks run on the executor, without any lobby lock held
+    Lobby(MatchCallback onMatch, ResumeCallback onResume);
+    ~Lobby();
+
+    Lobby(const Lobby&) = delete;
+    Lobby& operator=(const Lobby&) = delete;
+
+    // conn must have been adopted by reactor, which must outlive the lobby
+    void admit(unique_ptr<Transport> conn, Reactor& reactor);
+
+    size_t waitingCount() const;
+
+    // Turns away waiting clients and every later HELLO with LOBBY|DRAINING,
+    // so that no new match starts; RESUMEs are still served
+    void drain();
+
+    // Zero-downtime restarts (see handoff.h): every client still here, its
+    // connection detached, queued ones first and in order. The lobby is
+    // empty afterwards; a client whose transport cannot be detached is
+    // disconnected instead.
+    struct HandedOffClient {
+        int role;  // 0 Mechanical, 1 Electrical, -1 before its HELLO
+        DetachedTransport conn;
+        Reactor* reactor;
+        chrono::milliseconds timeLeft;
+    };
+    vector<HandedOffClient> handOff();
+    // The new process's side; conn must have been restored on reactor
+    void adoptHandedOff(unique_ptr<Transport> conn, Reactor& reactor, int role, chrono::milliseconds timeLeft);
+
+private:
+    typedef uint64_t ClientId;
+    typedef chrono::steady_clock Clock;
+
+    enum Role { MECHANICAL = 0, ELECTRICAL = 1, NO_ROLE = 2, RESUMING = 3 };
+
+    // What a client's read task works with outside lobbyMutex. Its lock is
+    // only ever taken after lobbyMutex, never before it, and covers every
+    // send to the client as well, so PONGs do not interleave with lobby
+    // replies.
+    struct Reader {
+        mutex lock;
+        Transport* conn = nullptr;  // the client's, until it is taken or dropped
+        FloodGuard flood;
+        vector<string> lines;  // read and admitted, not yet handled
+    };
+
+    struct Client {
+        unique_ptr<Transport> conn;
+        shared_ptr<Reader> reader;
+        Reactor* reactor;
+        Reactor::WatchId watch;
+        Role role;                        // NO_ROLE until HELLO
+        bool inQueue;
+        list<ClientId>::iterator queued;  // valid while inQueue
+        string resumeToken;
+        vector<string> backlog;
+        Clock::time_point deadline;
+        Reactor::TimerId deadlineTimer;
+    };
+
+    MatchCallback onMatch;
+    ResumeCallback onResume;
+
+    mutable mutex lobbyMutex;
+    unordered_map<ClientId, Client> clients;
+    map<Reactor*, list<ClientId>> waiting[2];
+    ClientId nextClient;
+    bool draining;
+
+    void onReadable(ClientId id);
+    void resumePlayer(const string& token, Player& player);
+    void expire(ClientId id);
+
+    // With lobbyMutex held
+    ClientId addLocked(unique_ptr<Transport> conn, Reactor& reactor);
+    void setDeadlineLocked(ClientId id, Client& client, chrono::milliseconds timeout);
+    list<ClientId>* partnersLocked(Role role, Reactor* reactor);
+    void sendLocked(Client& client, const string& line);
+    vector<string> releaseReaderLocked(Client& client);
+    Player takeLocked(ClientId id);
+    void dropLocked(ClientId id, const char* reason);
+};
+
+#endif // LOBBY_H
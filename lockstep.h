@@ -0,0 +1,191 @@
+#ifndef LOCKSTEP_H
+#define LOCKSTEP_H
+
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+#include "physics.h"
+#include "protocol.h"
+
+using namespace std;
+
+// Lockstep mode: instead of a STATE on every tick, the session sends the
+// inputs that changed since the last tick and a STEP, and both stations run
+// the tick themselves on a LockstepSim. Traffic then follows the players'
+// inputs rather than the size of the state:
+//
+//   session -> clients   LOCKSTEP|<tick>, STATE, MECH, ELEC   (re)seeds the sim
+//   session -> clients   MECH|... and/or ELEC|...             changed controls
+//   session -> clients   STEP|<tick>|<serverTime>             run one tick
+//   session -> clients   STATE_HASH|<tick>|<hash>             every HASH_INTERVAL steps
+//   client -> session    DESYNC|<tick>                        our hash differs: reseed us
+//
+// Everything arrives in order on one connection, so a control change always
+// reaches a client before the STEP it first applies to. The session seeds
+// at the start of a game, on a RESUME, on a DESYNC and whenever it sends a
+// STATE for another reason (READY, PLAY_AGAIN, game over).
+//
+// Set FACTORY_LOCKSTEP=1 on the server to turn it on; clients follow
+// whichever mode the server uses.
+inline bool lockstepEnabled() {
+    static const bool enabled = [] {
+        const char* setting = getenv("FACTORY_LOCKSTEP");
+        return setting && strcmp(setting, "1") == 0;
+    }();
+    return enabled;
+}
+
+const uint32_t HASH_INTERVAL = 10;
+
+// The match's machine, stepped identically on every host. Pressure and
+// temperature are fixed point (FRACTION_BITS binary places), so stepping
+// is integer arithmetic. The floating-point part, controlRates(), runs only
+// when a control changes and is rounded into fixed point straight away; it
+// is plain IEEE multiplication and division in a set order, which every
+// x86-64 and ARM64 build evaluates alike. Every fixed-point value is also
+// exactly a double, so seeding from a STATE and filling one back loses
+// nothing.
+//
+// step() follows Session's tick: integrate, apply a pressed button, check
+// failure and the targets, count down the clock.
+class LockstepSim {
+public:
+    typedef int64_t Fixed;
+    static const int FRACTION_BITS = 16;
+
+    static Fixed toFixed(double value) { return llround(ldexp(value, FRACTION_BITS)); }
+    static double toDouble(Fixed value) { return ldexp(double(value), -FRACTION_BITS); }
+
+    explicit LockstepSim(const PhysicsParams& physics = DEFAULT_PHYSICS)
+        : params(physics), mechanicalControls{"Stopped", "Middle", "Closed", 5}, electricalControls{"Off", "Idle"},
+          currentTick(0), pressure(toFixed(100.0)), temperature(toFixed(200.0)), targetPressure(toFixed(150.0)),
+          targetTemperature(toFixed(300.0)), timeLeft(60), active(false), won(false), failed(false) {
+        updateRates();
+    }
+
+    // Steps run so far, as numbered in STEP lines
+    uint32_t tick() const { return currentTick; }
+    void setTick(uint32_t tick) { currentTick = tick; }
+
+    // The machine and the clock from a STATE
+    void seed(const StateMessage& state) {
+        pressure = toFixed(state.pressure);
+        temperature = toFixed(state.temperature);
+        targetPressure = toFixed(state.targetPressure);
+        targetTemperature = toFixed(state.targetTemperature);
+        timeLeft = state.timeLeft;
+        active = state.gameActive;
+        won = state.gameWon;
+        failed = state.gameFailed;
+    }
+
+    // Writes the fields seed() reads; the rest of state is left alone
+    void fill(StateMessage& state) const {
+        state.pressure = toDouble(pressure);
+        state.temperature = toDouble(temperature);
+        state.targetPressure = toDouble(targetPressure);
+        state.targetTemperature = toDouble(targetTemperature);
+        state.timeLeft = timeLeft;
+        state.gameActive = active;
+        state.gameWon = won;
+        state.gameFailed = failed;
+    }
+
+    void setMechanical(const Mechanical& controls) {
+        if (controls == mechanicalControls) return;
+        mechanicalControls = controls;
+        updateRates();
+    }
+
+    void setElectrical(const Electrical& controls) {
+        if (controls == electricalControls) return;
+        electricalControls = controls;
+        updateRates();
+    }
+
+    const Mechanical& mechanical() const { return mechanicalControls; }
+    const Electrical& electrical() const { return electricalControls; }
+    bool gameActive() const { return active; }
+
+    void step() {
+        currentTick++;
+        if (!active) return;
+
+        pressure += ratePressure;
+        temperature += rateTemperature;
+        if (electricalControls.button == "Pressed") {
+            pressure = toFixed(params.safePressure);
+            temperature = toFixed(params.safeTemperature);
+        }
+
+        if (pressure < toFixed(params.minPressure) || pressure > toFixed(params.maxPressure) ||
+            temperature < toFixed(params.minTemperature) || temperature > toFixed(params.maxTemperature)) {
+            failed = true;
+            active = false;
+        }
+        Fixed tolerance = toFixed(params.targetTolerance);
+        if (llabs(pressure - targetPressure) <= tolerance && llabs(temperature - targetTemperature) <= tolerance) {
+            won = true;
+            active = false;
+        }
+
+        timeLeft--;
+        if (timeLeft <= 0) active = false;
+    }
+
+    // FNV-1a over everything step() reads or writes
+    uint64_t hash() const {
+        uint64_t h = 14695981039346656037ull;
+        auto mix = [&h](uint64_t value) {
+            for (int i = 0; i < 8; i++) {
+                h ^= (value >> (8 * i)) & 0xff;
+                h *= 1099511628211ull;
+            }
+        };
+        mix(currentTick);
+        mix(pressure);
+        mix(temperature);
+        mix(targetPressure);
+        mix(targetTemperature);
+        mix(ratePressure);
+        mix(rateTemperature);
+        mix(uint64_t(int64_t(timeLeft)));
+        mix((active ? 1 : 0) | (won ? 2 : 0) | (failed ? 4 : 0) | (electricalControls.button == "Pressed" ? 8 : 0));
+        return h;
+    }
+
+private:
+    PhysicsParams params;
+    Mechanical mechanicalControls;
+    Electrical electricalControls;
+    uint32_t currentTick;
+    Fixed pressure;
+    Fixed temperature;
+    Fixed targetPressure;
+    Fixed targetTemperature;
+    Fixed ratePressure;
+    Fixed rateTemperature;
+    int timeLeft;
+    bool active;
+    bool won;
+    bool failed;
+
+    void updateRates() {
+        pair<double, double> rates = controlRates(mechanicalControls, electricalControls, params);
+        ratePressure = toFixed(rates.first);
+        rateTemperature = toFixed(rates.second);
+    }
+};
+
+// The controls carried by MECH and ELEC lines
+inline Mechanical controlsOf(const MechanicalInputMessage& input) {
+    return {input.gear, input.lever, input.valve, input.dial};
+}
+
+inline Electrical controlsOf(const ElectricalInputMessage& input) {
+    return {input.switchA, input.button};
+}
+
+#endif // LOCKSTEP_H
@@ -0,0 +1,77 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+
+using namespace std;
+
+// Minimal leveled logging for the server. Each line is built privately and
+// written in one piece, so lines from different worker threads never
+// interleave. The threshold comes from FACTORY_LOG (debug, info, warn);
+// debug builds default to debug. setLogThreshold() changes it at run time
+// (the server's admin socket does).
+//
+//   LOG(LogLevel::Info) << "Session " << id << " started";
+enum class LogLevel { Debug = 0, Info = 1, Warn = 2 };
+
+// False if name is not one of debug, info and warn
+inline bool parseLogLevel(const char* name, LogLevel& level) {
+    if (strcmp(name, "debug") == 0) level = LogLevel::Debug;
+    else if (strcmp(name, "info") == 0) level = LogLevel::Info;
+    else if (strcmp(name, "warn") == 0) level = LogLevel::Warn;
+    else return false;
+    return true;
+}
+
+inline const char* logLevelName(LogLevel level) {
+    return level == LogLevel::Debug ? "debug" : level == LogLevel::Info ? "info" : "warn";
+}
+
+inline atomic<int>& logThresholdSetting() {
+    static atomic<int> threshold([] {
+        LogLevel level;
+        const char* setting = getenv("FACTORY_LOG");
+        if (setting && parseLogLevel(setting, level)) return int(level);
+#ifdef DEBUG
+        return int(LogLevel::Debug);
+#else
+        return int(LogLevel::Info);
+#endif
+    }());
+    return threshold;
+}
+
+inline LogLevel logThreshold() { return LogLevel(logThresholdSetting().load(memory_order_relaxed)); }
+
+inline void setLogThreshold(LogLevel level) { logThresholdSetting().store(int(level), memory_order_relaxed); }
+
+inline bool logEnabled(LogLevel level) { return level >= logThreshold(); }
+
+class LogLine {
+private:
+    ostringstream line;
+
+public:
+    ~LogLine() {
+        static mutex outputMutex;
+        line << '\n';
+        lock_guard<mutex> lock(outputMutex);
+        cout << line.str() << flush;
+    }
+
+    template <typename T>
+    LogLine& operator<<(const T& value) {
+        line << value;
+        return *this;
+    }
+};
+
+// Arguments are not evaluated when the level is filtered out
+#define LOG(level) if (!logEnabled(level)) {} else LogLine()
+
+#endif // LOG_H
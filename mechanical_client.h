@@ -0,0 +1,319 @@
+#ifndef MECHANICAL_CLIENT_H
+#define MECHANICAL_CLIENT_H
+
+#include <SFML/Graphics.hpp>
+#include "game_client.h"
+#include "assets.h"
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cmath>
+
+using namespace std;
+using namespace sf;
+
+class MechanicalClient : public GameClient<MechanicalClient> {
+    friend class GameClient<MechanicalClient>;
+
+public:
+    static constexpr const char* roleName = "Mechanical";
+
+private:
+    struct LeverAnimation {
+        float currentFrame = 1.0f;     
+        string targetState = "UP"; 
+        string currentState = "Middle"; 
+        bool isGold = false;           
+        float animationSpeed = 6.0f;   
+    } leverAnim;
+    struct LocalControls {
+        string gear = "Stopped";
+        string lever = "Middle";
+        string valve = "Closed";
+        int dial = 5;
+    } controls;
+    
+    enum LeverFrame {
+        BLACK_DOWN = 0,
+        BLACK_MID = 1,  
+        BLACK_UP = 2,
+        GOLD_DOWN = 3,
+        GOLD_MID = 4,
+        GOLD_UP = 5
+    };
+    
+    sf::IntRect leverFrameRect;
+
+    // UI Elements
+    RectangleShape pressureGauge;
+    RectangleShape temperatureGauge;
+    Texture gearTexture;
+    Sprite gearSprite;
+    Texture leverTexture;
+    Sprite leverSprite;
+    Clock spriteClock;
+    Text statusText;
+    Text gearStopText;
+    Text leverResetText;
+
+    void initializeLeverFrames() {
+    
+    int frameWidth = (leverTexture.getSize().x / 3);
+    int frameHeight = leverTexture.getSize().y / 2;
+    
+    leverFrameRect = sf::IntRect(0, 0, frameWidth, frameHeight);
+    leverSprite.setTextureRect(leverFrameRect);
+    
+    // Initialize animation state to middle frame
+    leverAnim.currentFrame = (leverAnim.isGold ? GOLD_MID : BLACK_MID);
+    leverAnim.currentState = "Middle";
+    leverAnim.targetState = "Middle";
+}
+
+    void initializeGraphics() {
+        // Initialize UI elements
+        pressureGauge.setSize(Vector2f(30, 200));
+        pressureGauge.setPosition(250, 200);
+        pressureGauge.setFillColor(Color::Red);
+        
+        temperatureGauge.setSize(Vector2f(30, 200));
+        temperatureGauge.setPosition(350, 200);
+        temperatureGauge.setFillColor(sf::Color::Yellow);
+        
+        if (!loadAsset(gearTexture, "images/gear.png")) {
+            std::cout << "Warning: images/gear.png missing from assets.pak — using placeholder\n";
+            sf::Image img; img.create(128, 128, sf::Color(150,150,150));
+            gearTexture.loadFromImage(img);
+        }
+        if (!loadAsset(leverTexture, "images/lever.png")) {
+            std::cout << "Warning: images/lever.png missing from assets.pak — using placeholder\n";
+            sf::Image img; img.create(32, 128, sf::Color(120,120,120));
+            leverTexture.loadFromImage(img);
+        }
+
+        gearSprite.setTexture(gearTexture);
+        gearSprite.setOrigin(gearTexture.getSize().x / 2.f, gearTexture.getSize().y / 2.f);
+        gearSprite.setScale(4.5f, 4.5f);
+        gearSprite.setPosition(200.f, 470.f);
+
+        int frameWidth = leverTexture.getSize().x / 3;
+        leverSprite.setTexture(leverTexture);
+        leverSprite.setOrigin(frameWidth / 2.f, (leverTexture.getSize().y / 2) * 0.1f);
+        leverSprite.setScale(2.f, 2.f);
+        leverSprite.setPosition(450.f, 400.f);
+        
+        initializeLeverFrames();
+
+        statusText.setFont(font);
+        statusText.setCharacterSize(24);
+        statusText.setFillColor(sf::Color::White);
+        statusText.setPosition(10, 10);
+
+        gearStopText.setFont(font);
+        gearStopText.setCharacterSize(16);
+        gearStopText.setFillColor(sf::Color::White);
+        gearStopText.setString("Click Gear or press 'G' to toggle\nPress 'S' to Stop");
+        gearStopText.setPosition(200, 550);
+
+        leverResetText.setFont(font);
+        leverResetText.setCharacterSize(16);
+        leverResetText.setFillColor(sf::Color::White);
+        leverResetText.setString("Click Lever or press 'L' to toggle\nPress 'M' for Middle");
+        leverResetText.setPosition(400, 550);
+
+    }
+    void updateSpriteStates() {
+        PROFILE_ZONE("MechanicalClient::updateSpriteStates");
+        // compute delta time
+        float dt = spriteClock.restart().asSeconds();
+
+        // Gear: continuous rotation when running; stopped = no rotation
+        updateLeverAnimationSmooth(dt);
+        float gearSpeedDegPerSec = 0.f;
+        if (controls.gear == "Clockwise") gearSpeedDegPerSec = 180.f;          // tweak as needed
+        else if (controls.gear == "Counterclockwise") gearSpeedDegPerSec = -180.f;
+        gearSprite.rotate(gearSpeedDegPerSec * dt); // accumulates rotation over frames
+    }
+
+    void updateLeverAnimationSmooth(float deltaTime) {
+    LeverFrame targetFrame;
+
+    if (controls.lever == "Up") {
+        targetFrame = leverAnim.isGold ? GOLD_UP : BLACK_UP;
+    } else if (controls.lever == "Down") {
+        targetFrame = leverAnim.isGold ? GOLD_DOWN : BLACK_DOWN;
+    } else {
+        targetFrame = leverAnim.isGold ? GOLD_MID : BLACK_MID;
+    }
+
+    float targetFrameFloat = static_cast<float>(targetFrame);
+    
+    if (abs(leverAnim.currentFrame - targetFrameFloat) > 0.1f) {
+        // Smoothly interpolate towards target
+        leverAnim.currentFrame += (targetFrameFloat - leverAnim.currentFrame) * leverAnim.animationSpeed * deltaTime;
+    } else {
+        // Animation complete - snap to target and update state
+        leverAnim.currentFrame = targetFrameFloat;
+        leverAnim.currentState = controls.lever;
+    }
+
+    // Update sprite frame for 3x2 layout
+    int displayFrame = static_cast<int>(round(leverAnim.currentFrame));
+    displayFrame = max(0, min(5, displayFrame));
+    
+    // Calculate 2D position in sprite sheet
+    int frameWidth = leverTexture.getSize().x / 3;
+    int frameHeight = leverTexture.getSize().y / 2;
+    
+    int col = displayFrame % 3;  // Column: 0=Up, 1=Mid, 2=Down
+    int row = displayFrame / 3;  // Row: 0=Black, 1=Gold
+    
+    leverFrameRect.left = col * frameWidth;
+    leverFrameRect.top = row * frameHeight;
+    leverFrameRect.width = frameWidth;
+    leverFrameRect.height = frameHeight;
+    
+    leverSprite.setTextureRect(leverFrameRect);
+}
+
+    void toggleLeverColor() {
+        
+        string currentLogicalState = leverAnim.currentState;
+        leverAnim.isGold = !leverAnim.isGold;
+        
+        
+        if (currentLogicalState == "Up") {
+            leverAnim.currentFrame = leverAnim.isGold ? GOLD_UP : BLACK_UP;
+        } else if (currentLogicalState == "Down") {
+            leverAnim.currentFrame = leverAnim.isGold ? GOLD_DOWN : BLACK_DOWN;
+        } else {
+            leverAnim.currentFrame = leverAnim.isGold ? GOLD_MID : BLACK_MID;
+        }
+    }
+    void handleEvents() {
+        PROFILE_ZONE("MechanicalClient::handleEvents");
+        sf::Event event;
+        while (window.pollEvent(event)) {
+            if (event.type == sf::Event::Closed)
+                window.close();
+
+            if (event.type == sf::Event::MouseButtonPressed) {
+                if (event.mouseButton.button == sf::Mouse::Left) {
+                    sf::Vector2i mousePos = sf::Mouse::getPosition(window);
+                    if (leverSprite.getGlobalBounds().contains(mousePos.x, mousePos.y)) {
+                        controls.lever = (controls.lever == "Up") ? "Down" : "Up";
+                        playEffect(SFX_LEVER);
+                        sendMechanicalUpdate(controls.gear, controls.lever, controls.valve, controls.dial);
+                    }
+                    if(gearSprite.getGlobalBounds().contains(mousePos.x, mousePos.y)) {
+                        controls.gear = (controls.gear == "Clockwise") ? "Counterclockwise" : "Clockwise";
+                        playEffect(SFX_GEAR);
+                        sendMechanicalUpdate(controls.gear, controls.lever, controls.valve, controls.dial);
+                    }
+                }
+            }
+
+                                //Keyboard Controls
+            if (event.type == sf::Event::KeyPressed) {
+                switch (event.key.code) {
+                    case sf::Keyboard::G:
+                    controls.gear = (controls.gear == "Clockwise") ? "Counterclockwise" : "Clockwise";
+                        playEffect(SFX_GEAR);
+                        sendMechanicalUpdate(controls.gear, controls.lever, controls.valve, controls.dial);
+                        break;
+                    case sf::Keyboard::S:
+                    controls.gear = "Stopped";
+                        playEffect(SFX_GEAR);
+                        sendMechanicalUpdate(controls.gear, controls.lever, controls.valve, controls.dial);
+                        break;
+                    case sf::Keyboard::L:
+                    controls.lever = (controls.lever == "Up") ? "Down" : "Up";
+                        playEffect(SFX_LEVER);
+                        sendMechanicalUpdate(controls.gear, controls.lever, controls.valve, controls.dial);
+                        break;
+                    case sf::Keyboard::M:
+                    controls.lever = "Middle";
+                        playEffect(SFX_LEVER);
+                        sendMechanicalUpdate(controls.gear, controls.lever, controls.valve, controls.dial);
+                        break;
+                    case sf::Keyboard::V:
+                    controls.valve = (controls.valve == "Open") ? "Partial" : "Open";
+                        playEffect(SFX_VALVE);
+                        sendMechanicalUpdate(controls.gear, controls.lever, controls.valve, controls.dial);
+                        break;
+                    case sf::Keyboard::C:
+                    controls.valve = "Closed";
+                        playEffect(SFX_VALVE);
+                        sendMechanicalUpdate(controls.gear, controls.lever, controls.valve, controls.dial);
+                        break;
+                                                // Dial 0-9 //
+                    case sf::Keyboard::Num0: case sf::Keyboard::Num1: case sf::Keyboard::Num2:
+                    case sf::Keyboard::Num3: case sf::Keyboard::Num4: case sf::Keyboard::Num5:
+                    case sf::Keyboard::Num6: case sf::Keyboard::Num7: case sf::Keyboard::Num8:
+                    case sf::Keyboard::Num9:
+                    controls.dial = event.key.code - sf::Keyboard::Num0;
+                        playEffect(SFX_DIAL);
+                        sendMechanicalUpdate(controls.gear, controls.lever, controls.valve, controls.dial);
+                    break;
+                    case sf::Keyboard::F3:
+                        toggleOverlay();
+                        break;
+                    case sf::Keyboard::F9:
+                        requestTraceDump();
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+    void render() {
+        PROFILE_ZONE("MechanicalClient::render");
+        window.clear(sf::Color(50, 50, 50));
+        
+        // Update gauges based on machine state, predicted between ticks
+        StateMessage shown = displayedState();
+        float pressureHeight = (shown.pressure / 200.0f) * 200.0f;
+        pressureGauge.setSize(Vector2f(30, pressureHeight));
+        
+        float tempHeight = (shown.temperature / 400.0f) * 200.0f;
+        temperatureGauge.setSize(Vector2f(30, tempHeight));
+        
+        // Draw UI elements
+        window.draw(pressureGauge);
+        window.draw(temperatureGauge);
+        window.draw(leverResetText);
+        window.draw(gearStopText);
+        window.draw(gearSprite);
+        window.draw(leverSprite);
+        
+        // Update status text
+        std::stringstream ss;
+        ss << fixed << setprecision(1) << "Pressure: " << shown.pressure << "\n"
+           << "Temperature: " << shown.temperature << "\n"
+           << "Time Left: " << state.timeLeft << "\n"
+           << "\nCurrent Controls:\t(Valve and Gears must be operating)\n"
+           << "Gear: " << controls.gear << "\n"
+           << "Lever: " << controls.lever << "\n"
+           << "Valve: " << controls.valve << "\n"
+           << "Dial: " << controls.dial;
+        statusText.setString(ss.str());
+        window.draw(statusText);
+        
+        presentFrame();
+    }
+
+
+public:
+    MechanicalClient() {
+        initializeGraphics();
+    }
+
+    void sendMechanicalUpdate(const string& gear, const string& lever, 
+                             const string& valve, int dial) {
+        sendInput(MechanicalInputMessage{gear, lever, valve, dial});
+    }
+};
+
+#endif // MECHANICAL_CLIENT_H
@@ -6,6 +6,7 @@
 #include <cmath>
 #include "menus.h"
 #include "audio.h"
+#include "assets.h"
 using namespace std;
 using namespace sf;
 
@@ -37,7 +38,7 @@ int Menus::MainMenu(RenderWindow &window, Font &font, bool &gameStart, bool &new
         exitButton.setPosition(window.getSize().x / 2.f - exitButton.getLocalBounds().width / 2.f, window.getSize().y / 2.f - exitButton.getLocalBounds().height / 2.f + 300);
     
         Image background;
-        if (!background.loadFromFile("/home/dame/brck/background.png"))
+        if (!loadAsset(background, "images/background.png"))
         {
             cerr << "Error Loading Image" << endl;
             return -1;
@@ -18,7 +18,10 @@ private:
 
 public:
     Menus() = default;
-    
+
+    // The game screens play control sounds through the same manager
+    AudioManager& audio() { return audios; }
+
     int MainMenu(RenderWindow &window, Font &font, bool &gameStart, bool &newGame);
 };
 
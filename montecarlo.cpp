@@ -0,0 +1,407 @@
+// Monte Carlo difficulty analyzer: plays millions of matches with simulated
+// players under the server's rules and reports win rates and time-to-win
+// distributions.
+//
+//   montecarlo [--matches N] [--model random|greedy|delayed|all] [--seed S]
+//              [--target P T] [--start P T] [--time N] [--threads N]
+//              [--delay K] [--mistakes P] [--activity P] [--histogram]
+//              [--gear-rate X] [--valve-open X] [--valve-partial X]
+//              [--dial-scale X] [--switch-divisor X] [--tolerance X]
+//
+// Player models, all acting between ticks like real inputs do:
+//   random   each player fiddles with one of their controls now and then
+//   greedy   the pair picks whatever setting lands closest to the target on
+//            the next tick, with an occasional random mistake
+//   delayed  greedy, but reacting to what the gauges showed --delay ticks ago
+//
+// Matches run in batches on the work-stealing executor. Every batch has its
+// own RNG stream derived from (seed, model, batch) and its own result slot,
+// so nothing mutable is shared and a given seed gives the same numbers on
+// any number of threads.
+#include "executor.h"
+#include "physics.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+enum class Model { Random, Greedy, Delayed };
+
+static const char* modelName(Model model) {
+    switch (model) {
+        case Model::Random: return "random";
+        case Model::Greedy: return "greedy";
+        default: return "delayed";
+    }
+}
+
+// xoshiro256** seeded through splitmix64
+class Rng {
+private:
+    uint64_t s[4];
+
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+public:
+    explicit Rng(uint64_t seed) {
+        for (uint64_t& word : s) {
+            seed += 0x9E3779B97F4A7C15ull;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            word = z ^ (z >> 31);
+        }
+    }
+
+    uint64_t next() {
+        uint64_t result = rotl(s[1] * 5, 7) * 9;
+        uint64_t t = s[1] << 17;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 45);
+        return result;
+    }
+
+    int below(int bound) { return (int)((next() >> 32) * bound >> 32); }
+    bool chance(double probability) { return (next() >> 11) * 0x1.0p-53 < probability; }
+};
+
+// Every control combination the two panels can show, with its per-tick rate
+// precomputed from physics.h so a simulated tick is two additions
+class ControlTable {
+public:
+    static const int GEARS = 3, LEVERS = 3, VALVES = 3, DIALS = DIAL_MAX - DIAL_MIN + 1, SWITCHES = 2;
+    static const int COMBOS = GEARS * LEVERS * VALVES * DIALS * SWITCHES;
+
+    struct Controls {
+        int gear, lever, valve, dial, switchA;  // dial as shown, the rest as indexes
+        int combo() const {
+            return (((gear * LEVERS + lever) * VALVES + valve) * DIALS + (dial - DIAL_MIN)) * SWITCHES + switchA;
+        }
+    };
+
+    double pressureRate[COMBOS];
+    double temperatureRate[COMBOS];
+    vector<int> distinct;  // one combo per distinct rate, for the greedy players
+
+    explicit ControlTable(const PhysicsParams& params) {
+        static const char* gears[GEARS] = {"Clockwise", "Counterclockwise", "Stopped"};
+        static const char* levers[LEVERS] = {"Up", "Middle", "Down"};
+        static const char* valves[VALVES] = {"Open", "Partial", "Closed"};
+        static const char* switches[SWITCHES] = {"On", "Off"};
+
+        for (int g = 0; g < GEARS; g++)
+            for (int l = 0; l < LEVERS; l++)
+                for (int v = 0; v < VALVES; v++)
+                    for (int d = DIAL_MIN; d <= DIAL_MAX; d++)
+                        for (int s = 0; s < SWITCHES; s++) {
+                            int combo = Controls{g, l, v, d, s}.combo();
+                            pair<double, double> rates = controlRates({gears[g], levers[l], valves[v], d}, {switches[s], "Idle"}, params);
+                            pressureRate[combo] = rates.first;
+                            temperatureRate[combo] = rates.second;
+
+                            bool seen = false;
+                            for (int other : distinct) {
+                                if (pressureRate[other] == rates.first && temperatureRate[other] == rates.second) seen = true;
+                            }
+                            if (!seen) distinct.push_back(combo);
+                        }
+    }
+
+    // Panels as the server starts them: Stopped, Middle, Closed, dial 5, Off
+    static Controls initial() { return {2, 1, 2, 5, 1}; }
+
+    static Controls decode(int combo) {
+        Controls c;
+        c.switchA = combo % SWITCHES; combo /= SWITCHES;
+        c.dial = DIAL_MIN + combo % DIALS; combo /= DIALS;
+        c.valve = combo % VALVES; combo /= VALVES;
+        c.lever = combo % LEVERS;
+        c.gear = combo / LEVERS;
+        return c;
+    }
+};
+
+struct Scenario {
+    double startPressure = 100.0;
+    double startTemperature = 200.0;
+    double targetPressure = 150.0;
+    double targetTemperature = 300.0;
+    int timeLimit = 60;
+    int delay = 2;            // ticks of reaction lag for the delayed model
+    double mistakes = 0.1;    // chance per tick a greedy player does something random
+    double activity = 0.3;    // chance per tick a random player touches a control
+    PhysicsParams params;
+};
+
+// Counts for one batch of matches; padded so neighbouring batches written by
+// different workers never share a cache line
+struct alignas(64) BatchResult {
+    uint64_t wins = 0;
+    uint64_t failures = 0;
+    uint64_t timeouts = 0;
+    vector<uint64_t> winTicks;  // wins per tick
+};
+
+class MatchSimulator {
+private:
+    const Scenario& scenario;
+    const ControlTable& table;
+
+    double distanceToTarget(double pressure, double temperature) const {
+        return fabs(pressure - scenario.targetPressure) + fabs(temperature - scenario.targetTemperature);
+    }
+
+    static void randomTweak(ControlTable::Controls& controls, Rng& rng, bool& button, double activity) {
+        if (rng.chance(activity)) {
+            switch (rng.below(4)) {
+                case 0: controls.gear = rng.below(ControlTable::GEARS); break;
+                case 1: controls.lever = rng.below(ControlTable::LEVERS); break;
+                case 2: controls.valve = rng.below(ControlTable::VALVES); break;
+                default: controls.dial = DIAL_MIN + rng.below(ControlTable::DIALS); break;
+            }
+        }
+        if (rng.chance(activity / 2)) controls.switchA ^= 1;
+        button = rng.chance(activity / 10);
+    }
+
+    // Best next setting judged from an observed machine state; the button
+    // wins when every setting would fail the machine or reset gets closer
+    void greedyChoice(const Machine& observed, ControlTable::Controls& controls, bool& button) const {
+        const PhysicsParams& params = scenario.params;
+        double best = distanceToTarget(params.safePressure, params.safeTemperature);
+        int bestCombo = -1;
+
+        for (int combo : table.distinct) {
+            Machine next = {observed.pressure + table.pressureRate[combo], observed.temperature + table.temperatureRate[combo]};
+            if (machineFailed(next, params)) continue;
+            double distance = distanceToTarget(next.pressure, next.temperature);
+            if (bestCombo < 0 || distance < best) {
+                best = distance;
+                bestCombo = combo;
+            }
+        }
+
+        button = bestCombo < 0 || best > distanceToTarget(params.safePressure, params.safeTemperature);
+        if (bestCombo >= 0) controls = ControlTable::decode(bestCombo);
+    }
+
+public:
+    MatchSimulator(const Scenario& scenario, const ControlTable& table) : scenario(scenario), table(table) {}
+
+    void play(Model model, Rng& rng, BatchResult& result) const {
+        const PhysicsParams& params = scenario.params;
+        Machine machine = {scenario.startPressure, scenario.startTemperature};
+        ControlTable::Controls controls = ControlTable::initial();
+
+        // Gauges as they looked over the last few ticks, for the delayed model
+        static const int HISTORY = 64;
+        Machine history[HISTORY];
+        int lag = min(scenario.delay, HISTORY - 1);
+        for (Machine& seen : history) seen = machine;
+
+        for (int tick = 1; tick <= scenario.timeLimit; tick++) {
+            bool button = false;
+            switch (model) {
+                case Model::Random:
+                    randomTweak(controls, rng, button, scenario.activity);
+                    break;
+                case Model::Greedy:
+                    if (rng.chance(scenario.mistakes)) randomTweak(controls, rng, button, 1.0);
+                    else greedyChoice(machine, controls, button);
+                    break;
+                case Model::Delayed:
+                    if (rng.chance(scenario.mistakes)) randomTweak(controls, rng, button, 1.0);
+                    else greedyChoice(history[(tick - 1 - lag + HISTORY) % HISTORY], controls, button);
+                    break;
+            }
+
+            // Same order as Session::updateGameStateLocked(): integrate, button
+            // reset, then failure and win checks
+            int combo = controls.combo();
+            machine.pressure += table.pressureRate[combo];
+            machine.temperature += table.temperatureRate[combo];
+            if (button) machine = {params.safePressure, params.safeTemperature};
+            history[tick % HISTORY] = machine;
+
+            if (machineFailed(machine, params)) {
+                result.failures++;
+                return;
+            }
+            if (machineOnTarget(machine, scenario.targetPressure, scenario.targetTemperature, params)) {
+                result.wins++;
+                result.winTicks[tick]++;
+                return;
+            }
+        }
+        result.timeouts++;
+    }
+};
+
+struct ModelSummary {
+    uint64_t matches = 0, wins = 0, failures = 0, timeouts = 0;
+    vector<uint64_t> winTicks;
+};
+
+static ModelSummary runModel(Executor& executor, const MatchSimulator& simulator, const Scenario& scenario,
+                             Model model, uint64_t matches, uint64_t seed) {
+    const uint64_t BATCH = 4096;
+    size_t batchCount = (matches + BATCH - 1) / BATCH;
+    vector<BatchResult> batches(batchCount);
+
+    // Split the batch range in halves: each task hands one half to the pool
+    // and keeps the other, so idle workers steal large chunks first
+    function<void(size_t, size_t)> runRange = [&](size_t first, size_t last) {
+        while (last - first > 1) {
+            size_t middle = first + (last - first) / 2;
+            executor.submit([&runRange, middle, last] { runRange(middle, last); });
+            last = middle;
+        }
+
+        BatchResult& result = batches[first];
+        result.winTicks.assign(scenario.timeLimit + 1, 0);
+        Rng rng(seed ^ ((uint64_t)model << 56) ^ (first * 0x9E3779B97F4A7C15ull));
+        uint64_t count = min(BATCH, matches - first * BATCH);
+        for (uint64_t i = 0; i < count; i++) simulator.play(model, rng, result);
+    };
+
+    if (batchCount > 0) {
+        executor.submit([&runRange, batchCount] { runRange(0, batchCount); });
+        executor.waitIdle();
+    }
+
+    ModelSummary summary;
+    summary.matches = matches;
+    summary.winTicks.assign(scenario.timeLimit + 1, 0);
+    for (const BatchResult& batch : batches) {
+        summary.wins += batch.wins;
+        summary.failures += batch.failures;
+        summary.timeouts += batch.timeouts;
+        for (size_t tick = 0; tick < batch.winTicks.size(); tick++) summary.winTicks[tick] += batch.winTicks[tick];
+    }
+    return summary;
+}
+
+static int percentileTick(const ModelSummary& summary, double fraction) {
+    uint64_t needed = (uint64_t)ceil(summary.wins * fraction);
+    uint64_t seen = 0;
+    for (size_t tick = 0; tick < summary.winTicks.size(); tick++) {
+        seen += summary.winTicks[tick];
+        if (seen >= needed && seen > 0) return tick;
+    }
+    return -1;
+}
+
+static void printSummary(Model model, const ModelSummary& summary, bool histogram) {
+    double total = max<uint64_t>(summary.matches, 1);
+    cout << setw(8) << modelName(model)
+         << setw(8) << 100.0 * summary.wins / total
+         << setw(8) << 100.0 * summary.failures / total
+         << setw(9) << 100.0 * summary.timeouts / total;
+
+    if (summary.wins == 0) {
+        cout << "       -     -     -     -\n";
+    } else {
+        double sum = 0.0;
+        for (size_t tick = 0; tick < summary.winTicks.size(); tick++) sum += (double)tick * summary.winTicks[tick];
+        cout << setw(8) << sum / summary.wins
+             << setw(6) << percentileTick(summary, 0.10)
+             << setw(6) << percentileTick(summary, 0.50)
+             << setw(6) << percentileTick(summary, 0.90) << "\n";
+    }
+
+    if (histogram && summary.wins > 0) {
+        uint64_t peak = *max_element(summary.winTicks.begin(), summary.winTicks.end());
+        for (size_t tick = 1; tick < summary.winTicks.size(); tick++) {
+            if (summary.winTicks[tick] == 0) continue;
+            int bar = (int)(40 * summary.winTicks[tick] / peak);
+            cout << "        " << setw(4) << tick << " " << setw(6) << 100.0 * summary.winTicks[tick] / summary.wins
+                 << "% " << string(max(bar, 1), '#') << "\n";
+        }
+    }
+}
+
+static void usage(const char* program) {
+    cout << "Usage: " << program << " [--matches N] [--model random|greedy|delayed|all] [--seed S]\n"
+         << "         [--target P T] [--start P T] [--time N] [--threads N]\n"
+         << "         [--delay K] [--mistakes P] [--activity P] [--histogram]\n"
+         << "         [--gear-rate X] [--valve-open X] [--valve-partial X]\n"
+         << "         [--dial-scale X] [--switch-divisor X] [--tolerance X]\n";
+}
+
+int main(int argc, char* argv[]) {
+    Scenario scenario;
+    uint64_t matches = 1000000;
+    uint64_t seed = 1;
+    size_t threads = thread::hardware_concurrency();
+    bool histogram = false;
+    vector<Model> models = {Model::Random, Model::Greedy, Model::Delayed};
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--matches" && hasValue) matches = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--seed" && hasValue) seed = strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--threads" && hasValue) threads = max(1, atoi(argv[++i]));
+        else if (arg == "--time" && hasValue) scenario.timeLimit = max(1, atoi(argv[++i]));
+        else if (arg == "--delay" && hasValue) scenario.delay = max(0, atoi(argv[++i]));
+        else if (arg == "--mistakes" && hasValue) scenario.mistakes = atof(argv[++i]);
+        else if (arg == "--activity" && hasValue) scenario.activity = atof(argv[++i]);
+        else if (arg == "--gear-rate" && hasValue) scenario.params.gearRate = atof(argv[++i]);
+        else if (arg == "--valve-open" && hasValue) scenario.params.valveOpen = atof(argv[++i]);
+        else if (arg == "--valve-partial" && hasValue) scenario.params.valvePartial = atof(argv[++i]);
+        else if (arg == "--dial-scale" && hasValue) scenario.params.dialScale = atof(argv[++i]);
+        else if (arg == "--switch-divisor" && hasValue) scenario.params.switchDivisor = atof(argv[++i]);
+        else if (arg == "--tolerance" && hasValue) scenario.params.targetTolerance = atof(argv[++i]);
+        else if (arg == "--histogram") histogram = true;
+        else if (arg == "--target" && i + 2 < argc) {
+            scenario.targetPressure = atof(argv[++i]);
+            scenario.targetTemperature = atof(argv[++i]);
+        } else if (arg == "--start" && i + 2 < argc) {
+            scenario.startPressure = atof(argv[++i]);
+            scenario.startTemperature = atof(argv[++i]);
+        } else if (arg == "--model" && hasValue) {
+            string name = argv[++i];
+            if (name == "random") models = {Model::Random};
+            else if (name == "greedy") models = {Model::Greedy};
+            else if (name == "delayed") models = {Model::Delayed};
+            else if (name != "all") {
+                usage(argv[0]);
+                return 1;
+            }
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    ControlTable table(scenario.params);
+    MatchSimulator simulator(scenario, table);
+    Executor executor(threads);
+
+    cout << matches << " matches per model, start (" << scenario.startPressure << ", " << scenario.startTemperature
+         << "), target (" << scenario.targetPressure << ", " << scenario.targetTemperature << ") +/- "
+         << scenario.params.targetTolerance << ", " << scenario.timeLimit << " ticks, "
+         << executor.threadCount() << " threads, seed " << seed << "\n\n";
+    cout << fixed << setprecision(2);
+    cout << "   model    win%   fail% timeout%    mean   p10   p50   p90  (ticks to win)\n";
+
+    auto began = chrono::steady_clock::now();
+    for (Model model : models) {
+        printSummary(model, runModel(executor, simulator, scenario, model, matches, seed), histogram);
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - began).count();
+    cout << "\nSimulated " << matches * models.size() << " matches in " << seconds << " s\n";
+    return 0;
+}
@@ -0,0 +1,190 @@
+#ifndef PERF_OVERLAY_H
+#define PERF_OVERLAY_H
+
+#include <SFML/Graphics.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// RenderWindow that counts the draw() calls made through it. Drawables
+// that draw their own parts count once, and so does anything drawn through
+// a plain sf::RenderTarget& (the overlay itself, the menus).
+class CountingWindow : public sf::RenderWindow {
+public:
+    using sf::RenderWindow::draw;
+
+    void draw(const sf::Drawable& drawable, const sf::RenderStates& states = sf::RenderStates::Default) {
+        drawCalls++;
+        sf::RenderWindow::draw(drawable, states);
+    }
+
+    void draw(const sf::Vertex* vertices, size_t vertexCount, sf::PrimitiveType type,
+              const sf::RenderStates& states = sf::RenderStates::Default) {
+        drawCalls++;
+        sf::RenderWindow::draw(vertices, vertexCount, type, states);
+    }
+
+    // Calls since the last take
+    unsigned takeDrawCalls() {
+        unsigned count = drawCalls;
+        drawCalls = 0;
+        return count;
+    }
+
+private:
+    unsigned drawCalls = 0;
+};
+
+struct NetworkStats {
+    double stateAgeMs;     // of the latest STATE, on the server's clock once synced; < 0 if none yet
+    double rttMs;          // smoothed; < 0 until the first PONG
+    double clockOffsetMs;  // server clock minus ours
+    bool clockSynced;
+    uint64_t bytesIn;      // totals since starting, newlines included
+    uint64_t bytesOut;
+    uint32_t unackedInputs;  // sent, not yet echoed back in a STATE
+};
+
+// Frame-time graph and connection numbers drawn in a corner of the window
+// (toggled with F3), so that reports of stutter come with numbers. Frame
+// times are recorded all the time, which is one clock read per frame; the
+// text is only rebuilt, a few times a second, while the overlay is shown.
+class PerfOverlay {
+public:
+    static const int HISTORY = 240;  // frames in the graph and the percentile
+
+    explicit PerfOverlay(const sf::Font& font)
+        : shown(false), frameTimes(HISTORY, 0.f), nextFrame(0), recordedFrames(0), lastDrawCalls(0),
+          graph(sf::Lines, 2 * HISTORY), bytesInAtSample(0), bytesOutAtSample(0), inRate(0), outRate(0) {
+        background.setSize(sf::Vector2f(WIDTH, HEIGHT));
+        background.setFillColor(sf::Color(0, 0, 0, 170));
+        budgetLine.setSize(sf::Vector2f(HISTORY, 1));
+        budgetLine.setFillColor(sf::Color(255, 255, 255, 90));
+        text.setFont(font);
+        text.setCharacterSize(12);
+        text.setFillColor(sf::Color::White);
+    }
+
+    bool visible() const { return shown; }
+    void toggle() { shown = !shown; }
+
+    // Once per frame, just before display(), with the frame's draw calls
+    void frameFinished(unsigned drawCalls) {
+        Clock::time_point now = Clock::now();
+        if (lastFrame != Clock::time_point()) {
+            float ms = chrono::duration<float, milli>(now - lastFrame).count();
+            // Longer gaps are time spent outside the frame loop (the menu)
+            if (ms < 1000.f) {
+                frameTimes[nextFrame] = ms;
+                nextFrame = (nextFrame + 1) % HISTORY;
+                recordedFrames = min(recordedFrames + 1, HISTORY);
+            }
+        }
+        lastFrame = now;
+        lastDrawCalls = drawCalls;
+    }
+
+    void draw(sf::RenderTarget& target, const NetworkStats& network) {
+        sf::Vector2f origin(target.getSize().x - WIDTH - MARGIN, MARGIN);
+        Clock::time_point now = Clock::now();
+
+        if (now - lastSample >= chrono::seconds(1)) {
+            double seconds = chrono::duration<double>(now - lastSample).count();
+            if (lastSample != Clock::time_point()) {
+                inRate = (network.bytesIn - bytesInAtSample) / seconds;
+                outRate = (network.bytesOut - bytesOutAtSample) / seconds;
+            }
+            bytesInAtSample = network.bytesIn;
+            bytesOutAtSample = network.bytesOut;
+            lastSample = now;
+        }
+        if (now - lastTextUpdate >= chrono::milliseconds(250)) {
+            updateText(network);
+            lastTextUpdate = now;
+        }
+
+        // Oldest frame on the left, one pixel per frame
+        float graphBottom = origin.y + HEIGHT - PADDING;
+        for (int i = 0; i < HISTORY; i++) {
+            float ms = frameTimes[(nextFrame + i) % HISTORY];
+            float height = min(ms, GRAPH_MAX_MS) / GRAPH_MAX_MS * GRAPH_HEIGHT;
+            sf::Color color = ms <= 17.f ? sf::Color::Green : ms <= 34.f ? sf::Color::Yellow : sf::Color::Red;
+            float x = origin.x + PADDING + i;
+            graph[2 * i] = sf::Vertex(sf::Vector2f(x, graphBottom), color);
+            graph[2 * i + 1] = sf::Vertex(sf::Vector2f(x, graphBottom - height), color);
+        }
+
+        background.setPosition(origin);
+        text.setPosition(origin.x + PADDING, origin.y + PADDING);
+        budgetLine.setPosition(origin.x + PADDING, graphBottom - 16.7f / GRAPH_MAX_MS * GRAPH_HEIGHT);
+        target.draw(background);
+        target.draw(text);
+        target.draw(graph);
+        target.draw(budgetLine);
+    }
+
+private:
+    typedef chrono::steady_clock Clock;
+
+    static constexpr float WIDTH = 260;
+    static constexpr float HEIGHT = 160;
+    static constexpr float MARGIN = 10;
+    static constexpr float PADDING = 10;
+    static constexpr float GRAPH_HEIGHT = 50;
+    static constexpr float GRAPH_MAX_MS = 50;  // taller frames are clipped
+
+    bool shown;
+
+    vector<float> frameTimes;  // ms, ring of the last HISTORY frames
+    int nextFrame;
+    int recordedFrames;
+    Clock::time_point lastFrame;
+    unsigned lastDrawCalls;
+
+    sf::RectangleShape background;
+    sf::RectangleShape budgetLine;  // 60 fps
+    sf::VertexArray graph;
+    sf::Text text;
+    Clock::time_point lastTextUpdate;
+
+    Clock::time_point lastSample;
+    uint64_t bytesInAtSample;
+    uint64_t bytesOutAtSample;
+    double inRate;
+    double outRate;
+
+    void updateText(const NetworkStats& network) {
+        float last = frameTimes[(nextFrame + HISTORY - 1) % HISTORY];
+        float p99 = 0;
+        if (recordedFrames > 0) {
+            // The ring fills from index 0, so the recorded frames come first
+            vector<float> sorted(frameTimes.begin(), frameTimes.begin() + recordedFrames);
+            size_t rank = (sorted.size() * 99 + 99) / 100 - 1;
+            nth_element(sorted.begin(), sorted.begin() + rank, sorted.end());
+            p99 = sorted[rank];
+        }
+
+        char lines[256];
+        char stateAge[32], rtt[64];
+        if (network.stateAgeMs < 0) snprintf(stateAge, sizeof(stateAge), "-");
+        else snprintf(stateAge, sizeof(stateAge), "%.0f ms", network.stateAgeMs);
+        if (!network.clockSynced) snprintf(rtt, sizeof(rtt), "-");
+        else snprintf(rtt, sizeof(rtt), "%.1f ms   clock %+.1f ms", network.rttMs, network.clockOffsetMs);
+
+        snprintf(lines, sizeof(lines),
+                 "frame %.1f ms   p99 %.1f ms\n"
+                 "draw calls %u\n"
+                 "state age %s   unacked inputs %u\n"
+                 "rtt %s\n"
+                 "in %.1f KB/s   out %.1f KB/s",
+                 last, p99, lastDrawCalls, stateAge, network.unackedInputs, rtt, inRate / 1024, outRate / 1024);
+        text.setString(lines);
+    }
+};
+
+#endif // PERF_OVERLAY_H
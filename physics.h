@@ -0,0 +1,111 @@
+#ifndef PHYSICS_H
+#define PHYSICS_H
+
+#include <string>
+#include <utility>
+#include <cmath>
+
+using namespace std;
+
+// Control panel and machine structures shared by the server, the simulation
+// graph and the offline analyzers
+struct Mechanical {
+    string gear;   // "Clockwise", "Counterclockwise", "Stopped"
+    string lever;  // "Up", "Middle", "Down"
+    string valve;  // "Open", "Partial", "Closed"
+    int dial;      // DIAL_MIN to DIAL_MAX
+};
+
+// Dial positions a mechanical panel can report; the analyzers enumerate
+// and sample exactly these
+const int DIAL_MIN = 0;
+const int DIAL_MAX = 10;
+
+struct Electrical {
+    string switchA;  // "On", "Off"
+    string button;   // "Idle", "Pressed"
+};
+
+struct Machine {
+    double pressure;
+    double temperature;
+};
+
+inline bool operator==(const Mechanical& a, const Mechanical& b) {
+    return a.gear == b.gear && a.lever == b.lever && a.valve == b.valve && a.dial == b.dial;
+}
+
+inline bool operator==(const Electrical& a, const Electrical& b) {
+    return a.switchA == b.switchA && a.button == b.button;
+}
+
+// Tunable coefficients; the defaults are the original game rules
+struct PhysicsParams {
+    double gearRate = 5.0;            // per tick, sign follows gear direction
+    double valveOpen = 2.0;
+    double valvePartial = 1.0;
+    double dialScale = 10.0;          // dial / dialScale
+    double switchDivisor = 2.0;       // stabilizer switch divides the change
+    double safePressure = 100.0;      // button reset values
+    double safeTemperature = 200.0;
+    double minPressure = 50.0;        // outside these bounds the machine fails
+    double maxPressure = 200.0;
+    double minTemperature = 100.0;
+    double maxTemperature = 400.0;
+    double targetTolerance = 10.0;    // win when within this of both targets
+};
+
+const PhysicsParams DEFAULT_PHYSICS{};
+
+inline double gearEffect(const string& gear, const PhysicsParams& params = DEFAULT_PHYSICS) {
+    if (gear == "Clockwise") return params.gearRate;
+    else if (gear == "Counterclockwise") return -params.gearRate;
+    else return 0.0;
+}
+
+inline double valveMultiplier(const string& valve, const PhysicsParams& params = DEFAULT_PHYSICS) {
+    if (valve == "Open") return params.valveOpen;
+    else if (valve == "Partial") return params.valvePartial;
+    else return 0.0;
+}
+
+inline double dialMultiplier(int dial, const PhysicsParams& params = DEFAULT_PHYSICS) {
+    return dial / params.dialScale;
+}
+
+inline pair<double, double> leverMultiplier(const string& lever) {
+    if (lever == "Up") return {1.0, 0.0};
+    else if (lever == "Down") return {0.0, 1.0};
+    else return {0.5, 0.5};
+}
+
+// Per-tick (pressure, temperature) change produced by one set of controls
+inline pair<double, double> controlRates(const Mechanical& mechanical, const Electrical& electrical,
+                                         const PhysicsParams& params = DEFAULT_PHYSICS) {
+    double effect = gearEffect(mechanical.gear, params) * valveMultiplier(mechanical.valve, params) *
+                    dialMultiplier(mechanical.dial, params);
+
+    pair<double, double> leverMap = leverMultiplier(mechanical.lever);
+    double pressureChange = effect * leverMap.first;
+    double tempChange = effect * leverMap.second;
+
+    // Apply switch stabilizer
+    if (electrical.switchA == "On") {
+        pressureChange /= params.switchDivisor;
+        tempChange /= params.switchDivisor;
+    }
+    return {pressureChange, tempChange};
+}
+
+inline bool machineFailed(const Machine& machine, const PhysicsParams& params = DEFAULT_PHYSICS) {
+    return machine.pressure < params.minPressure || machine.pressure > params.maxPressure ||
+           machine.temperature < params.minTemperature || machine.temperature > params.maxTemperature;
+}
+
+inline bool machineOnTarget(const Machine& machine, double targetPressure, double targetTemperature,
+                            const PhysicsParams& params = DEFAULT_PHYSICS) {
+    return abs(machine.pressure - targetPressure) <= params.targetTolerance &&
+           abs(machine.temperature - targetTemperature) <= params.targetTolerance;
+}
+
+#endif // PHYSICS_H
@@ -0,0 +1,161 @@
+#ifndef PREDICTION_H
+#define PREDICTION_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include "lockstep.h"
+#include "physics.h"
+#include "protocol.h"
+
+using namespace std;
+
+// Client-side prediction for the gauges. The server only moves the machine
+// once a tick, so a control change used to show up to a whole tick later.
+// Instead, the station runs the tick's physics itself: from the latest
+// authoritative state, pressure and temperature move towards the next tick
+// at the rates the current controls give, ours included the moment we send
+// them. When the next state arrives, whatever the prediction got wrong (an
+// input the server got after its tick, the other station's change on the
+// way) is not snapped away but faded out over RECONCILE_MICROS.
+//
+// Inputs carry a seq, and STATE echoes the last one the server applied from
+// each station; the session passes each station's inputs on to the other.
+// Our own controls are the ones we last sent, unless the server has since
+// told us about a seq at least as recent (a reset, a RESUME), whose controls
+// then win.
+//
+// Render thread only; all times are monotonicMicros() on our clock.
+class Predictor {
+public:
+    // Session::TICK_INTERVAL, until the states say otherwise
+    static const int64_t DEFAULT_TICK_MICROS = 1000000;
+    // Time constant of the fade after a misprediction
+    static const int64_t RECONCILE_MICROS = 150000;
+
+    explicit Predictor(const PhysicsParams& physics = DEFAULT_PHYSICS)
+        : params(physics), station(NONE), sentSeq(0), serverMechanical{"Stopped", "Middle", "Closed", 5},
+          serverMechanicalSeq(0), serverElectrical{"Off", "Idle"}, serverElectricalSeq(0), baseAt(0),
+          tickMicros(DEFAULT_TICK_MICROS), pressureError(0), temperatureError(0), reconciledAt(0) {
+        updateRates();
+    }
+
+    // Our input, as it goes out with its seq
+    void sent(const MechanicalInputMessage& input) {
+        station = MECHANICAL;
+        sentSeq = input.seq;
+        sentMechanical = controlsOf(input);
+        updateRates();
+    }
+
+    void sent(const ElectricalInputMessage& input) {
+        station = ELECTRICAL;
+        sentSeq = input.seq;
+        sentElectrical = controlsOf(input);
+        updateRates();
+    }
+
+    // A station's controls as the server has them
+    void serverControls(const MechanicalInputMessage& input) {
+        serverMechanical = controlsOf(input);
+        serverMechanicalSeq = input.seq;
+        updateRates();
+    }
+
+    void serverControls(const ElectricalInputMessage& input) {
+        serverElectrical = controlsOf(input);
+        serverElectricalSeq = input.seq;
+        updateRates();
+    }
+
+    // A new authoritative state, which became true at `at`
+    void authoritative(const StateMessage& state, int64_t at) {
+        StateMessage before = shown(at);
+        bool wasActive = base.gameActive;
+        int64_t span = state.serverTime - base.serverTime;
+        // Only consecutive ticks tell the tick length; states sent for other
+        // reasons (READY, a RESUME) come in between at any time
+        if (wasActive && state.gameActive && span > tickMicros / 2 && span < tickMicros * 2) {
+            tickMicros += (span - tickMicros) / 4;
+        }
+
+        base = state;
+        baseAt = at;
+        pressureError = 0;
+        temperatureError = 0;
+        if (wasActive && state.gameActive) {
+            StateMessage after = shown(at);
+            pressureError = before.pressure - after.pressure;
+            temperatureError = before.temperature - after.temperature;
+            reconciledAt = at;
+        }
+    }
+
+    // Sent inputs the server has not applied yet, as far as we know
+    uint32_t unacknowledged() const {
+        if (station == NONE) return 0;
+        uint32_t acked = station == MECHANICAL ? base.mechanicalSeq : base.electricalSeq;
+        return sentSeq > acked ? sentSeq - acked : 0;
+    }
+
+    // The latest state with pressure and temperature as predicted for now
+    StateMessage shown(int64_t now) const {
+        StateMessage predicted = base;
+        if (!base.gameActive) return predicted;
+
+        double progress = max(0.0, min(1.0, double(now - baseAt) / tickMicros));
+        if (resetting) {
+            // A pressed button puts the machine back to safe values on the tick
+            predicted.pressure += (params.safePressure - base.pressure) * progress;
+            predicted.temperature += (params.safeTemperature - base.temperature) * progress;
+        } else {
+            predicted.pressure += rates.first * progress;
+            predicted.temperature += rates.second * progress;
+        }
+
+        if (pressureError != 0 || temperatureError != 0) {
+            double fade = exp(-double(now - reconciledAt) / RECONCILE_MICROS);
+            predicted.pressure += pressureError * fade;
+            predicted.temperature += temperatureError * fade;
+        }
+        return predicted;
+    }
+
+private:
+    enum Station { NONE, MECHANICAL, ELECTRICAL };
+
+    PhysicsParams params;
+    Station station;  // ours, known once we send an input
+    uint32_t sentSeq;
+    Mechanical sentMechanical;
+    Electrical sentElectrical;
+    Mechanical serverMechanical;
+    uint32_t serverMechanicalSeq;
+    Electrical serverElectrical;
+    uint32_t serverElectricalSeq;
+
+    // The controls the next tick will see, as we expect them
+    pair<double, double> rates;
+    bool resetting;
+
+    StateMessage base;  // the latest authoritative state
+    int64_t baseAt;
+    int64_t tickMicros;
+
+    // Prediction minus truth when base arrived, fading out from reconciledAt
+    double pressureError;
+    double temperatureError;
+    int64_t reconciledAt;
+
+    void updateRates() {
+        bool ownMechanical = station == MECHANICAL && sentSeq > serverMechanicalSeq;
+        bool ownElectrical = station == ELECTRICAL && sentSeq > serverElectricalSeq;
+        const Mechanical& mechanical = ownMechanical ? sentMechanical : serverMechanical;
+        const Electrical& electrical = ownElectrical ? sentElectrical : serverElectrical;
+        rates = controlRates(mechanical, electrical, params);
+        resetting = electrical.button == "Pressed";
+    }
+};
+
+#endif // PREDICTION_H
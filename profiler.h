@@ -0,0 +1,202 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Scoped-zone profiler. A zone records when it was entered and left:
+//
+//   void Session::tick() {
+//       PROFILE_ZONE("Session::tick");
+//       ...
+//
+// Every thread records into its own ring of the last EVENTS_PER_THREAD
+// zones, so recording never contends with other threads. dump() writes
+// all rings as Chrome trace JSON (chrome://tracing or ui.perfetto.dev).
+//
+// Recording is off unless FACTORY_PROFILE=1 or setEnabled(true); a zone on
+// a disabled profiler costs one relaxed atomic load. Building with
+// -DNO_PROFILER removes zones altogether. Zone names must be string
+// literals (only the pointer is kept).
+class Profiler {
+public:
+    static const size_t EVENTS_PER_THREAD = 1 << 16;
+
+    static bool enabled() { return enabledFlag().load(memory_order_relaxed); }
+    static void setEnabled(bool on) { enabledFlag().store(on, memory_order_relaxed); }
+
+    // Nanoseconds since the profiler's epoch
+    static int64_t now() {
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - epoch()).count();
+    }
+
+    // Label for the calling thread's track in the trace
+    static void nameThread(const string& name) {
+        ThreadBuffer& buffer = localBuffer();
+        lock_guard<mutex> lock(buffer.lock);
+        buffer.name = name;
+    }
+
+    static void record(const char* name, int64_t start, int64_t end) {
+        ThreadBuffer& buffer = localBuffer();
+        lock_guard<mutex> lock(buffer.lock);  // only contended by dump()
+        if (buffer.events.empty()) buffer.events.resize(EVENTS_PER_THREAD);
+        buffer.events[buffer.next % EVENTS_PER_THREAD] = {name, start, end - start};
+        buffer.next++;
+    }
+
+    // Writes every thread's recorded zones to path; false on I/O errors
+    static bool dump(const string& path) {
+        FILE* out = fopen(path.c_str(), "w");
+        if (!out) {
+            perror(("cannot write " + path).c_str());
+            return false;
+        }
+
+        int pid = getpid();
+        fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        bool first = true;
+        for (const shared_ptr<ThreadBuffer>& buffer : allBuffers()) {
+            string name;
+            vector<Event> events;
+            {
+                lock_guard<mutex> lock(buffer->lock);
+                name = buffer->name;
+                size_t count = min<size_t>(buffer->next, buffer->events.size());
+                for (size_t i = buffer->next - count; i < buffer->next; i++) {
+                    events.push_back(buffer->events[i % EVENTS_PER_THREAD]);
+                }
+            }
+
+            if (!name.empty()) {
+                fprintf(out, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                        first ? "" : ",\n", pid, buffer->tid, escaped(name).c_str());
+                first = false;
+            }
+            for (const Event& event : events) {
+                fprintf(out, "%s{\"ph\":\"X\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                        first ? "" : ",\n", escaped(event.name).c_str(), pid, buffer->tid,
+                        event.start / 1000.0, event.duration / 1000.0);
+                first = false;
+            }
+        }
+        fprintf(out, "\n]}\n");
+        return fclose(out) == 0;
+    }
+
+    // The on-demand trigger (SIGUSR1 on the server, F9 in a client window):
+    // starts recording if it was off, otherwise dumps to a fresh
+    // factory-trace-<pid>-<n>.json. Returns the file written, or "" if
+    // recording just started or the dump failed.
+    static string requestDump() {
+        if (!enabled()) {
+            setEnabled(true);
+            return "";
+        }
+        static atomic<int> dumps(0);
+        string path = "factory-trace-" + to_string(getpid()) + "-" + to_string(++dumps) + ".json";
+        return dump(path) ? path : "";
+    }
+
+private:
+    struct Event {
+        const char* name;
+        int64_t start;
+        int64_t duration;
+    };
+
+    // Kept after its thread exits, so a dump still shows finished threads
+    struct ThreadBuffer {
+        mutex lock;
+        int tid;
+        string name;
+        vector<Event> events;  // allocated on the first recorded zone
+        size_t next = 0;
+    };
+
+    static atomic<bool>& enabledFlag() {
+        static atomic<bool> flag([] {
+            const char* setting = getenv("FACTORY_PROFILE");
+            return setting && strcmp(setting, "0") != 0;
+        }());
+        return flag;
+    }
+
+    static chrono::steady_clock::time_point epoch() {
+        static const chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        return start;
+    }
+
+    static mutex& registryMutex() {
+        static mutex registry;
+        return registry;
+    }
+
+    static vector<shared_ptr<ThreadBuffer>>& registry() {
+        static vector<shared_ptr<ThreadBuffer>> buffers;
+        return buffers;
+    }
+
+    static vector<shared_ptr<ThreadBuffer>> allBuffers() {
+        lock_guard<mutex> lock(registryMutex());
+        return registry();
+    }
+
+    static ThreadBuffer& localBuffer() {
+        static thread_local shared_ptr<ThreadBuffer> buffer = [] {
+            shared_ptr<ThreadBuffer> created = make_shared<ThreadBuffer>();
+            lock_guard<mutex> lock(registryMutex());
+            created->tid = registry().size() + 1;
+            registry().push_back(created);
+            return created;
+        }();
+        return *buffer;
+    }
+
+    static string escaped(const string& text) {
+        string result;
+        for (char c : text) {
+            if (c == '"' || c == '\\') result += '\\';
+            result += c;
+        }
+        return result;
+    }
+};
+
+class ProfileZone {
+public:
+    explicit ProfileZone(const char* zoneName)
+        : name(zoneName), start(Profiler::enabled() ? Profiler::now() : -1) {}
+    ~ProfileZone() {
+        if (start >= 0) Profiler::record(name, start, Profiler::now());
+    }
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+    const char* name;
+    int64_t start;  // -1 when recording was off on entry
+};
+
+#ifdef NO_PROFILER
+#define PROFILE_ZONE(name) do {} while (0)
+#else
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#endif
+
+#endif // PROFILER_H
@@ -0,0 +1,327 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+using namespace std;
+
+// Every line the server and the stations exchange, declared once. A message
+// is a struct with a TAG and fields(), its members in wire order:
+//
+//   TAG|field|field|...
+//
+// encode() and decode() are generated from that list, so the server and
+// the clients cannot disagree on a layout, and a line with a missing, extra
+// or unparsable field is rejected as a whole. Field types are string, bool
+// ("1" or "0"), the integer types and double. Strings must not contain '|'
+// or a newline; nothing is escaped.
+//
+// Neither direction allocates beyond the caller's string: encode() appends
+// into a buffer that can be reused, and decode() parses numbers in place
+// with from_chars.
+//
+// Bump PROTOCOL_VERSION whenever a layout changes. HELLO carries it, and
+// the lobby turns away clients built against another version.
+const int PROTOCOL_VERSION = 4;
+
+template <typename Message, typename T>
+struct Field {
+    const char* name;
+    T Message::*member;
+};
+
+template <typename Message, typename T>
+constexpr Field<Message, T> field(const char* name, T Message::*member) {
+    return {name, member};
+}
+
+// Client -> lobby: the first line on a new connection, unless it is a RESUME
+struct HelloMessage {
+    static constexpr const char* TAG = "HELLO";
+    string role;  // "Mechanical" or "Electrical"
+    int version = PROTOCOL_VERSION;
+
+    static constexpr auto fields() {
+        return make_tuple(field("role", &HelloMessage::role), field("version", &HelloMessage::version));
+    }
+};
+
+// Client -> lobby: take a seat back after a dropped connection
+struct ResumeMessage {
+    static constexpr const char* TAG = "RESUME";
+    string token;  // from WELCOME
+
+    static constexpr auto fields() { return make_tuple(field("token", &ResumeMessage::token)); }
+};
+
+// Lobby -> client: WAITING, BAD_HELLO, BAD_VERSION, DRAINING, TIMEOUT or
+// RESUME_FAILED
+struct LobbyMessage {
+    static constexpr const char* TAG = "LOBBY";
+    string status;
+
+    static constexpr auto fields() { return make_tuple(field("status", &LobbyMessage::status)); }
+};
+
+// Session -> client, once seated
+struct WelcomeMessage {
+    static constexpr const char* TAG = "WELCOME";
+    string token;  // for RESUME
+
+    static constexpr auto fields() { return make_tuple(field("token", &WelcomeMessage::token)); }
+};
+
+// Client -> session: the player clicked start
+struct ReadyMessage {
+    static constexpr const char* TAG = "READY";
+
+    static constexpr auto fields() { return make_tuple(); }
+};
+
+// Mechanical station -> session, on every control change. The session
+// passes the station's controls on to the other client in the same layout.
+struct MechanicalInputMessage {
+    static constexpr const char* TAG = "MECH";
+    string gear;       // "Clockwise", "Counterclockwise", "Stopped"
+    string lever;      // "Up", "Middle", "Down"
+    string valve;      // "Open", "Partial", "Closed"
+    int dial = 5;      // 0 to 10
+    uint32_t seq = 0;  // counts up per input; STATE echoes the last one applied
+
+    static constexpr auto fields() {
+        return make_tuple(field("gear", &MechanicalInputMessage::gear), field("lever", &MechanicalInputMessage::lever),
+                          field("valve", &MechanicalInputMessage::valve), field("dial", &MechanicalInputMessage::dial),
+                          field("seq", &MechanicalInputMessage::seq));
+    }
+};
+
+// Electrical station -> session, on every control change; passed on like MECH
+struct ElectricalInputMessage {
+    static constexpr const char* TAG = "ELEC";
+    string switchA;    // "On", "Off"
+    string button;     // "Idle", "Pressed"
+    uint32_t seq = 0;  // as in MECH
+
+    static constexpr auto fields() {
+        return make_tuple(field("switchA", &ElectricalInputMessage::switchA),
+                          field("button", &ElectricalInputMessage::button),
+                          field("seq", &ElectricalInputMessage::seq));
+    }
+};
+
+// Client -> session: the answer to the play-again prompt
+struct PlayAgainMessage {
+    static constexpr const char* TAG = "PLAY_AGAIN";
+    bool wantsReplay = false;
+
+    static constexpr auto fields() { return make_tuple(field("wantsReplay", &PlayAgainMessage::wantsReplay)); }
+};
+
+// Session -> clients: the whole game state, after every change and tick
+struct StateMessage {
+    static constexpr const char* TAG = "STATE";
+    double pressure = 100.0;
+    double temperature = 200.0;
+    double targetPressure = 150.0;
+    double targetTemperature = 300.0;
+    int timeLeft = 60;
+    bool gameActive = false;
+    bool gameWon = false;
+    bool gameFailed = false;
+    bool mechanicalWantsReplay = false;
+    bool electricalWantsReplay = false;
+    int64_t serverTime = 0;      // server clock when sent (see clock_sync.h)
+    uint32_t mechanicalSeq = 0;  // seq of the last MECH / ELEC the state includes
+    uint32_t electricalSeq = 0;
+
+    static constexpr auto fields() {
+        return make_tuple(field("pressure", &StateMessage::pressure),
+                          field("temperature", &StateMessage::temperature),
+                          field("targetPressure", &StateMessage::targetPressure),
+                          field("targetTemperature", &StateMessage::targetTemperature),
+                          field("timeLeft", &StateMessage::timeLeft),
+                          field("gameActive", &StateMessage::gameActive),
+                          field("gameWon", &StateMessage::gameWon),
+                          field("gameFailed", &StateMessage::gameFailed),
+                          field("mechanicalWantsReplay", &StateMessage::mechanicalWantsReplay),
+                          field("electricalWantsReplay", &StateMessage::electricalWantsReplay),
+                          field("serverTime", &StateMessage::serverTime),
+                          field("mechanicalSeq", &StateMessage::mechanicalSeq),
+                          field("electricalSeq", &StateMessage::electricalSeq));
+    }
+};
+
+// Lockstep mode only (see lockstep.h). Session -> clients: the STATE, MECH
+// and ELEC lines that follow are the match as of step <tick>
+struct LockstepMessage {
+    static constexpr const char* TAG = "LOCKSTEP";
+    uint32_t tick = 0;
+
+    static constexpr auto fields() { return make_tuple(field("tick", &LockstepMessage::tick)); }
+};
+
+// Session -> clients, every tick in place of a STATE: run step <tick> with
+// the controls last received
+struct StepMessage {
+    static constexpr const char* TAG = "STEP";
+    uint32_t tick = 0;
+    int64_t serverTime = 0;  // as in STATE
+
+    static constexpr auto fields() {
+        return make_tuple(field("tick", &StepMessage::tick), field("serverTime", &StepMessage::serverTime));
+    }
+};
+
+// Session -> clients, every HASH_INTERVAL steps: the session's
+// LockstepSim::hash() after step <tick>
+struct StateHashMessage {
+    static constexpr const char* TAG = "STATE_HASH";
+    uint32_t tick = 0;
+    uint64_t hash = 0;
+
+    static constexpr auto fields() {
+        return make_tuple(field("tick", &StateHashMessage::tick), field("hash", &StateHashMessage::hash));
+    }
+};
+
+// Client -> session: our hash after step <tick> differs, seed us again
+struct DesyncMessage {
+    static constexpr const char* TAG = "DESYNC";
+    uint32_t tick = 0;
+
+    static constexpr auto fields() { return make_tuple(field("tick", &DesyncMessage::tick)); }
+};
+
+// Either direction; see clock_sync.h for the exchange
+struct PingMessage {
+    static constexpr const char* TAG = "PING";
+    int64_t sent = 0;  // t1
+
+    static constexpr auto fields() { return make_tuple(field("sent", &PingMessage::sent)); }
+};
+
+struct PongMessage {
+    static constexpr const char* TAG = "PONG";
+    int64_t sent = 0;      // t1, copied from the PING
+    int64_t received = 0;  // t2
+    int64_t replied = 0;   // t3
+
+    static constexpr auto fields() {
+        return make_tuple(field("sent", &PongMessage::sent), field("received", &PongMessage::received),
+                          field("replied", &PongMessage::replied));
+    }
+};
+
+template <typename Message>
+constexpr size_t fieldCount() {
+    return tuple_size<decltype(Message::fields())>::value;
+}
+
+template <typename Message>
+constexpr size_t tagLength() {
+    return char_traits<char>::length(Message::TAG);
+}
+
+// Encoding, one overload per field type
+
+inline void appendField(string& out, const string& value) {
+    out += '|';
+    out += value;
+}
+
+inline void appendField(string& out, bool value) {
+    out += value ? "|1" : "|0";
+}
+
+template <typename T>
+typename enable_if<is_integral<T>::value>::type appendField(string& out, T value) {
+    char digits[24];
+    out += '|';
+    out.append(digits, to_chars(digits, digits + sizeof(digits), value).ptr);
+}
+
+// Shortest text that reads back as the same double
+inline void appendField(string& out, double value) {
+    char digits[32];
+    out += '|';
+    out.append(digits, to_chars(digits, digits + sizeof(digits), value).ptr);
+}
+
+// Decoding, one overload per field type; false if text is not a valid value
+
+inline bool parseField(string_view text, string& value) {
+    value.assign(text.data(), text.size());
+    return true;
+}
+
+inline bool parseField(string_view text, bool& value) {
+    if (text != "1" && text != "0") return false;
+    value = text == "1";
+    return true;
+}
+
+template <typename T>
+typename enable_if<is_arithmetic<T>::value && !is_same<T, bool>::value, bool>::type parseField(string_view text,
+                                                                                             T& value) {
+    const char* end = text.data() + text.size();
+    from_chars_result result = from_chars(text.data(), end, value);
+    return result.ec == errc() && result.ptr == end;
+}
+
+// Consumes "|<field>" from the front of rest
+template <typename T>
+bool nextField(string_view& rest, T& value) {
+    if (rest.empty() || rest[0] != '|') return false;
+    rest.remove_prefix(1);
+    string_view text = rest.substr(0, rest.find('|'));
+    rest.remove_prefix(text.size());
+    return parseField(text, value);
+}
+
+// Whether line is a Message, well-formed or not
+template <typename Message>
+bool hasTag(string_view line) {
+    constexpr size_t length = tagLength<Message>();
+    return line.compare(0, length, Message::TAG) == 0 && (line.size() == length || line[length] == '|');
+}
+
+// Replaces out with the line for message
+template <typename Message>
+void encode(const Message& message, string& out) {
+    out.assign(Message::TAG, tagLength<Message>());
+    apply([&](auto... schema) { (appendField(out, message.*(schema.member)), ...); }, Message::fields());
+}
+
+template <typename Message>
+string encode(const Message& message) {
+    string out;
+    encode(message, out);
+    return out;
+}
+
+// False unless line is a Message with exactly its fields, all valid. On
+// false, out may be partly overwritten.
+template <typename Message>
+bool decode(string_view line, Message& out) {
+    if (!hasTag<Message>(line)) return false;
+    string_view rest = line.substr(tagLength<Message>());
+    bool valid = true;
+    apply([&](auto... schema) { ((valid = valid && nextField(rest, out.*(schema.member))), ...); },
+          Message::fields());
+    return valid && rest.empty();
+}
+
+// "MECH|gear|lever|valve|dial", for log messages about bad lines
+template <typename Message>
+string layout() {
+    string text = Message::TAG;
+    apply([&](auto... schema) { ((text += '|', text += schema.name), ...); }, Message::fields());
+    return text;
+}
+
+#endif // PROTOCOL_H
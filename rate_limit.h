@@ -0,0 +1,95 @@
+#ifndef RATE_LIMIT_H
+#define RATE_LIMIT_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+using namespace std;
+
+// Messages per second a connection may send of one kind, and how many it
+// may send at once after being quiet
+struct RateLimit {
+    double perSecond;
+    double burst;
+};
+
+// Inputs are only sent on a control change; dragging the dial is the
+// busiest a real station gets
+const RateLimit INPUT_LIMIT = {30, 60};
+// READY and PLAY_AGAIN: a handful per match
+const RateLimit CONTROL_LIMIT = {2, 5};
+// PINGs and PONGs, both ways at FACTORY_PING_MS down to 100 ms
+const RateLimit TIMING_LIMIT = {20, 40};
+// Anything else is ignored by the server anyway
+const RateLimit OTHER_LIMIT = {2, 5};
+// Messages over their limit a connection gets away with before it is cut
+// off; a client that overshoots now and then never gets close
+const RateLimit STRIKE_LIMIT = {10, 100};
+
+class TokenBucket {
+public:
+    typedef chrono::steady_clock Clock;
+
+    explicit TokenBucket(RateLimit limit)
+        : perSecond(limit.perSecond), capacity(limit.burst), tokens(limit.burst), refilled(Clock::now()) {}
+
+    // Takes a token if one is left
+    bool take(Clock::time_point now) {
+        double elapsed = chrono::duration<double>(now - refilled).count();
+        if (elapsed > 0) {
+            tokens = min(capacity, tokens + elapsed * perSecond);
+            refilled = now;
+        }
+        if (tokens < 1) return false;
+        tokens -= 1;
+        return true;
+    }
+
+private:
+    double perSecond;
+    double capacity;
+    double tokens;
+    Clock::time_point refilled;
+};
+
+// Flood control for one connection: a bucket per kind of message, checked
+// on the tag alone before the line is parsed or any lock is taken. What the
+// caller does with a message over its limit depends on the kind (Session
+// merges inputs and drops the rest); each one also costs a strike, and a
+// connection out of strikes is to be disconnected.
+//
+// A Session keeps its player's guard across RESUMEs, so the read task of a
+// replaced connection may still be finishing while the new one starts:
+// admit() takes a lock of its own, which is otherwise never contended. The
+// counters may be read from anywhere.
+class FloodGuard {
+public:
+    enum Kind { INPUT, CONTROL, TIMING, OTHER, KINDS };
+    enum Verdict { ACCEPT, OVER_LIMIT, DISCONNECT };
+
+    FloodGuard()
+        : buckets{TokenBucket(INPUT_LIMIT), TokenBucket(CONTROL_LIMIT), TokenBucket(TIMING_LIMIT),
+                  TokenBucket(OTHER_LIMIT)},
+          strikes(STRIKE_LIMIT), overLimit(0) {}
+
+    Verdict admit(Kind kind, TokenBucket::Clock::time_point now) {
+        lock_guard<mutex> lock(bucketsMutex);
+        if (buckets[kind].take(now)) return ACCEPT;
+        overLimit.fetch_add(1, memory_order_relaxed);
+        return strikes.take(now) ? OVER_LIMIT : DISCONNECT;
+    }
+
+    // Messages that went over their limit, since the guard was made
+    uint64_t overLimitCount() const { return overLimit.load(memory_order_relaxed); }
+
+private:
+    mutex bucketsMutex;
+    TokenBucket buckets[KINDS];
+    TokenBucket strikes;
+    atomic<uint64_t> overLimit;
+};
+
+#endif // RATE_LIMIT_H
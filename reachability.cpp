@@ -0,0 +1,406 @@
+// Offline analyzer for a scenario (start state, targets, time limit).
+//
+//   reachability [--target P T] [--start P T] [--time N] [--threads N]
+//                [--no-button] [--sweep STEP]
+//
+// Each tick the players may set any combination of controls, so a tick moves
+// the machine by one of the distinct controlRates() of physics.h, or the
+// button puts it back to the safe values. Every such rate is a multiple of
+// 1/8 with the default coefficients, so (pressure, temperature) lives on a
+// finite grid between the failure bounds and the game can be searched
+// exhaustively:
+//
+//   - forward, level by level from the start state (one level per tick), for
+//     the earliest tick each state can be reached and the par time;
+//   - backward from the target region, for the fewest ticks from every state
+//     to a win.
+//
+// A position in the game is a state plus the ticks left. Stopping the gear is
+// always a zero move, so a state first reached at tick d can be held until
+// any later tick: its positions are every tick from d to the time limit. A
+// position with fewer ticks left than the state's distance to a win is
+// doomed: whatever the players do, it ends in failure or a timeout.
+//
+// Both searches expand each level on all cores and share one atomic bitset
+// as the visited set. --sweep prints the par time for a grid of targets, for
+// picking difficulty.
+//
+// Note that the server starts its first match with timeLeft = 600, while
+// a replay (Session::resetGameLocked()) gets 60; the default --time is 60.
+#include "physics.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+static const uint16_t UNREACHED = 0xFFFF;
+
+// Visited set shared by all search threads; testAndSet() tells exactly one
+// caller that it claimed a state
+class ConcurrentBitset {
+private:
+    unique_ptr<atomic<uint64_t>[]> words;
+
+public:
+    explicit ConcurrentBitset(size_t bits) : words(new atomic<uint64_t>[(bits + 63) / 64]()) {}
+
+    bool testAndSet(size_t index) {
+        uint64_t bit = 1ull << (index & 63);
+        return words[index >> 6].fetch_or(bit, memory_order_relaxed) & bit;
+    }
+};
+
+struct Move {
+    int pressure;     // grid steps per tick
+    int temperature;
+};
+
+struct Scenario {
+    double startPressure = 100.0;
+    double startTemperature = 200.0;
+    double targetPressure = 150.0;
+    double targetTemperature = 300.0;
+    int timeLimit = 60;
+    bool button = true;
+    PhysicsParams params;
+};
+
+// The discretized state space: grid point (i, j) is
+// (minPressure + i * step, minTemperature + j * step)
+class StateGrid {
+public:
+    double step;
+    int width;    // pressure points
+    int height;   // temperature points
+    vector<Move> moves;
+
+    size_t size() const { return (size_t)width * height; }
+    uint32_t index(int i, int j) const { return (uint32_t)j * width + i; }
+    int column(uint32_t state) const { return state % width; }
+    int row(uint32_t state) const { return state / width; }
+    double pressureAt(uint32_t state) const { return params.minPressure + column(state) * step; }
+    double temperatureAt(uint32_t state) const { return params.minTemperature + row(state) * step; }
+
+    bool inBounds(int i, int j) const { return i >= 0 && i < width && j >= 0 && j < height; }
+
+    // Some setting leaves the machine where it is (a stopped gear does)
+    bool canHold() const {
+        for (const Move& move : moves) {
+            if (move.pressure == 0 && move.temperature == 0) return true;
+        }
+        return false;
+    }
+
+    // Grid point for a real state; false if it is off the grid or out of bounds
+    bool locate(double pressure, double temperature, uint32_t& state) const {
+        double i = (pressure - params.minPressure) / step;
+        double j = (temperature - params.minTemperature) / step;
+        if (!onGrid(i) || !onGrid(j) || !inBounds(lround(i), lround(j))) return false;
+        state = index(lround(i), lround(j));
+        return true;
+    }
+
+    bool onTarget(uint32_t state, double targetPressure, double targetTemperature) const {
+        return machineOnTarget({pressureAt(state), temperatureAt(state)}, targetPressure, targetTemperature, params);
+    }
+
+    bool build(const PhysicsParams& physics) {
+        params = physics;
+
+        vector<pair<double, double>> rates;
+        static const char* gears[] = {"Clockwise", "Counterclockwise", "Stopped"};
+        static const char* levers[] = {"Up", "Middle", "Down"};
+        static const char* valves[] = {"Open", "Partial", "Closed"};
+        static const char* switches[] = {"On", "Off"};
+        for (const char* gear : gears)
+            for (const char* lever : levers)
+                for (const char* valve : valves)
+                    for (int dial = DIAL_MIN; dial <= DIAL_MAX; dial++)
+                        for (const char* switchA : switches)
+                            rates.push_back(controlRates({gear, lever, valve, dial}, {switchA, "Idle"}, params));
+
+        // Coarsest power-of-two step every rate is a whole multiple of
+        for (step = 1.0; step >= 1.0 / 1024; step /= 2) {
+            bool fits = true;
+            for (const pair<double, double>& rate : rates) {
+                if (!onGrid(rate.first / step) || !onGrid(rate.second / step)) {
+                    fits = false;
+                    break;
+                }
+            }
+            if (fits) break;
+        }
+        if (step < 1.0 / 1024) {
+            cout << "Error: control rates do not fit a grid of 1/1024\n";
+            return false;
+        }
+
+        width = (int)floor((params.maxPressure - params.minPressure) / step + 1e-9) + 1;
+        height = (int)floor((params.maxTemperature - params.minTemperature) / step + 1e-9) + 1;
+
+        for (const pair<double, double>& rate : rates) {
+            Move move = {(int)lround(rate.first / step), (int)lround(rate.second / step)};
+            bool seen = false;
+            for (const Move& other : moves) {
+                if (other.pressure == move.pressure && other.temperature == move.temperature) seen = true;
+            }
+            if (!seen) moves.push_back(move);
+        }
+        return true;
+    }
+
+private:
+    PhysicsParams params;
+
+    static bool onGrid(double value) { return fabs(value - nearbyint(value)) < 1e-9; }
+};
+
+// Level-synchronous breadth-first search. Every frontier state must already
+// be claimed in visited with its depth set; expand(state, emit) calls
+// emit(next) for each neighbour. Levels stop after maxDepth.
+template <typename Expand>
+static void parallelBfs(vector<uint32_t> frontier, int firstDepth, int maxDepth, ConcurrentBitset& visited,
+                        vector<uint16_t>& depth, int threadCount, Expand expand) {
+    const size_t CHUNK = 4096;
+
+    for (int level = firstDepth; level < maxDepth && !frontier.empty(); level++) {
+        vector<vector<uint32_t>> next(threadCount);
+        atomic<size_t> cursor(0);
+
+        auto worker = [&](int id) {
+            vector<uint32_t>& found = next[id];
+            auto emit = [&](uint32_t state) {
+                // The claiming thread is the only writer of depth[state]
+                if (!visited.testAndSet(state)) {
+                    depth[state] = level + 1;
+                    found.push_back(state);
+                }
+            };
+            for (size_t begin; (begin = cursor.fetch_add(CHUNK)) < frontier.size();) {
+                size_t end = min(begin + CHUNK, frontier.size());
+                for (size_t k = begin; k < end; k++) expand(frontier[k], emit);
+            }
+        };
+
+        vector<thread> workers;
+        for (int id = 1; id < threadCount; id++) workers.emplace_back(worker, id);
+        worker(0);
+        for (thread& t : workers) t.join();
+
+        frontier.clear();
+        for (vector<uint32_t>& found : next) frontier.insert(frontier.end(), found.begin(), found.end());
+    }
+}
+
+// Earliest tick (>= 1) at which each state can be the machine's state after
+// that tick. Win states are terminal only when stopAtTarget is set.
+static vector<uint16_t> forwardSearch(const StateGrid& grid, const Scenario& scenario, uint32_t start,
+                                      uint32_t safe, bool safeValid, bool stopAtTarget, int threads) {
+    vector<uint16_t> depth(grid.size(), UNREACHED);
+    ConcurrentBitset visited(grid.size());
+
+    // The start is not judged until the first tick, so seed with its
+    // successors; that way a move back onto the start is recorded too
+    vector<uint32_t> frontier;
+    auto claim = [&](uint32_t state) {
+        if (!visited.testAndSet(state)) {
+            depth[state] = 1;
+            frontier.push_back(state);
+        }
+    };
+
+    auto expand = [&](uint32_t state, auto& emit) {
+        int i = grid.column(state), j = grid.row(state);
+        for (const Move& move : grid.moves) {
+            if (grid.inBounds(i + move.pressure, j + move.temperature)) emit(grid.index(i + move.pressure, j + move.temperature));
+        }
+        if (scenario.button && safeValid) emit(safe);
+    };
+
+    expand(start, claim);
+
+    parallelBfs(frontier, 1, scenario.timeLimit, visited, depth, threads, [&](uint32_t state, auto& emit) {
+        if (stopAtTarget && grid.onTarget(state, scenario.targetPressure, scenario.targetTemperature)) return;
+        expand(state, emit);
+    });
+    return depth;
+}
+
+// Fewest ticks from each state to a win (0 for target states themselves)
+static vector<uint16_t> backwardSearch(const StateGrid& grid, const Scenario& scenario, uint32_t safe,
+                                       bool safeValid, int threads) {
+    vector<uint16_t> distance(grid.size(), UNREACHED);
+    ConcurrentBitset visited(grid.size());
+
+    vector<uint32_t> frontier;
+    for (uint32_t state = 0; state < grid.size(); state++) {
+        if (grid.onTarget(state, scenario.targetPressure, scenario.targetTemperature)) {
+            visited.testAndSet(state);
+            distance[state] = 0;
+            frontier.push_back(state);
+        }
+    }
+
+    // Predecessors through the control rates. The target states are the
+    // seeds at distance 0, so no path is counted through one: reaching it
+    // already won
+    parallelBfs(frontier, 0, UNREACHED - 1, visited, distance, threads, [&](uint32_t state, auto& emit) {
+        int i = grid.column(state), j = grid.row(state);
+        for (const Move& move : grid.moves) {
+            if (grid.inBounds(i - move.pressure, j - move.temperature)) emit(grid.index(i - move.pressure, j - move.temperature));
+        }
+    });
+
+    // The button reaches the safe values from anywhere in one tick, so the
+    // best line that uses it presses it first
+    if (scenario.button && safeValid && distance[safe] != UNREACHED) {
+        uint16_t viaButton = distance[safe] == 0 ? 1 : distance[safe] + 1;
+        for (uint16_t& d : distance) d = min(d, viaButton);
+    }
+    return distance;
+}
+
+static void sweepTargets(const StateGrid& grid, const Scenario& scenario, const vector<uint16_t>& depth, double spacing) {
+    const PhysicsParams& params = scenario.params;
+
+    cout << "Par ticks by target (rows: temperature, columns: pressure, - = not winnable in "
+         << scenario.timeLimit << ")\n";
+    cout << setw(8) << "T \\ P";
+    for (double p = params.minPressure; p <= params.maxPressure + 1e-9; p += spacing) cout << setw(6) << p;
+    cout << "\n";
+
+    for (double t = params.minTemperature; t <= params.maxTemperature + 1e-9; t += spacing) {
+        cout << setw(8) << t;
+        for (double p = params.minPressure; p <= params.maxPressure + 1e-9; p += spacing) {
+            uint16_t best = UNREACHED;
+            for (uint32_t state = 0; state < grid.size(); state++) {
+                if (depth[state] < best && grid.onTarget(state, p, t)) best = depth[state];
+            }
+            if (best == UNREACHED) cout << setw(6) << "-";
+            else cout << setw(6) << best;
+        }
+        cout << "\n";
+    }
+}
+
+static void usage(const char* program) {
+    cout << "Usage: " << program << " [--target P T] [--start P T] [--time N] [--threads N]\n"
+         << "       " << string(strlen(program), ' ') << " [--no-button] [--sweep STEP]\n";
+}
+
+int main(int argc, char* argv[]) {
+    Scenario scenario;
+    int threads = max(1u, thread::hardware_concurrency());
+    double sweep = 0.0;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--target" && i + 2 < argc) {
+            scenario.targetPressure = atof(argv[++i]);
+            scenario.targetTemperature = atof(argv[++i]);
+        } else if (arg == "--start" && i + 2 < argc) {
+            scenario.startPressure = atof(argv[++i]);
+            scenario.startTemperature = atof(argv[++i]);
+        } else if (arg == "--time" && i + 1 < argc) {
+            scenario.timeLimit = atoi(argv[++i]);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = max(1, atoi(argv[++i]));
+        } else if (arg == "--no-button") {
+            scenario.button = false;
+        } else if (arg == "--sweep" && i + 1 < argc) {
+            sweep = atof(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (scenario.timeLimit < 1 || scenario.timeLimit >= UNREACHED) {
+        cout << "Error: --time must be between 1 and " << UNREACHED - 1 << "\n";
+        return 1;
+    }
+
+    StateGrid grid;
+    if (!grid.build(scenario.params)) return 1;
+    if (!grid.canHold()) {
+        cout << "Error: no control setting holds the machine still\n";
+        return 1;
+    }
+
+    uint32_t start, safe;
+    if (!grid.locate(scenario.startPressure, scenario.startTemperature, start)) {
+        cout << "Error: start state is outside the bounds or off the " << grid.step << " grid\n";
+        return 1;
+    }
+    bool safeValid = grid.locate(scenario.params.safePressure, scenario.params.safeTemperature, safe);
+
+    cout << "Grid: " << grid.width << " x " << grid.height << " states, step " << grid.step << ", "
+         << grid.moves.size() << " distinct control rates" << (scenario.button ? " + button" : "") << ", "
+         << threads << " threads\n";
+
+    auto began = chrono::steady_clock::now();
+
+    if (sweep > 0.0) {
+        vector<uint16_t> depth = forwardSearch(grid, scenario, start, safe, safeValid, false, threads);
+        sweepTargets(grid, scenario, depth, sweep);
+    } else {
+        vector<uint16_t> depth = forwardSearch(grid, scenario, start, safe, safeValid, true, threads);
+        vector<uint16_t> distance = backwardSearch(grid, scenario, safe, safeValid, threads);
+
+        uint16_t par = UNREACHED;
+        size_t reachable = 0, positions = 0, doomed = 0, risky = 0;
+        for (uint32_t state = 0; state < grid.size(); state++) {
+            if (depth[state] == UNREACHED) continue;
+            if (grid.onTarget(state, scenario.targetPressure, scenario.targetTemperature)) {
+                par = min(par, depth[state]);
+                continue;
+            }
+            if (depth[state] >= scenario.timeLimit) continue;  // time is already up here
+
+            // Held from its first tick to the last one with time left; doomed
+            // from the tick where the win no longer fits
+            int first = depth[state];
+            int lastWinnable = distance[state] == UNREACHED ? first - 1 : scenario.timeLimit - distance[state];
+            int ticks = scenario.timeLimit - first;
+            reachable++;
+            positions += ticks;
+            doomed += ticks - max(0, min(lastWinnable, scenario.timeLimit - 1) - first + 1);
+
+            int i = grid.column(state), j = grid.row(state);
+            for (const Move& move : grid.moves) {
+                if (!grid.inBounds(i + move.pressure, j + move.temperature)) {
+                    risky += ticks;
+                    break;
+                }
+            }
+        }
+
+        cout << "Scenario: start (" << scenario.startPressure << ", " << scenario.startTemperature << "), target ("
+             << scenario.targetPressure << ", " << scenario.targetTemperature << ") +/- "
+             << scenario.params.targetTolerance << ", " << scenario.timeLimit << " ticks\n";
+        if (par == UNREACHED) cout << "Not winnable within " << scenario.timeLimit << " ticks\n";
+        else cout << "Par: " << par << " ticks\n";
+
+        cout << fixed << setprecision(2);
+        cout << "Reachable in-play states: " << reachable << ", " << positions << " with the ticks left\n";
+        if (positions > 0) {
+            cout << "Doomed (no win possible in the time left): " << doomed << " ("
+                 << 100.0 * doomed / positions << "%)\n";
+            cout << "One wrong setting from failure: " << risky << " (" << 100.0 * risky / positions << "%)\n";
+        }
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - began).count();
+    cout << "Search took " << setprecision(3) << seconds << " s\n";
+    return 0;
+}
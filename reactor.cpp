@@ -0,0 +1,182 @@
+#include "reactor.h"
+#include "log.h"
+#include "uring_reactor.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+using namespace std;
+
+unique_ptr<Reactor> Reactor::create(Executor& executor) {
+    const char* setting = getenv("FACTORY_IO");
+    if (!setting || strcmp(setting, "epoll") != 0) {
+        unique_ptr<UringReactor> uring(new UringReactor(executor));
+        if (uring->valid()) return uring;
+        LOG(LogLevel::Info) << "io_uring unavailable (" << uring->unavailableReason() << "), using epoll";
+    }
+
+    unique_ptr<EpollReactor> epoll(new EpollReactor(executor));
+    if (!epoll->valid()) return nullptr;
+    return epoll;
+}
+
+// ---------------------------------------------------------------------------
+// Timers, shared by both backends
+
+Reactor::TimerId Reactor::runAfter(chrono::milliseconds delay, Task task) {
+    TimerId id;
+    bool earlier;
+    {
+        lock_guard<mutex> lock(timerMutex);
+        // Rounded up a tick, so a timer never fires early
+        uint64_t due = tickAt(Clock::now()) + max<int64_t>(delay.count(), 0) + 1;
+        id = timers.schedule(due, move(task));
+        earlier = due < plannedWake;
+        if (earlier) plannedWake = due;
+    }
+    // The I/O thread may be sleeping toward a later deadline
+    if (earlier) wake();
+    return id;
+}
+
+bool Reactor::cancel(TimerId id) {
+    lock_guard<mutex> lock(timerMutex);
+    return timers.cancel(id);
+}
+
+void Reactor::stop() {
+    stopping.store(true);
+    wake();
+}
+
+uint64_t Reactor::tickAt(Clock::time_point time) const {
+    return chrono::duration_cast<chrono::milliseconds>(time - epoch).count();
+}
+
+int Reactor::msUntilNextTimer() {
+    lock_guard<mutex> lock(timerMutex);
+    int64_t ticks = timers.ticksUntilNext();
+    if (ticks < 0) {
+        plannedWake = UINT64_MAX;
+        return -1;
+    }
+    plannedWake = timers.currentTick() + ticks;
+    int64_t now = tickAt(Clock::now());
+    return plannedWake <= uint64_t(now) ? 0 : int(min<uint64_t>(plannedWake - now, INT32_MAX));
+}
+
+void Reactor::fireDueTimers() {
+    // Only run() calls this, so the batch needs no lock of its own
+    {
+        lock_guard<mutex> lock(timerMutex);
+        timers.advance(tickAt(Clock::now()), dueTimers);
+    }
+    for (Task& task : dueTimers) executor.submit(move(task));
+    dueTimers.clear();
+}
+
+// ---------------------------------------------------------------------------
+// epoll
+
+// epoll data for the reactor's own wakeup eventfd; watch ids start at 1
+const Reactor::WatchId WAKE_ID = 0;
+const int MAX_EVENTS = 256;
+
+EpollReactor::EpollReactor(Executor& pool) : Reactor(pool), epollFd(-1), wakeFd(-1), nextWatch(1) {
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd < 0 || wakeFd < 0) {
+        perror("reactor setup failed");
+        return;
+    }
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.u64 = WAKE_ID;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event) < 0) {
+        perror("epoll_ctl wakeup failed");
+    }
+}
+
+EpollReactor::~EpollReactor() {
+    if (wakeFd != -1) close(wakeFd);
+    if (epollFd != -1) close(epollFd);
+}
+
+Reactor::WatchId EpollReactor::watch(int fd, Task onReady) {
+    lock_guard<mutex> lock(watchMutex);
+    WatchId id = nextWatch++;
+
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.u64 = id;
+    if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+        perror("epoll_ctl add failed");
+        return 0;
+    }
+    watches[id] = {fd, move(onReady)};
+    return id;
+}
+
+void EpollReactor::rearm(WatchId id) {
+    lock_guard<mutex> lock(watchMutex);
+    auto found = watches.find(id);
+    if (found == watches.end()) return;  // unwatched meanwhile
+
+    epoll_event event = {};
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.u64 = id;
+    if (epoll_ctl(epollFd, EPOLL_CTL_MOD, found->second.fd, &event) < 0) {
+        perror("epoll_ctl rearm failed");
+    }
+}
+
+void EpollReactor::unwatch(WatchId id) {
+    lock_guard<mutex> lock(watchMutex);
+    auto found = watches.find(id);
+    if (found == watches.end()) return;
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, found->second.fd, nullptr);
+    watches.erase(found);
+}
+
+void EpollReactor::wake() {
+    uint64_t one = 1;
+    ssize_t written = write(wakeFd, &one, sizeof(one));
+    (void)written;
+}
+
+void EpollReactor::run() {
+    epoll_event events[MAX_EVENTS];
+    while (!stopping.load()) {
+        int count = epoll_wait(epollFd, events, MAX_EVENTS, msUntilNextTimer());
+        if (count < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait failed");
+            return;
+        }
+
+        for (int i = 0; i < count; i++) {
+            WatchId id = events[i].data.u64;
+            if (id == WAKE_ID) {
+                uint64_t counter;
+                ssize_t drained = read(wakeFd, &counter, sizeof(counter));
+                (void)drained;
+                continue;
+            }
+
+            Task task;
+            {
+                lock_guard<mutex> lock(watchMutex);
+                auto found = watches.find(id);
+                if (found == watches.end()) continue;
+                task = found->second.onReady;
+            }
+            executor.submit(move(task));
+        }
+
+        fireDueTimers();
+    }
+}
@@ -0,0 +1,133 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "executor.h"
+#include "timer_wheel.h"
+#include "transport.h"
+
+using namespace std;
+
+// Single I/O thread that turns readiness and deadlines into tasks on an
+// Executor. Nothing runs on the I/O thread itself, so a slow handler never
+// delays other connections' wakeups.
+//
+// Watches are one-shot: after a watch fires, its callback must call rearm()
+// once it has drained its connection (or unwatch() when it is done). At
+// most one callback per watch is therefore ever in flight.
+//
+// Two backends implement it: epoll, and io_uring where the kernel supports
+// it (see create()).
+class Reactor {
+public:
+    typedef uint64_t WatchId;
+    typedef TimerWheel::Id TimerId;  // never 0
+    typedef Executor::Task Task;
+
+    // io_uring when the kernel has everything it needs, epoll otherwise;
+    // FACTORY_IO=epoll forces epoll
+    static unique_ptr<Reactor> create(Executor& executor);
+
+    virtual ~Reactor() {}
+
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    virtual const char* backendName() const = 0;
+
+    // Transport for a freshly accepted TCP connection
+    virtual unique_ptr<Transport> adoptConnection(int fd) { return acceptTransport(fd); }
+    // Transport for a connection another process handed over; null if it
+    // cannot be restored
+    virtual unique_ptr<Transport> restoreConnection(DetachedTransport& detached) { return restoreTransport(detached); }
+
+    // Runs onReady on the executor whenever fd turns readable; 0 on failure
+    virtual WatchId watch(int fd, Task onReady) = 0;
+    // Same for a connection; the transport must outlive the watch
+    virtual WatchId watchTransport(Transport& transport, Task onReady) {
+        transport.watchReadiness();
+        return watch(transport.readinessFd(), move(onReady));
+    }
+    virtual void rearm(WatchId id) = 0;
+    // Stops watching; the fd must still be open
+    virtual void unwatch(WatchId id) = 0;
+
+    // Runs task on the executor once delay has passed. Timers have
+    // millisecond resolution and live in a timing wheel, so scheduling and
+    // cancelling are O(1) however many are pending.
+    TimerId runAfter(chrono::milliseconds delay, Task task);
+    // False if the timer already fired (its task may be running or queued)
+    // or was cancelled before
+    bool cancel(TimerId id);
+
+    // Dispatches until stop(); call from one thread only
+    virtual void run() = 0;
+    void stop();
+
+protected:
+    typedef chrono::steady_clock Clock;
+
+    Executor& executor;
+    atomic<bool> stopping;
+
+    explicit Reactor(Executor& pool)
+        : executor(pool), stopping(false), epoch(Clock::now()), plannedWake(UINT64_MAX) {}
+
+    // Interrupts a sleeping run() from another thread
+    virtual void wake() = 0;
+
+    // For run(): sleep budget until the next deadline (-1 = none), and
+    // handing every due timer to the executor
+    int msUntilNextTimer();
+    void fireDueTimers();
+
+private:
+    mutex timerMutex;
+    TimerWheel timers;          // ticks are milliseconds since epoch
+    vector<Task> dueTimers;     // fireDueTimers() batch, kept for its capacity
+    Clock::time_point epoch;
+    uint64_t plannedWake;       // tick run() sleeps toward; UINT64_MAX = none
+
+    uint64_t tickAt(Clock::time_point time) const;
+};
+
+// Readiness through epoll; every connection does its own recv/send calls
+class EpollReactor : public Reactor {
+public:
+    explicit EpollReactor(Executor& executor);
+    ~EpollReactor() override;
+
+    // False if epoll could not be set up
+    bool valid() const { return epollFd != -1 && wakeFd != -1; }
+
+    const char* backendName() const override { return "epoll"; }
+    WatchId watch(int fd, Task onReady) override;
+    void rearm(WatchId id) override;
+    void unwatch(WatchId id) override;
+    void run() override;
+
+protected:
+    void wake() override;
+
+private:
+    struct Watch {
+        int fd;
+        Task onReady;
+    };
+
+    int epollFd;
+    int wakeFd;
+
+    mutex watchMutex;
+    map<WatchId, Watch> watches;
+    WatchId nextWatch;
+};
+
+#endif // REACTOR_H
@@ -0,0 +1,53 @@
+#ifndef SCRATCH_H
+#define SCRATCH_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Per-thread scratch strings for reading and formatting lines. Each keeps
+// the capacity it has grown to, so once a worker has warmed up, the tasks
+// it runs receive and encode messages without touching the heap:
+//
+//   ScratchLine line;  // borrowed until the end of the scope
+//   encode(PingMessage{monotonicMicros()}, *line);
+//
+// Borrows nest (a handler may borrow while its caller holds one) and end in
+// reverse order, which leaves the pool reset for the next task. A line must
+// not outlive its scope or move to another thread.
+class ScratchLine {
+public:
+    ScratchLine() : index(depth()++) {
+        vector<unique_ptr<string>>& pool = lines();
+        if (index == pool.size()) pool.emplace_back(new string());
+        line = pool[index].get();
+        line->clear();
+    }
+
+    ~ScratchLine() { depth()--; }
+
+    ScratchLine(const ScratchLine&) = delete;
+    ScratchLine& operator=(const ScratchLine&) = delete;
+
+    string& operator*() const { return *line; }
+    string* operator->() const { return line; }
+
+private:
+    size_t index;
+    string* line;
+
+    // Boxed, so growing the pool never moves a line someone is holding
+    static vector<unique_ptr<string>>& lines() {
+        static thread_local vector<unique_ptr<string>> pool;
+        return pool;
+    }
+
+    static size_t& depth() {
+        static thread_local size_t borrowed = 0;
+        return borrowed;
+    }
+};
+
+#endif // SCRATCH_H
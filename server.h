@@ -0,0 +1,866 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <sched.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+#include "arena.h"
+#include "executor.h"
+#include "handoff.h"
+#include "heap_stats.h"
+#include "lobby.h"
+#include "log.h"
+#include "profiler.h"
+#include "reactor.h"
+#include "session.h"
+#include "transport.h"
+
+
+using namespace std;
+
+// Accepts players and runs any number of matches at once, spread over
+// shards. A shard is one core's share of the server: a reactor thread
+// (io_uring or epoll) and a worker, both pinned to that core, its own
+// SO_REUSEPORT listening socket on port 8888 (the kernel spreads new
+// connections over the shards), its own match table and an Arena the
+// matches are allocated from. A match stays on the shard it started on.
+//
+// New connections go to the Lobby, shared by all shards, which pairs them
+// by the role they ask for in their HELLO and hands each pair to a new
+// Session. It pairs players accepted on the same shard when it can; a
+// match whose players came in on different shards lives on the less busy
+// of the two, and the other connection is moved over to it (detached from
+// its reactor and restored on the home one), as is a player resuming
+// through another shard. A match is thus served by one shard only: its
+// reads, its ticks and its state lock never leave that core.
+//
+// FACTORY_SHARDS sets the shard count (default: one per CPU we may run
+// on); FACTORY_PIN=0 turns pinning off. A single shard is never pinned.
+// FACTORY_PORT moves the server off port 8888, for running several behind
+// a gateway on one host.
+//
+// drain() (SIGTERM in the server binary) stops new matches and exits once
+// the running ones are over; their players can still resume meanwhile.
+// For a restart that does not wait, handOff() and takeOver() move the
+// listening sockets, the lobby and every running match into a new process
+// without a single connection dropping (see handoff.h).
+class GameServer {
+public:
+    struct ShardStats {
+        int index;
+        int cpu;                  // -1 if not pinned
+        const char* backend;
+        size_t matches;           // running now
+        uint64_t accepted;        // connections, since starting
+        uint64_t matchesStarted;
+        uint64_t crossShardMatches;  // of those, with a player left on another shard
+        uint64_t tasksRun;
+        size_t arenaInUse;        // bytes
+        size_t arenaReserved;
+    };
+
+private:
+    typedef map<Session::Id, shared_ptr<Session>, less<Session::Id>,
+                ArenaAllocator<pair<const Session::Id, shared_ptr<Session>>>> SessionTable;
+
+    struct Shard {
+        int index;
+        int cpu;
+        Arena arena;  // outlives everything below that was allocated from it
+        Executor executor;
+        unique_ptr<Reactor> reactor;  // null if no backend could be set up
+        int listenSocket;
+        Reactor::WatchId listenWatch;
+
+        mutex sessionsMutex;
+        SessionTable sessions;
+
+        atomic<uint64_t> accepted;
+        atomic<uint64_t> matchesStarted;
+        atomic<uint64_t> crossShardMatches;
+
+        Shard(int shardIndex, int shardCpu)
+            : index(shardIndex), cpu(shardCpu), executor(1, "shard " + to_string(shardIndex) + " worker"),
+              reactor(Reactor::create(executor)), listenSocket(-1), listenWatch(0),
+              sessions(SessionTable::allocator_type(arena)), accepted(0), matchesStarted(0), crossShardMatches(0) {
+            if (cpu >= 0) executor.pinTo(cpu);
+        }
+
+        size_t sessionCount() {
+            lock_guard<mutex> lock(sessionsMutex);
+            return sessions.size();
+        }
+    };
+
+    vector<unique_ptr<Shard>> shards;
+    unique_ptr<Lobby> lobby;  // only with listening sockets
+    bool listening;
+    int port;
+    atomic<bool> draining;
+    atomic<bool> handingOff;
+
+    // Signals arrive through one signalfd on the first shard's reactor
+    int signalFd;
+    Reactor::WatchId signalWatch;
+    sigset_t handledSignals;
+    mutex signalMutex;
+    map<int, Reactor::Task> signalHandlers;
+
+    // Which shard has the match for each resume token
+    mutex directoryMutex;
+    unordered_map<string, pair<Shard*, Session::Id>> resumeTokens;
+    atomic<Session::Id> nextSessionId;
+    atomic<size_t> runningMatches;
+
+    // Where the previous statsReport() left off, for its heap line
+    mutex reportMutex;
+    HeapStats reportedHeap;
+    uint64_t reportedTasks;
+
+    static size_t defaultShardCount() {
+        const char* setting = getenv("FACTORY_SHARDS");
+        long count = setting ? atol(setting) : 0;
+        return count > 0 ? count : allowedCpus().size();
+    }
+
+    // The CPUs this process may run on (taskset, cgroups), in order
+    static vector<int> allowedCpus() {
+        vector<int> cpus;
+        cpu_set_t allowed;
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                if (CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+            }
+        }
+        if (cpus.empty()) cpus.push_back(0);
+        return cpus;
+    }
+
+    static int configuredPort() {
+        const char* setting = getenv("FACTORY_PORT");
+        int value = setting ? atoi(setting) : 0;
+        return value > 0 && value < 65536 ? value : 8888;
+    }
+
+    static bool pinningWanted(size_t shardCount) {
+        const char* setting = getenv("FACTORY_PIN");
+        return shardCount > 1 && !(setting && strcmp(setting, "0") == 0);
+    }
+
+    Shard* shardOf(Reactor* reactor) {
+        for (unique_ptr<Shard>& shard : shards) {
+            if (shard->reactor.get() == reactor) return shard.get();
+        }
+        return nullptr;
+    }
+
+    // A listening socket on our port; -1 on failure
+    int openListener(bool reusePort) {
+        int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            perror("socket creation failed");
+            return -1;
+        }
+
+        // Allow socket reuse
+        int opt = 1;
+        if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0 ||
+            (reusePort && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)) {
+            perror("setsockopt failed");
+            close(fd);
+            return -1;
+        }
+
+        sockaddr_in serverAddr;
+        serverAddr.sin_family = AF_INET;
+        serverAddr.sin_addr.s_addr = INADDR_ANY;
+        serverAddr.sin_port = htons(port);
+
+        if (bind(fd, (sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
+            perror("bind failed");
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    void acceptPlayers(Shard& shard) {
+        // The listener belongs to the new process now
+        if (handingOff) return;
+        while (true) {
+            int playerSocket = accept4(shard.listenSocket, NULL, NULL, SOCK_CLOEXEC);
+            if (playerSocket < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept player failed");
+                break;
+            }
+
+            shard.accepted.fetch_add(1, memory_order_relaxed);
+            lobby->admit(shard.reactor->adoptConnection(playerSocket), *shard.reactor);
+        }
+        shard.reactor->rearm(shard.listenWatch);
+    }
+
+    void readSignals() {
+        signalfd_siginfo info;
+        while (read(signalFd, &info, sizeof(info)) == sizeof(info)) {
+            Reactor::Task handler;
+            {
+                lock_guard<mutex> lock(signalMutex);
+                auto found = signalHandlers.find(info.ssi_signo);
+                if (found != signalHandlers.end()) handler = found->second;
+            }
+            if (handler) handler();
+        }
+        shards[0]->reactor->rearm(signalWatch);
+    }
+
+    // Moves a player's connection onto shard's reactor. One that cannot be
+    // detached stays where it is; false if it was lost on the way (a
+    // segment that would not map again), which leaves player.conn null.
+    bool moveToShard(Lobby::Player& player, Shard& shard) {
+        if (!player.reactor || player.reactor == shard.reactor.get()) return true;
+        DetachedTransport detached;
+        if (!player.conn->detach(detached)) return true;
+        player.conn = shard.reactor->restoreConnection(detached);
+        player.reactor = shard.reactor.get();
+        return player.conn != nullptr;
+    }
+
+    void startMatch(Lobby::Player mechanical, Lobby::Player electrical) {
+        // Players without a reactor (attachPlayers) go wherever it is quietest
+        Shard* candidates[2] = {shardOf(mechanical.reactor), shardOf(electrical.reactor)};
+        Shard* home = nullptr;
+        for (unique_ptr<Shard>& shard : shards) {
+            bool candidate = !candidates[0] || shard.get() == candidates[0] || shard.get() == candidates[1];
+            if (candidate && (!home || shard->sessionCount() < home->sessionCount())) home = shard.get();
+        }
+        bool mechanicalMoved = moveToShard(mechanical, *home);
+        bool electricalMoved = moveToShard(electrical, *home);
+        if (!mechanicalMoved || !electricalMoved) {
+            LOG(LogLevel::Warn) << "Lost a connection moving it to shard " << home->index << ", match not started";
+            if (mechanical.conn) mechanical.conn->shutdown();
+            if (electrical.conn) electrical.conn->shutdown();
+            return;
+        }
+        Reactor& mechanicalIo = mechanical.reactor ? *mechanical.reactor : *home->reactor;
+        Reactor& electricalIo = electrical.reactor ? *electrical.reactor : *home->reactor;
+
+        Session::Id id = nextSessionId++;
+        shared_ptr<Session> session = allocate_shared<Session>(
+            ArenaAllocator<Session>(home->arena), id, move(mechanical.conn), mechanicalIo, move(electrical.conn),
+            electricalIo, *home->reactor, [this, home](Session::Id ended) { sessionEnded(*home, ended); });
+        {
+            lock_guard<mutex> lock(home->sessionsMutex);
+            home->sessions[id] = session;
+        }
+        {
+            lock_guard<mutex> lock(directoryMutex);
+            for (const string& token : session->resumeTokens()) resumeTokens[token] = {home, id};
+        }
+        home->matchesStarted.fetch_add(1, memory_order_relaxed);
+        if (&mechanicalIo != &electricalIo) home->crossShardMatches.fetch_add(1, memory_order_relaxed);
+        runningMatches++;
+        session->start(mechanical.backlog, electrical.backlog);
+    }
+
+    bool resumePlayer(const string& token, Lobby::Player& player) {
+        pair<Shard*, Session::Id> location;
+        {
+            lock_guard<mutex> lock(directoryMutex);
+            auto found = resumeTokens.find(token);
+            if (found == resumeTokens.end()) return false;
+            location = found->second;
+        }
+        shared_ptr<Session> session;
+        Shard& home = *location.first;
+        {
+            lock_guard<mutex> lock(home.sessionsMutex);
+            auto found = home.sessions.find(location.second);
+            if (found == home.sessions.end()) return false;
+            session = found->second;
+        }
+        // Nothing left to turn away
+        if (!moveToShard(player, home)) {
+            LOG(LogLevel::Warn) << "Lost a resuming connection moving it to shard " << home.index;
+            return true;
+        }
+        return session->reattach(token, player.conn, *player.reactor, player.backlog);
+    }
+
+    void sessionEnded(Shard& shard, Session::Id id) {
+        shared_ptr<Session> session;
+        {
+            lock_guard<mutex> lock(shard.sessionsMutex);
+            auto found = shard.sessions.find(id);
+            if (found == shard.sessions.end()) return;
+            session = found->second;
+            shard.sessions.erase(found);
+        }
+        {
+            lock_guard<mutex> lock(directoryMutex);
+            for (const string& token : session->resumeTokens()) resumeTokens.erase(token);
+        }
+        size_t running = --runningMatches;
+        LOG(LogLevel::Info) << "[session " << id << "] Match over, " << running << " still running";
+
+        // Without a listener nothing new can arrive (the single-process
+        // build); once draining nothing new may
+        if ((!listening || draining) && running == 0) stop();
+    }
+
+    vector<Session::Stats> matchesOn(Shard& shard) {
+        vector<shared_ptr<Session>> running;
+        {
+            lock_guard<mutex> lock(shard.sessionsMutex);
+            for (auto& entry : shard.sessions) running.push_back(entry.second);
+        }
+        vector<Session::Stats> result;
+        for (const shared_ptr<Session>& session : running) result.push_back(session->stats());
+        return result;
+    }
+
+    // Creates the lobby and starts accepting on every shard's listener
+    void startAccepting() {
+        lobby.reset(new Lobby(
+            [this](Lobby::Player mechanical, Lobby::Player electrical) {
+                startMatch(move(mechanical), move(electrical));
+            },
+            [this](const string& token, Lobby::Player& player) { return resumePlayer(token, player); }));
+        for (unique_ptr<Shard>& shard : shards) {
+            Shard* current = shard.get();
+            current->listenWatch = current->reactor->watch(current->listenSocket, [this, current] { acceptPlayers(*current); });
+        }
+        listening = true;
+    }
+
+    void waitAllIdle() {
+        for (unique_ptr<Shard>& shard : shards) shard->executor.waitIdle();
+    }
+
+    // Shards by the index another process knew them by
+    Shard& shardAt(int index) { return *shards[size_t(max(index, 0)) % shards.size()]; }
+
+    // A handed-over match leaves without ending: no onEnded, no shutdowns
+    void forgetMatch(Shard& shard, const shared_ptr<Session>& session) {
+        {
+            lock_guard<mutex> lock(shard.sessionsMutex);
+            shard.sessions.erase(session->id());
+        }
+        {
+            lock_guard<mutex> lock(directoryMutex);
+            for (const string& token : session->resumeTokens()) resumeTokens.erase(token);
+        }
+        runningMatches--;
+    }
+
+    // One match and its connected players, as handOff() sends them
+    bool sendMatch(int channel, Shard& home, Session& session) {
+        Session::HandedOffPlayer players[2];
+        HandoffMatch match = session.handOff(players);
+        match.shard = home.index;
+        bool sent = sendHandoffRecord(channel, encode(match), string(), {});
+        for (int role = 0; role < 2; role++) {
+            if (!players[role].connected) continue;
+            DetachedTransport& conn = players[role].conn;
+            HandoffSeat seat;
+            seat.match = match.id;
+            seat.role = role;
+            seat.shard = shardOf(players[role].io)->index;
+            seat.kind = conn.kind;
+            sent = sent && sendHandoffRecord(channel, encode(seat), conn.unread, conn.fds);
+            for (int fd : conn.fds) close(fd);
+        }
+        return sent;
+    }
+
+    void runShard(Shard& shard) {
+        Profiler::nameThread(shards.size() == 1 ? string("reactor") : "reactor " + to_string(shard.index));
+        if (shard.cpu >= 0) pinThread(pthread_self(), shard.cpu);
+        shard.reactor->run();
+    }
+
+public:
+    explicit GameServer(size_t shardCount = defaultShardCount())
+        : listening(false), port(configuredPort()), draining(false), handingOff(false), signalFd(-1), signalWatch(0), nextSessionId(1), runningMatches(0),
+          reportedHeap(heapStats()), reportedTasks(0) {
+        shardCount = max<size_t>(1, shardCount);
+        vector<int> cpus = allowedCpus();
+        bool pin = pinningWanted(shardCount);
+        for (size_t i = 0; i < shardCount; i++) {
+            shards.emplace_back(new Shard(i, pin ? cpus[i % cpus.size()] : -1));
+        }
+        sigemptyset(&handledSignals);
+    }
+
+    ~GameServer() {
+        stop();
+        for (unique_ptr<Shard>& shard : shards) {
+            lock_guard<mutex> lock(shard->sessionsMutex);
+            for (auto& entry : shard->sessions) entry.second->close();
+        }
+        // Nothing may still be running when the reactors go away
+        for (unique_ptr<Shard>& shard : shards) shard->executor.waitIdle();
+        lobby.reset();
+        for (unique_ptr<Shard>& shard : shards) {
+            if (shard->listenWatch) shard->reactor->unwatch(shard->listenWatch);
+            if (shard->listenSocket != -1) close(shard->listenSocket);
+        }
+        if (signalFd != -1) {
+            shards[0]->reactor->unwatch(signalWatch);
+            close(signalFd);
+        }
+        // Matches live in their shard's arena, and any shard's reactor may
+        // still hold tasks that keep one alive: release every match before
+        // the first arena goes
+        for (unique_ptr<Shard>& shard : shards) {
+            lock_guard<mutex> lock(shard->sessionsMutex);
+            shard->sessions.clear();
+        }
+        for (unique_ptr<Shard>& shard : shards) shard->reactor.reset();
+    }
+
+    // False if some shard has no reactor
+    bool ready() const {
+        for (const unique_ptr<Shard>& shard : shards) {
+            if (!shard->reactor) return false;
+        }
+        return true;
+    }
+
+    bool startServer() {
+        if (!ready()) return false;
+
+        // Every shard's socket has SO_REUSEPORT, which would also let a
+        // second server on the port steal our connections: make sure the
+        // port is free first
+        int probe = openListener(false);
+        if (probe < 0) return false;
+        close(probe);
+
+        for (unique_ptr<Shard>& shard : shards) {
+            Shard& current = *shard;
+            current.listenSocket = openListener(true);
+            if (current.listenSocket < 0) return false;
+            if (listen(current.listenSocket, SOMAXCONN) < 0) {
+                perror("listen failed");
+                close(current.listenSocket);
+                current.listenSocket = -1;
+                return false;
+            }
+        }
+
+        startAccepting();
+
+        LOG(LogLevel::Info) << "Server started on port " << port << " with " << shards.size() << " shard"
+                            << (shards.size() == 1 ? "" : "s") << " (" << shards[0]->reactor->backendName()
+                            << (shards[0]->cpu >= 0 ? ", pinned" : "") << "). Waiting for players...";
+        return true;
+    }
+
+    // Zero-downtime restart, new side: takes the listening sockets, the
+    // lobby and the running matches over from the server whose admin socket
+    // is at adminPath, instead of binding the port. False if that server
+    // handed nothing over, in which case it is still running.
+    bool takeOver(const string& adminPath) {
+        if (!ready()) return false;
+        chrono::steady_clock::time_point started = chrono::steady_clock::now();
+
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (adminPath.size() >= sizeof(address.sun_path)) {
+            cout << "Admin socket path too long: " << adminPath << "\n";
+            return false;
+        }
+        strcpy(address.sun_path, adminPath.c_str());
+        int channel = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (channel < 0) {
+            perror("handoff socket creation failed");
+            return false;
+        }
+        const string request = "handoff\n";
+        if (connect(channel, (sockaddr*)&address, sizeof(address)) < 0 ||
+            send(channel, request.data(), request.size(), MSG_NOSIGNAL) != ssize_t(request.size())) {
+            cout << "Cannot reach the running server at " << adminPath << ": " << strerror(errno) << "\n";
+            close(channel);
+            return false;
+        }
+
+        struct PendingMatch {
+            HandoffMatch match;
+            unique_ptr<Transport> conns[2];
+            Reactor* ios[2];
+        };
+        struct PendingClient {
+            unique_ptr<Transport> conn;
+            Reactor* reactor;
+            int role;
+            chrono::milliseconds timeLeft;
+        };
+        vector<PendingMatch> matches;
+        vector<PendingClient> waiting;
+        vector<int> extraListeners;  // the old process had more shards
+        bool complete = false;
+
+        string line, tail;
+        vector<int> fds;
+        while (receiveHandoffRecord(channel, line, tail, fds)) {
+            HandoffListener listener;
+            HandoffMatch match;
+            HandoffSeat seat;
+            HandoffWaiting client;
+            HandoffEnd end;
+            if (decode(line, listener) && fds.size() == 1) {
+                int& slot = shardAt(listener.shard).listenSocket;
+                (slot == -1 ? slot : extraListeners.emplace_back()) = fds[0];
+            } else if (decode(line, match) && fds.empty()) {
+                matches.push_back({match, {}, {nullptr, nullptr}});
+            } else if (decode(line, seat) && !matches.empty() && matches.back().match.id == seat.match &&
+                       (seat.role == 0 || seat.role == 1)) {
+                // On the match's shard, even if the old process had the
+                // seat read elsewhere
+                Reactor& io = *shardAt(matches.back().match.shard).reactor;
+                DetachedTransport conn = {seat.kind, fds, tail};
+                matches.back().conns[seat.role] = io.restoreConnection(conn);
+                matches.back().ios[seat.role] = &io;
+            } else if (decode(line, client) && client.role >= -1 && client.role <= 1) {
+                Reactor& io = *shardAt(client.shard).reactor;
+                DetachedTransport conn = {client.kind, fds, tail};
+                unique_ptr<Transport> transport = io.restoreConnection(conn);
+                if (transport) waiting.push_back({move(transport), &io, client.role, chrono::milliseconds(client.msLeft)});
+            } else if (decode(line, end)) {
+                complete = end.matches == matches.size() && end.waiting == waiting.size();
+                break;
+            } else {
+                LOG(LogLevel::Warn) << "Unexpected handoff record: " << line.substr(0, 80);
+                for (int fd : fds) close(fd);
+            }
+        }
+        close(channel);
+
+        // Without listeners nothing was handed over, and the old server
+        // still has the port
+        bool anyListener = false;
+        for (unique_ptr<Shard>& shard : shards) anyListener = anyListener || shard->listenSocket != -1;
+        if (!anyListener) {
+            cout << "The server at " << adminPath << " did not hand over\n";
+            for (int fd : extraListeners) close(fd);
+            return false;
+        }
+        if (!complete) {
+            LOG(LogLevel::Warn) << "Handoff cut short, carrying on with what arrived";
+        }
+
+        // We may have more shards than the old process: they join the port
+        for (unique_ptr<Shard>& shard : shards) {
+            if (shard->listenSocket != -1) continue;
+            shard->listenSocket = openListener(true);
+            if (shard->listenSocket < 0 || listen(shard->listenSocket, SOMAXCONN) < 0) {
+                perror("listen failed");
+                return false;
+            }
+        }
+        startAccepting();
+        // Or fewer: whoever is queued on the extra listeners still gets in
+        for (int fd : extraListeners) {
+            Shard& shard = *shards[0];
+            int playerSocket;
+            while ((playerSocket = accept4(fd, NULL, NULL, SOCK_CLOEXEC)) >= 0) {
+                shard.accepted.fetch_add(1, memory_order_relaxed);
+                lobby->admit(shard.reactor->adoptConnection(playerSocket), *shard.reactor);
+            }
+            close(fd);
+        }
+
+        for (PendingMatch& pending : matches) {
+            Shard* home = &shardAt(pending.match.shard);
+            Reactor& mechanicalIo = pending.ios[0] ? *pending.ios[0] : *home->reactor;
+            Reactor& electricalIo = pending.ios[1] ? *pending.ios[1] : *home->reactor;
+            shared_ptr<Session> session = allocate_shared<Session>(
+                ArenaAllocator<Session>(home->arena), pending.match, move(pending.conns[0]), mechanicalIo,
+                move(pending.conns[1]), electricalIo, *home->reactor,
+                [this, home](Session::Id ended) { sessionEnded(*home, ended); });
+            {
+                lock_guard<mutex> lock(home->sessionsMutex);
+                home->sessions[pending.match.id] = session;
+            }
+            {
+                lock_guard<mutex> lock(directoryMutex);
+                for (const string& token : session->resumeTokens()) resumeTokens[token] = {home, pending.match.id};
+            }
+            if (pending.match.id >= nextSessionId) nextSessionId = pending.match.id + 1;
+            runningMatches++;
+            session->resumeHandedOff(pending.match);
+        }
+        for (PendingClient& client : waiting) {
+            lobby->adoptHandedOff(move(client.conn), *client.reactor, client.role, client.timeLeft);
+        }
+
+        double tookMs = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+        LOG(LogLevel::Info) << "Took over port " << port << " with " << matches.size() << " match"
+                            << (matches.size() == 1 ? "" : "es") << " and " << waiting.size()
+                            << " waiting player" << (waiting.size() == 1 ? "" : "s") << " in " << tookMs << " ms ("
+                            << shards.size() << " shard" << (shards.size() == 1 ? "" : "s") << ", "
+                            << shards[0]->reactor->backendName() << ")";
+        return true;
+    }
+
+    // Zero-downtime restart, old side: hands the listening sockets, the
+    // lobby and every match to the process at the other end of channel (see
+    // takeOver()), then stops gameLoop(). Connections are only closed here,
+    // never shut down. False if the channel failed part way, in which case
+    // whatever had not gone out yet is lost.
+    bool handOff(int channel) {
+        if (!listening || handingOff.exchange(true)) return false;
+        chrono::steady_clock::time_point started = chrono::steady_clock::now();
+        LOG(LogLevel::Info) << "Handing over to a new server process";
+
+        // No new connections; an accept already running is waited out below
+        for (unique_ptr<Shard>& shard : shards) {
+            if (shard->listenWatch) shard->reactor->unwatch(shard->listenWatch);
+            shard->listenWatch = 0;
+        }
+        vector<Lobby::HandedOffClient> waiting = lobby->handOff();
+        // Matches the lobby was just starting or resuming into are in the
+        // tables after this
+        waitAllIdle();
+
+        vector<pair<Shard*, shared_ptr<Session>>> matches;
+        for (unique_ptr<Shard>& shard : shards) {
+            lock_guard<mutex> lock(shard->sessionsMutex);
+            for (auto& entry : shard->sessions) matches.push_back({shard.get(), entry.second});
+        }
+        for (auto& match : matches) match.second->freeze();
+        // A read task that was already past its checks keeps what it read
+        // for the handoff; after this none is left
+        waitAllIdle();
+
+        bool sent = true;
+        for (unique_ptr<Shard>& shard : shards) {
+            if (shard->listenSocket == -1) continue;
+            HandoffListener listener;
+            listener.shard = shard->index;
+            sent = sent && sendHandoffRecord(channel, encode(listener), string(), {shard->listenSocket});
+            close(shard->listenSocket);
+            shard->listenSocket = -1;
+        }
+        for (auto& match : matches) {
+            sent = sendMatch(channel, *match.first, *match.second) && sent;
+            forgetMatch(*match.first, match.second);
+        }
+        for (Lobby::HandedOffClient& client : waiting) {
+            HandoffWaiting record;
+            record.shard = shardOf(client.reactor)->index;
+            record.role = client.role;
+            record.msLeft = client.timeLeft.count();
+            record.kind = client.conn.kind;
+            sent = sent && sendHandoffRecord(channel, encode(record), client.conn.unread, client.conn.fds);
+            for (int fd : client.conn.fds) close(fd);
+        }
+        HandoffEnd end;
+        end.matches = matches.size();
+        end.waiting = waiting.size();
+        sent = sent && sendHandoffRecord(channel, encode(end), string(), {});
+
+        double tookMs = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+        if (sent) {
+            LOG(LogLevel::Info) << "Handed over " << matches.size() << " match" << (matches.size() == 1 ? "" : "es")
+                                << " and " << waiting.size() << " waiting player" << (waiting.size() == 1 ? "" : "s")
+                                << " in " << tookMs << " ms, exiting";
+        } else {
+            LOG(LogLevel::Warn) << "Handoff failed part way (" << strerror(errno) << "), exiting";
+        }
+        stop();
+        return sent;
+    }
+
+    // Lets the running matches finish, then stops gameLoop(). Players may
+    // still resume into them; new ones are turned away (see Lobby::drain()).
+    void drain() {
+        if (draining.exchange(true)) return;
+        if (lobby) lobby->drain();
+        size_t running = runningMatches;
+        LOG(LogLevel::Info) << "Draining, " << running << " match" << (running == 1 ? "" : "es")
+                            << " left to finish";
+        if (running == 0) stop();
+    }
+
+    // Snapshot of every running match
+    vector<Session::Stats> stats() {
+        vector<Session::Stats> result;
+        for (unique_ptr<Shard>& shard : shards) {
+            vector<Session::Stats> matches = matchesOn(*shard);
+            result.insert(result.end(), matches.begin(), matches.end());
+        }
+        return result;
+    }
+
+    vector<ShardStats> shardStats() {
+        vector<ShardStats> result;
+        for (unique_ptr<Shard>& shard : shards) {
+            result.push_back({shard->index, shard->cpu, shard->reactor ? shard->reactor->backendName() : "none",
+                              shard->sessionCount(), shard->accepted.load(), shard->matchesStarted.load(),
+                              shard->crossShardMatches.load(), shard->executor.tasksRun(), shard->arena.bytesInUse(),
+                              shard->arena.bytesReserved()});
+        }
+        return result;
+    }
+
+    // Human-readable stats(): RTT percentiles over every connected player
+    // (from the heartbeat PINGs), then each shard's load followed by one
+    // line per match on it
+    string statsReport() {
+        vector<ShardStats> loads = shardStats();
+        vector<vector<Session::Stats>> matchesByShard;
+        size_t matchCount = 0;
+        vector<double> rtts;
+        for (unique_ptr<Shard>& shard : shards) {
+            matchesByShard.push_back(matchesOn(*shard));
+            matchCount += matchesByShard.back().size();
+            for (const Session::Stats& match : matchesByShard.back()) {
+                for (const Session::PlayerStats* player : {&match.mechanical, &match.electrical}) {
+                    if (player->connected && player->pongs > 0) rtts.push_back(player->rttMs);
+                }
+            }
+        }
+        sort(rtts.begin(), rtts.end());
+
+        ostringstream report;
+        report.setf(ios::fixed);
+        report.precision(1);
+        report << matchCount << " matches running, " << (lobby ? lobby->waitingCount() : 0) << " players waiting";
+        if (!rtts.empty()) {
+            auto percentile = [&rtts](double p) { return rtts[min(rtts.size() - 1, size_t(p * rtts.size()))]; };
+            report << "\nrtt over " << rtts.size() << " players: p50 " << percentile(0.50) << " ms, p99 "
+                   << percentile(0.99) << " ms, max " << rtts.back() << " ms";
+        }
+        Session::FloodTotals flood = Session::floodTotals();
+        report << "\nflood control: " << flood.merged << " inputs merged, " << flood.dropped << " messages dropped, "
+               << flood.disconnects << " players disconnected";
+        if (lockstepEnabled()) report << "\nlockstep: " << Session::desyncCount() << " desyncs reseeded";
+        {
+            // Once matches are running, none of this should move
+            lock_guard<mutex> lock(reportMutex);
+            HeapStats heap = heapStats();
+            uint64_t tasks = 0;
+            for (const ShardStats& load : loads) tasks += load.tasksRun;
+            uint64_t allocations = heap.allocations - reportedHeap.allocations;
+            report << "\nheap: " << allocations << " allocations (" << (heap.bytes - reportedHeap.bytes) / 1024.0
+                   << " KB) and " << heap.frees - reportedHeap.frees << " frees over " << tasks - reportedTasks
+                   << " tasks since the last report";
+            reportedHeap = heap;
+            reportedTasks = tasks;
+        }
+        for (size_t i = 0; i < loads.size(); i++) {
+            const ShardStats& load = loads[i];
+            report << "\nshard " << load.index << " (";
+            if (load.cpu >= 0) report << "cpu " << load.cpu << ", ";
+            report << load.backend << "): " << load.matches << " matches, " << load.accepted
+                   << " connections accepted, " << load.matchesStarted << " matches started ("
+                   << load.crossShardMatches << " cross-shard), " << load.tasksRun << " tasks run, arena "
+                   << load.arenaInUse / 1024.0 << " of " << load.arenaReserved / 1024 << " KB in use";
+            for (const Session::Stats& match : matchesByShard[i]) report << "\n  " << describeMatch(match);
+        }
+        return report.str();
+    }
+
+    // One line about a match, as in statsReport()
+    static string describeMatch(const Session::Stats& match) {
+        ostringstream line;
+        line.setf(ios::fixed);
+        line.precision(1);
+        line << "[session " << match.id << "] " << match.phase << ", " << match.timeLeft << " s left, tick lag "
+             << match.tickLagMs << " ms (max " << match.maxTickLagMs << ")";
+        const char* names[2] = {"mechanical", "electrical"};
+        const Session::PlayerStats* players[2] = {&match.mechanical, &match.electrical};
+        for (int j = 0; j < 2; j++) {
+            line << "; " << names[j] << " ";
+            if (!players[j]->connected) {
+                line << "away";
+            } else if (players[j]->pongs == 0) {
+                line << "rtt not measured yet";
+            } else {
+                line << "rtt " << players[j]->rttMs << " ms (+-" << players[j]->rttVariationMs << "), clock offset "
+                     << players[j]->clockOffsetMs << " ms";
+            }
+            if (players[j]->throttled > 0) line << ", " << players[j]->throttled << " messages over limit";
+        }
+        return line.str();
+    }
+
+    // The running match with that id; null if there is none
+    shared_ptr<Session> findMatch(Session::Id id) {
+        for (unique_ptr<Shard>& shard : shards) {
+            lock_guard<mutex> lock(shard->sessionsMutex);
+            auto found = shard->sessions.find(id);
+            if (found != shard->sessions.end()) return found->second;
+        }
+        return nullptr;
+    }
+
+    int listeningPort() const { return port; }
+
+    // Runs handler on the first shard's worker whenever signo arrives. signo
+    // must be blocked in every thread, so block it before constructing the
+    // server (its threads inherit the mask).
+    bool handleSignal(int signo, Reactor::Task handler) {
+        if (!ready()) return false;
+        lock_guard<mutex> lock(signalMutex);
+        sigaddset(&handledSignals, signo);
+        int fd = signalfd(signalFd, &handledSignals, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (fd < 0) {
+            perror("signalfd failed");
+            return false;
+        }
+        signalHandlers[signo] = move(handler);
+        if (signalFd == -1) {
+            signalFd = fd;
+            signalWatch = shards[0]->reactor->watch(signalFd, [this] { readSignals(); });
+        }
+        return true;
+    }
+
+    // Starts a match over already-connected transports (TCP or in-process)
+    void attachPlayers(unique_ptr<Transport> mechanical, unique_ptr<Transport> electrical) {
+        startMatch({move(mechanical), {}, nullptr}, {move(electrical), {}, nullptr});
+    }
+
+    // Runs every shard until stop(), the first on the calling thread;
+    // without listening sockets it also returns once the last match has
+    // ended
+    void gameLoop() {
+        if (!ready()) return;
+        vector<thread> loops;
+        for (size_t i = 1; i < shards.size(); i++) loops.emplace_back(&GameServer::runShard, this, ref(*shards[i]));
+        runShard(*shards[0]);
+        for (thread& loop : loops) loop.join();
+    }
+
+    void stop() {
+        for (unique_ptr<Shard>& shard : shards) {
+            if (shard->reactor) shard->reactor->stop();
+        }
+    }
+};
+
+#endif // SERVER_H
@@ -0,0 +1,921 @@
+#include "session.h"
+#include "log.h"
+#include "profiler.h"
+#include "scratch.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <random>
+#include <vector>
+using namespace std;
+
+const chrono::milliseconds Session::TICK_INTERVAL(1000);
+const chrono::milliseconds Session::RESUME_GRACE(30 * 1000);
+const chrono::milliseconds Session::FLOOD_COOLDOWN(10 * 1000);
+const chrono::milliseconds Session::IDLE_TIMEOUT(15 * 1000);
+const chrono::milliseconds Session::READY_TIMEOUT(5 * 60 * 1000);
+const chrono::milliseconds Session::REPLAY_TIMEOUT(2 * 60 * 1000);
+
+// Messages handled per wakeup before the handler yields its worker
+const int MESSAGE_BUDGET = 64;
+
+static atomic<uint64_t> inputsMerged(0);
+static atomic<uint64_t> messagesDropped(0);
+static atomic<uint64_t> floodDisconnects(0);
+static atomic<uint64_t> desyncs(0);
+
+// By tag only: this runs before the line is parsed. Inputs from the wrong
+// station are ignored by handleMessage(), so they count as OTHER.
+static FloodGuard::Kind kindOf(bool mechanical, const string& message) {
+    if (hasTag<MechanicalInputMessage>(message)) return mechanical ? FloodGuard::INPUT : FloodGuard::OTHER;
+    if (hasTag<ElectricalInputMessage>(message)) return mechanical ? FloodGuard::OTHER : FloodGuard::INPUT;
+    if (hasTag<PingMessage>(message) || hasTag<PongMessage>(message)) return FloodGuard::TIMING;
+    if (hasTag<ReadyMessage>(message) || hasTag<PlayAgainMessage>(message)) return FloodGuard::CONTROL;
+    return FloodGuard::OTHER;
+}
+
+// 128 random bits as hex; knowing it is what lets a client take a seat back
+static string newResumeToken() {
+    static mutex sourceMutex;
+    static random_device source;
+    lock_guard<mutex> lock(sourceMutex);
+    char hex[33];
+    for (int i = 0; i < 4; i++) snprintf(hex + 8 * i, 9, "%08x", (unsigned)source());
+    return hex;
+}
+
+Session::Session(Id id, unique_ptr<Transport> mechanical, Reactor& mechanicalIo, unique_ptr<Transport> electrical,
+                 Reactor& electricalIo, Reactor& eventLoop, EndedCallback endedCallback)
+    : sessionId(id), reactor(eventLoop), onEnded(endedCallback), ended(false), tickScheduled(false), tickLagMs(0),
+      maxTickLagMs(0), heartbeatTimer(0), phaseTimer(0), phase(0), frozen(false), frozenTickInMs(-1),
+      frozenPhaseLeftMs(-1), lockstep(lockstepEnabled()), mechanicalChanged(false), electricalChanged(false) {
+    players[MECHANICAL] = {move(mechanical), &mechanicalIo, 0, true, 0, Clock::now(), 0, ClockSync(),
+                           make_shared<FloodGuard>(), 0, Clock::time_point(), string()};
+    players[ELECTRICAL] = {move(electrical), &electricalIo, 0, true, 0, Clock::now(), 0, ClockSync(),
+                           make_shared<FloodGuard>(), 0, Clock::time_point(), string()};
+    tokens = {newResumeToken(), newResumeToken()};
+
+    // Initialize game state
+    gameState.electrical = {"Off", "Idle"};
+    gameState.mechanical = {"Stopped", "Middle", "Closed", 5};
+    gameState.timeLeft = 600;
+    gameState.targetPressure = 150.0;
+    gameState.machine = {100.0, 200.0};
+    gameState.targetTemperature = 300.0;
+    gameState.gameWon = false;
+    gameState.gameActive = false;
+    gameState.gameFailed = false;
+    gameState.mechanicalReady = false;
+    gameState.electricalReady = false;
+    gameState.playAgainRequested = false;
+    gameState.mechanicalWantsReplay = false;
+    gameState.electricalWantsReplay = false;
+
+    lockstepSim.setMechanical(gameState.mechanical);
+    lockstepSim.setElectrical(gameState.electrical);
+
+    mechanicalStation = plant.addMechanicalStation(gameState.mechanical);
+    electricalStation = plant.addElectricalStation(gameState.electrical);
+    mainMachine = plant.addMachine(gameState.machine, mechanicalStation, electricalStation);
+    plant.setTarget(mainMachine, gameState.targetPressure, gameState.targetTemperature);
+}
+
+Session::Session(const HandoffMatch& match, unique_ptr<Transport> mechanical, Reactor& mechanicalIo,
+                 unique_ptr<Transport> electrical, Reactor& electricalIo, Reactor& eventLoop,
+                 EndedCallback endedCallback)
+    : Session(match.id, move(mechanical), mechanicalIo, move(electrical), electricalIo, eventLoop, endedCallback) {
+    players[MECHANICAL].connected = players[MECHANICAL].conn != nullptr;
+    players[ELECTRICAL].connected = players[ELECTRICAL].conn != nullptr;
+    tokens = {match.mechanicalToken, match.electricalToken};
+
+    gameState.mechanical = {match.gear, match.lever, match.valve, match.dial};
+    gameState.electrical = {match.switchA, match.button};
+    gameState.machine = {match.pressure, match.temperature};
+    gameState.targetPressure = match.targetPressure;
+    gameState.targetTemperature = match.targetTemperature;
+    gameState.timeLeft = match.timeLeft;
+    gameState.gameActive = match.gameActive;
+    gameState.gameWon = match.gameWon;
+    gameState.gameFailed = match.gameFailed;
+    gameState.mechanicalReady = match.mechanicalReady;
+    gameState.electricalReady = match.electricalReady;
+    gameState.playAgainRequested = match.playAgainRequested;
+    gameState.mechanicalWantsReplay = match.mechanicalWantsReplay;
+    gameState.electricalWantsReplay = match.electricalWantsReplay;
+    mechanicalInput = {match.gear, match.lever, match.valve, match.dial, match.mechanicalSeq};
+    electricalInput = {match.switchA, match.button, match.electricalSeq};
+
+    plant.setMechanical(mechanicalStation, gameState.mechanical);
+    plant.setElectrical(electricalStation, gameState.electrical);
+    plant.setTarget(mainMachine, gameState.targetPressure, gameState.targetTemperature);
+    plant.setMachine(mainMachine, gameState.machine);
+
+    // The stations' sims are where the old process left them: ours must
+    // match them bit for bit, which seeding from exact doubles does
+    lockstep = match.lockstep;
+    lockstepSim.setMechanical(gameState.mechanical);
+    lockstepSim.setElectrical(gameState.electrical);
+    lockstepSim.setTick(match.lockstepTick);
+    StateMessage seed;
+    seed.pressure = gameState.machine.pressure;
+    seed.temperature = gameState.machine.temperature;
+    seed.targetPressure = gameState.targetPressure;
+    seed.targetTemperature = gameState.targetTemperature;
+    seed.timeLeft = gameState.timeLeft;
+    seed.gameActive = gameState.gameActive;
+    seed.gameWon = gameState.gameWon;
+    seed.gameFailed = gameState.gameFailed;
+    lockstepSim.seed(seed);
+    mechanicalChanged = match.mechanicalChanged;
+    electricalChanged = match.electricalChanged;
+}
+
+Session::~Session() {}
+
+void Session::start(const vector<string>& mechanicalBacklog, const vector<string>& electricalBacklog) {
+    lock_guard<mutex> lock(stateMutex);
+
+    for (Role role : {MECHANICAL, ELECTRICAL}) {
+        watchLocked(role);
+        players[role].conn->sendMessage(encode(WelcomeMessage{tokens[role]}));
+    }
+    LOG(LogLevel::Info) << "[session " << sessionId << "] Match started (mechanical " << players[MECHANICAL].conn->kind()
+                        << ", electrical " << players[ELECTRICAL].conn->kind() << ")";
+
+    // Send initial game state to both players
+    sendGameStateLocked();
+    sendControlsLocked();
+    scheduleHeartbeatLocked();
+    setPhaseTimeoutLocked(READY_TIMEOUT, "players never got ready");
+
+    // Handled before anything the watches deliver, which needs stateMutex
+    for (const string& message : mechanicalBacklog) handleMessage(MECHANICAL, message);
+    for (const string& message : electricalBacklog) handleMessage(ELECTRICAL, message);
+}
+
+void Session::close() {
+    lock_guard<mutex> lock(stateMutex);
+    for (Player& player : players) {
+        if (player.connected) player.conn->shutdown();
+    }
+}
+
+void Session::freeze() {
+    lock_guard<mutex> lock(stateMutex);
+    if (ended) return;
+    Clock::time_point now = Clock::now();
+    auto msUntil = [now](Clock::time_point due) {
+        return max<int64_t>(0, chrono::duration_cast<chrono::milliseconds>(due - now).count());
+    };
+    frozenTickInMs = tickScheduled ? msUntil(tickDue) : -1;
+    frozenPhaseLeftMs = phaseTimer ? msUntil(phaseDue) : -1;
+
+    // Every task and timer of ours returns at once from here on; a pending
+    // tick cannot be cancelled, but finds the match ended
+    frozen = true;
+    ended = true;
+    if (phaseTimer) reactor.cancel(phaseTimer);
+    phaseTimer = 0;
+    if (heartbeatTimer) reactor.cancel(heartbeatTimer);
+    for (Player& player : players) {
+        if (player.graceTimer) reactor.cancel(player.graceTimer);
+        if (player.connected) player.io->unwatch(player.watch);
+    }
+    LOG(LogLevel::Info) << "[session " << sessionId << "] Frozen for the handoff";
+}
+
+HandoffMatch Session::handOff(HandedOffPlayer handedOff[2]) {
+    lock_guard<mutex> lock(stateMutex);
+    HandoffMatch match;
+    match.id = sessionId;
+    match.mechanicalToken = tokens[MECHANICAL];
+    match.electricalToken = tokens[ELECTRICAL];
+    match.gear = gameState.mechanical.gear;
+    match.lever = gameState.mechanical.lever;
+    match.valve = gameState.mechanical.valve;
+    match.dial = gameState.mechanical.dial;
+    match.mechanicalSeq = mechanicalInput.seq;
+    match.switchA = gameState.electrical.switchA;
+    match.button = gameState.electrical.button;
+    match.electricalSeq = electricalInput.seq;
+    match.pressure = gameState.machine.pressure;
+    match.temperature = gameState.machine.temperature;
+    match.targetPressure = gameState.targetPressure;
+    match.targetTemperature = gameState.targetTemperature;
+    match.timeLeft = gameState.timeLeft;
+    match.gameActive = gameState.gameActive;
+    match.gameWon = gameState.gameWon;
+    match.gameFailed = gameState.gameFailed;
+    match.mechanicalReady = gameState.mechanicalReady;
+    match.electricalReady = gameState.electricalReady;
+    match.playAgainRequested = gameState.playAgainRequested;
+    match.mechanicalWantsReplay = gameState.mechanicalWantsReplay;
+    match.electricalWantsReplay = gameState.electricalWantsReplay;
+    match.tickInMs = frozenTickInMs;
+    match.phaseLeftMs = frozenPhaseLeftMs;
+    match.lockstep = lockstep;
+    match.lockstepTick = lockstepSim.tick();
+    match.mechanicalChanged = mechanicalChanged;
+    match.electricalChanged = electricalChanged;
+
+    for (Role role : {MECHANICAL, ELECTRICAL}) {
+        Player& player = players[role];
+        HandedOffPlayer& out = handedOff[role];
+        out.io = player.io;
+        out.connected = false;
+        if (!player.connected) continue;
+        if (player.conn->detach(out.conn)) {
+            // Read here first, so they go ahead of whatever was still unread
+            out.conn.unread.insert(0, player.kept);
+            out.connected = true;
+        } else {
+            LOG(LogLevel::Warn) << "[session " << sessionId << "] " << roleName(role) << " player's "
+                                << player.conn->kind() << " connection cannot be handed over; it will have to resume";
+            player.conn->shutdown();
+        }
+    }
+    return match;
+}
+
+void Session::resumeHandedOff(const HandoffMatch& match) {
+    lock_guard<mutex> lock(stateMutex);
+    vector<string> backlogs[2];
+    for (Role role : {MECHANICAL, ELECTRICAL}) {
+        Player& player = players[role];
+        if (!player.connected) {
+            startGraceLocked(role);
+            continue;
+        }
+        // Lines already buffered in the transport would never make its fd
+        // readable, so they are read out here before watching
+        player.conn->watchReadiness();
+        string line;
+        RecvStatus status;
+        while ((status = player.conn->tryReceive(line)) == RecvStatus::Message) backlogs[role].push_back(line);
+        watchLocked(role);
+        if (status == RecvStatus::Closed) detachLocked(role);
+    }
+    LOG(LogLevel::Info) << "[session " << sessionId << "] Match taken over (mechanical "
+                        << (players[MECHANICAL].connected ? players[MECHANICAL].conn->kind() : "away")
+                        << ", electrical " << (players[ELECTRICAL].connected ? players[ELECTRICAL].conn->kind() : "away")
+                        << ")";
+
+    scheduleHeartbeatLocked();
+    if (match.phaseLeftMs >= 0) {
+        bool over = gameState.gameWon || gameState.gameFailed || gameState.timeLeft <= 0;
+        setPhaseTimeoutLocked(chrono::milliseconds(match.phaseLeftMs),
+                              over ? "no replay decision" : "players never got ready");
+    }
+    if (match.tickInMs >= 0 && gameState.gameActive) scheduleTickLocked(chrono::milliseconds(match.tickInMs));
+
+    for (Role role : {MECHANICAL, ELECTRICAL}) {
+        for (const string& message : backlogs[role]) {
+            if (ended) return;
+            handleMessage(role, message);
+        }
+    }
+}
+
+bool Session::reattach(const string& token, unique_ptr<Transport>& conn, Reactor& io, const vector<string>& backlog) {
+    lock_guard<mutex> lock(stateMutex);
+    if (ended) return false;
+
+    Role role;
+    if (token == tokens[MECHANICAL]) {
+        role = MECHANICAL;
+    } else if (token == tokens[ELECTRICAL]) {
+        role = ELECTRICAL;
+    } else {
+        return false;
+    }
+
+    Player& player = players[role];
+    if (Clock::now() < player.floodCooldownEnd) {
+        LOG(LogLevel::Info) << "[session " << sessionId << "] " << roleName(role)
+                            << " player tried to come back while cooling down after a flood";
+        return false;
+    }
+    if (player.connected) {
+        // The old connection has not noticed yet that it is dead
+        player.io->unwatch(player.watch);
+        player.conn->shutdown();
+    }
+    if (player.graceTimer) reactor.cancel(player.graceTimer);
+    player.graceTimer = 0;
+    player.conn = move(conn);
+    player.io = &io;
+    player.connected = true;
+    player.generation++;
+    player.lastHeard = Clock::now();
+    player.clock = ClockSync();
+    watchLocked(role);
+    LOG(LogLevel::Info) << "[session " << sessionId << "] " << roleName(role) << " player is back ("
+                        << player.conn->kind() << ")";
+
+    // The reconnecting client starts from nothing: token, then the full state
+    player.conn->sendMessage(encode(WelcomeMessage{token}));
+    sendGameStateLocked();
+    sendControlsLocked();
+    for (const string& message : backlog) handleMessage(role, message);
+
+    // Ticks stop while a player is away
+    if (gameState.gameActive) scheduleTickLocked(TICK_INTERVAL);
+    return true;
+}
+
+void Session::onReadable(Role role, uint64_t generation) {
+    PROFILE_ZONE("Session::onReadable");
+    shared_ptr<Transport> conn;
+    shared_ptr<FloodGuard> flood;
+    Reactor* io;
+    Reactor::WatchId watch;
+    {
+        lock_guard<mutex> lock(stateMutex);
+        if (ended || players[role].generation != generation) return;  // replaced meanwhile
+        conn = players[role].conn;
+        flood = players[role].flood;
+        io = players[role].io;
+        watch = players[role].watch;
+    }
+    ScratchLine message;
+    ScratchLine mergedInput;  // the latest input over the limit, not applied yet
+
+    for (int handled = 0; handled < MESSAGE_BUDGET; handled++) {
+        // Only this task receives on this connection, so no lock is needed here
+        RecvStatus status = conn->tryReceive(*message);
+        if (status == RecvStatus::WouldBlock) {
+            if (!applyMergedInput(role, generation, *mergedInput)) return;
+            io->rearm(watch);
+            return;
+        }
+
+        if (status == RecvStatus::Message) {
+            FloodGuard::Kind kind = kindOf(role == MECHANICAL, *message);
+            FloodGuard::Verdict verdict = flood->admit(kind, Clock::now());
+            if (verdict == FloodGuard::OVER_LIMIT) {
+                if (kind == FloodGuard::INPUT) {
+                    if (!mergedInput->empty()) inputsMerged.fetch_add(1, memory_order_relaxed);
+                    mergedInput->swap(*message);
+                } else {
+                    messagesDropped.fetch_add(1, memory_order_relaxed);
+                }
+                continue;
+            }
+            if (verdict == FloodGuard::DISCONNECT) {
+                lock_guard<mutex> lock(stateMutex);
+                if (ended || players[role].generation != generation) return;
+                floodDisconnects.fetch_add(1, memory_order_relaxed);
+                Player& player = players[role];
+                chrono::milliseconds cooldown = FLOOD_COOLDOWN * (1 << min(player.timesFlooded, 8));
+                player.timesFlooded++;
+                player.floodCooldownEnd = Clock::now() + cooldown;
+                LOG(LogLevel::Warn) << "[session " << sessionId << "] " << roleName(role)
+                                    << " player kept flooding, disconnecting it (no resuming for "
+                                    << cooldown.count() / 1000 << " s)";
+                detachLocked(role);
+                return;
+            }
+            // Anything merged so far is older than this input
+            if (kind == FloodGuard::INPUT && !mergedInput->empty()) {
+                inputsMerged.fetch_add(1, memory_order_relaxed);
+                mergedInput->clear();
+            }
+        }
+
+        lock_guard<mutex> lock(stateMutex);
+        if (frozen && players[role].generation == generation) {
+            // Read just as the match froze for a handoff: it goes along
+            keepLocked(role, *mergedInput);
+            if (status == RecvStatus::Message) keepLocked(role, *message);
+            return;
+        }
+        if (ended || players[role].generation != generation) return;
+        if (status == RecvStatus::Closed) {
+            detachLocked(role);
+            return;
+        }
+        players[role].lastHeard = Clock::now();
+        handleMessage(role, *message);
+    }
+
+    // Still busy: give the worker back and continue in a fresh task
+    if (!applyMergedInput(role, generation, *mergedInput)) return;
+    shared_ptr<Session> self = shared_from_this();
+    io->runAfter(chrono::milliseconds(0), [self, role, generation] { self->onReadable(role, generation); });
+}
+
+bool Session::applyMergedInput(Role role, uint64_t generation, const string& input) {
+    if (input.empty()) return true;
+    lock_guard<mutex> lock(stateMutex);
+    if (frozen && players[role].generation == generation) keepLocked(role, input);
+    if (ended || players[role].generation != generation) return false;
+    players[role].lastHeard = Clock::now();
+    handleMessage(role, input);
+    return true;
+}
+
+uint64_t Session::desyncCount() {
+    return desyncs.load(memory_order_relaxed);
+}
+
+Session::FloodTotals Session::floodTotals() {
+    return {inputsMerged.load(memory_order_relaxed), messagesDropped.load(memory_order_relaxed),
+            floodDisconnects.load(memory_order_relaxed)};
+}
+
+Session::Stats Session::stats() {
+    lock_guard<mutex> lock(stateMutex);
+    Stats result;
+    result.id = sessionId;
+    if (ended) result.phase = "ended";
+    else if (gameState.gameActive) result.phase = "playing";
+    else if (gameState.gameWon) result.phase = "won";
+    else if (gameState.gameFailed) result.phase = "failed";
+    else if (gameState.timeLeft <= 0) result.phase = "out of time";
+    else result.phase = "waiting for players";
+    result.gameActive = gameState.gameActive;
+    result.timeLeft = gameState.timeLeft;
+    result.tickLagMs = tickLagMs;
+    result.maxTickLagMs = maxTickLagMs;
+    PlayerStats* out[2] = {&result.mechanical, &result.electrical};
+    for (Role role : {MECHANICAL, ELECTRICAL}) {
+        const Player& player = players[role];
+        *out[role] = {player.connected, player.clock.samplesTaken(), player.clock.smoothedRtt() / 1000.0,
+                      player.clock.rttVariation() / 1000.0, player.clock.offset() / 1000.0,
+                      player.flood->overLimitCount()};
+    }
+    return result;
+}
+
+GameState Session::snapshot() {
+    lock_guard<mutex> lock(stateMutex);
+    return gameState;
+}
+
+void Session::requestReset() {
+    weak_ptr<Session> weakSelf = shared_from_this();
+    reactor.runAfter(chrono::milliseconds(0), [weakSelf] {
+        if (shared_ptr<Session> self = weakSelf.lock()) self->operatorReset();
+    });
+}
+
+void Session::requestEnd(const string& reason) {
+    weak_ptr<Session> weakSelf = shared_from_this();
+    reactor.runAfter(chrono::milliseconds(0), [weakSelf, reason] {
+        if (shared_ptr<Session> self = weakSelf.lock()) self->operatorEnd(reason);
+    });
+}
+
+void Session::operatorReset() {
+    lock_guard<mutex> lock(stateMutex);
+    if (ended) return;
+    LOG(LogLevel::Info) << "[session " << sessionId << "] Reset by the operator";
+    resetGameLocked();
+    sendGameStateLocked();
+    sendControlsLocked();
+}
+
+void Session::operatorEnd(const string& reason) {
+    {
+        lock_guard<mutex> lock(stateMutex);
+        if (ended) return;
+        endLocked(reason);
+    }
+    onEnded(sessionId);
+}
+
+void Session::graceExpired(Role role, uint64_t generation) {
+    {
+        lock_guard<mutex> lock(stateMutex);
+        // Came back (or the match ended some other way) in the meantime
+        if (ended || players[role].generation != generation) return;
+        endLocked(string(roleName(role)) + " player did not come back");
+    }
+    onEnded(sessionId);
+}
+
+void Session::heartbeat() {
+    lock_guard<mutex> lock(stateMutex);
+    heartbeatTimer = 0;
+    if (ended) return;
+
+    Clock::time_point now = Clock::now();
+    ScratchLine ping;
+    for (Role role : {MECHANICAL, ELECTRICAL}) {
+        Player& player = players[role];
+        if (!player.connected) continue;
+        Clock::duration silent = now - player.lastHeard;
+        if (silent >= IDLE_TIMEOUT) {
+            LOG(LogLevel::Info) << "[session " << sessionId << "] " << roleName(role) << " player stopped answering";
+            detachLocked(role);
+        } else {
+            encode(PingMessage{monotonicMicros()}, *ping);
+            player.conn->sendMessage(*ping);
+        }
+    }
+    scheduleHeartbeatLocked();
+}
+
+void Session::phaseExpired(uint64_t expectedPhase, const char* reason) {
+    {
+        lock_guard<mutex> lock(stateMutex);
+        // The phase moved on while this task was queued
+        if (ended || phase != expectedPhase) return;
+        endLocked(reason);
+    }
+    onEnded(sessionId);
+}
+
+void Session::handleMessage(Role role, const string& message) {
+    if (hasTag<ReadyMessage>(message)) {
+        (role == MECHANICAL ? gameState.mechanicalReady : gameState.electricalReady) = true;
+        LOG(LogLevel::Info) << "[session " << sessionId << "] " << roleName(role) << " player is ready!";
+
+        // Check if both players are ready
+        if (gameState.mechanicalReady && gameState.electricalReady && !gameState.gameActive) {
+            LOG(LogLevel::Info) << "[session " << sessionId << "] Both players ready! Starting game...";
+            gameState.gameActive = true;
+            clearPhaseTimeoutLocked();
+            sendGameStateLocked();
+            scheduleTickLocked(chrono::milliseconds(0));
+        }
+    } else if (role == MECHANICAL && hasTag<MechanicalInputMessage>(message)) {
+        handleMechanicalInput(message);
+    } else if (role == ELECTRICAL && hasTag<ElectricalInputMessage>(message)) {
+        handleElectricalInput(message);
+    } else if (hasTag<PingMessage>(message)) {
+        PingMessage ping;
+        if (decode(message, ping)) {
+            ScratchLine pong;
+            encode(pongFor(ping, monotonicMicros()), *pong);
+            players[role].conn->sendMessage(*pong);
+        }
+    } else if (hasTag<PongMessage>(message)) {
+        PongMessage pong;
+        if (decode(message, pong)) {
+            players[role].clock.addSample(pong, monotonicMicros());
+        }
+    } else if (lockstep && hasTag<DesyncMessage>(message)) {
+        DesyncMessage desync;
+        if (!decode(message, desync)) return;
+        desyncs.fetch_add(1, memory_order_relaxed);
+        LOG(LogLevel::Warn) << "[session " << sessionId << "] " << roleName(role) << " player out of sync at step "
+                            << desync.tick << " (ours is " << lockstepSim.tick() << "), reseeding";
+        sendGameStateLocked();
+    } else if (hasTag<PlayAgainMessage>(message)) {
+        PlayAgainMessage answer;
+        if (!decode(message, answer)) {
+            LOG(LogLevel::Warn) << "[session " << sessionId << "] Expected " << layout<PlayAgainMessage>()
+                                << ", got: " << message;
+            return;
+        }
+        (role == MECHANICAL ? gameState.mechanicalWantsReplay : gameState.electricalWantsReplay) = answer.wantsReplay;
+        LOG(LogLevel::Info) << "[session " << sessionId << "] " << roleName(role) << " player wants replay: "
+                            << (answer.wantsReplay ? "YES" : "NO");
+
+        // Check if both players want to replay
+        bool reset = gameState.mechanicalWantsReplay && gameState.electricalWantsReplay;
+        if (reset) {
+            resetGameLocked();
+        }
+        // Both sides see each other's answer right away
+        sendGameStateLocked();
+        if (reset) sendControlsLocked();
+    }
+}
+
+void Session::handleMechanicalInput(const string& message) {
+    if (!decode(message, receivedMechanical)) {
+        LOG(LogLevel::Warn) << "[session " << sessionId << "] Expected " << layout<MechanicalInputMessage>()
+                            << ", got: " << message;
+        return;
+    }
+    // Assigned field by field, so the strings keep their buffers
+    MechanicalInputMessage& input = mechanicalInput;
+    input.gear = receivedMechanical.gear;
+    input.lever = receivedMechanical.lever;
+    input.valve = receivedMechanical.valve;
+    input.dial = receivedMechanical.dial;
+    input.seq = receivedMechanical.seq;
+    gameState.mechanical.gear = input.gear;
+    gameState.mechanical.lever = input.lever;
+    gameState.mechanical.valve = input.valve;
+    gameState.mechanical.dial = input.dial;
+    plant.setMechanical(mechanicalStation, gameState.mechanical);
+    lockstepSim.setMechanical(gameState.mechanical);
+    mechanicalChanged = true;
+    // Lockstep passes it on with the next STEP instead
+    if (!lockstep && players[ELECTRICAL].connected) players[ELECTRICAL].conn->sendMessage(message);
+
+    LOG(LogLevel::Debug) << "[session " << sessionId << "] Mechanical update: Gear=" << gameState.mechanical.gear
+                         << " Lever=" << gameState.mechanical.lever << " Valve=" << gameState.mechanical.valve
+                         << " Dial=" << gameState.mechanical.dial;
+}
+
+void Session::handleElectricalInput(const string& message) {
+    if (!decode(message, receivedElectrical)) {
+        LOG(LogLevel::Warn) << "[session " << sessionId << "] Expected " << layout<ElectricalInputMessage>()
+                            << ", got: " << message;
+        return;
+    }
+    ElectricalInputMessage& input = electricalInput;
+    input.switchA = receivedElectrical.switchA;
+    input.button = receivedElectrical.button;
+    input.seq = receivedElectrical.seq;
+    gameState.electrical.switchA = input.switchA;
+    gameState.electrical.button = input.button;
+    plant.setElectrical(electricalStation, gameState.electrical);
+    lockstepSim.setElectrical(gameState.electrical);
+    electricalChanged = true;
+    if (!lockstep && players[MECHANICAL].connected) players[MECHANICAL].conn->sendMessage(message);
+
+    LOG(LogLevel::Debug) << "[session " << sessionId << "] Electrical update: Switch=" << gameState.electrical.switchA
+                         << " Button=" << gameState.electrical.button;
+}
+
+void Session::sendGameStateLocked() {
+    PROFILE_ZONE("Session::sendGameState");
+    stateMessage.pressure = gameState.machine.pressure;
+    stateMessage.temperature = gameState.machine.temperature;
+    stateMessage.targetPressure = gameState.targetPressure;
+    stateMessage.targetTemperature = gameState.targetTemperature;
+    stateMessage.timeLeft = gameState.timeLeft;
+    stateMessage.gameActive = gameState.gameActive;
+    stateMessage.gameWon = gameState.gameWon;
+    stateMessage.gameFailed = gameState.gameFailed;
+    stateMessage.mechanicalWantsReplay = gameState.mechanicalWantsReplay;
+    stateMessage.electricalWantsReplay = gameState.electricalWantsReplay;
+    stateMessage.serverTime = monotonicMicros();
+    stateMessage.mechanicalSeq = mechanicalInput.seq;
+    stateMessage.electricalSeq = electricalInput.seq;
+    encode(stateMessage, stateLine);
+
+    bool failed = false;
+    if (lockstep) {
+        // Seeds the stations' sims, and ours, from this very STATE
+        lockstepSim.seed(stateMessage);
+        ScratchLine seed, mechanicalLine, electricalLine;
+        encode(LockstepMessage{lockstepSim.tick()}, *seed);
+        encodeControlsLocked(*mechanicalLine, *electricalLine);
+        for (Player& player : players) {
+            if (!player.connected) continue;
+            for (const string* line : {&*seed, &stateLine, &*mechanicalLine, &*electricalLine}) {
+                if (!player.conn->sendMessage(*line)) failed = true;
+            }
+        }
+        mechanicalChanged = false;
+        electricalChanged = false;
+    } else {
+        for (Player& player : players) {
+            if (player.connected && !player.conn->sendMessage(stateLine)) failed = true;
+        }
+    }
+
+    if (failed) {
+        LOG(LogLevel::Warn) << "[session " << sessionId << "] Warning: Failed to send to one or both clients";
+    }
+}
+
+void Session::encodeControlsLocked(string& mechanicalLine, string& electricalLine) {
+    const Mechanical& mechanical = gameState.mechanical;
+    encode(MechanicalInputMessage{mechanical.gear, mechanical.lever, mechanical.valve, mechanical.dial,
+                                  mechanicalInput.seq},
+           mechanicalLine);
+    encode(ElectricalInputMessage{gameState.electrical.switchA, gameState.electrical.button, electricalInput.seq},
+           electricalLine);
+}
+
+void Session::sendControlsLocked() {
+    // A lockstep STATE already came with them
+    if (lockstep) return;
+    ScratchLine mechanicalLine, electricalLine;
+    encodeControlsLocked(*mechanicalLine, *electricalLine);
+    for (Player& player : players) {
+        if (!player.connected) continue;
+        player.conn->sendMessage(*mechanicalLine);
+        player.conn->sendMessage(*electricalLine);
+    }
+}
+
+void Session::resetGameLocked() {
+    // Reset machine state
+    gameState.mechanical = {"Stopped", "Middle", "Closed", 5};
+    gameState.electrical = {"Off", "Idle"};
+    gameState.machine = {100.0, 200.0};
+    plant.setMechanical(mechanicalStation, gameState.mechanical);
+    plant.setElectrical(electricalStation, gameState.electrical);
+    plant.resetMachines();
+    lockstepSim.setMechanical(gameState.mechanical);
+    lockstepSim.setElectrical(gameState.electrical);
+
+    // Reset game state
+    gameState.timeLeft = 60;
+    gameState.gameActive = false; // Reset to waiting for ready
+    gameState.gameWon = false;
+    gameState.gameFailed = false;
+
+    // Reset ready flags
+    gameState.mechanicalReady = false;
+    gameState.electricalReady = false;
+
+    // Reset play again flags
+    gameState.playAgainRequested = false;
+    gameState.mechanicalWantsReplay = false;
+    gameState.electricalWantsReplay = false;
+
+    setPhaseTimeoutLocked(READY_TIMEOUT, "players never got ready for the replay");
+    LOG(LogLevel::Info) << "[session " << sessionId << "] Game reset! Waiting for players to be ready again...";
+}
+
+void Session::updateGameStateLocked() {
+    PROFILE_ZONE("Session::updateGameState");
+    LOG(LogLevel::Debug) << "[session " << sessionId << "] Before update: Pressure=" << gameState.machine.pressure
+                         << " Temperature=" << gameState.machine.temperature;
+
+    // Rates are cached in the plant and only recomputed when a control changed
+    plant.tick();
+    gameState.machine = plant.machine(mainMachine);
+
+    LOG(LogLevel::Debug) << "[session " << sessionId << "] Re-evaluated machines: " << plant.lastEvaluatedCount()
+                         << ", changes: P=" << plant.pressureRate(mainMachine) << " T=" << plant.temperatureRate(mainMachine)
+                         << ", new Pressure=" << gameState.machine.pressure << " Temperature=" << gameState.machine.temperature;
+
+    if (gameState.electrical.button == "Pressed") {
+        LOG(LogLevel::Debug) << "[session " << sessionId << "] Button pressed: Machine reset to safe values.";
+    }
+
+    // Check win/fail conditions
+    if (plant.anyFailed()) {
+        gameState.gameFailed = true;
+        gameState.gameActive = false;
+    }
+
+    if (plant.allTargetsMet()) {
+        gameState.gameWon = true;
+        gameState.gameActive = false;
+    }
+
+    gameState.timeLeft--;
+    if (gameState.timeLeft <= 0) {
+        gameState.gameActive = false;
+    }
+}
+
+void Session::stepLockstepLocked() {
+    PROFILE_ZONE("Session::stepLockstep");
+    lockstepSim.step();
+    StateMessage stepped;
+    lockstepSim.fill(stepped);
+    gameState.machine = {stepped.pressure, stepped.temperature};
+    gameState.timeLeft = stepped.timeLeft;
+    gameState.gameActive = stepped.gameActive;
+    gameState.gameWon = stepped.gameWon;
+    gameState.gameFailed = stepped.gameFailed;
+
+    // The outcome goes out as a STATE, which the stations take over as is
+    if (!gameState.gameActive) {
+        sendGameStateLocked();
+        return;
+    }
+
+    ScratchLine mechanicalLine, electricalLine, step, hash;
+    if (mechanicalChanged) encode(mechanicalInput, *mechanicalLine);
+    if (electricalChanged) encode(electricalInput, *electricalLine);
+    encode(StepMessage{lockstepSim.tick(), monotonicMicros()}, *step);
+    if (lockstepSim.tick() % HASH_INTERVAL == 0) encode(StateHashMessage{lockstepSim.tick(), lockstepSim.hash()}, *hash);
+
+    bool failed = false;
+    for (Player& player : players) {
+        if (!player.connected) continue;
+        for (const string* line : {&*mechanicalLine, &*electricalLine, &*step, &*hash}) {
+            if (!line->empty() && !player.conn->sendMessage(*line)) failed = true;
+        }
+    }
+    mechanicalChanged = false;
+    electricalChanged = false;
+
+    if (failed) {
+        LOG(LogLevel::Warn) << "[session " << sessionId << "] Warning: Failed to send to one or both clients";
+    }
+}
+
+void Session::scheduleTickLocked(chrono::milliseconds delay) {
+    if (tickScheduled) return;
+    tickScheduled = true;
+    tickDue = Clock::now() + delay;
+    // A pending tick must not keep an ended session (and its sockets) alive
+    weak_ptr<Session> weakSelf = shared_from_this();
+    reactor.runAfter(delay, [weakSelf] {
+        if (shared_ptr<Session> self = weakSelf.lock()) self->tick();
+    });
+}
+
+void Session::tick() {
+    PROFILE_ZONE("Session::tick");
+    lock_guard<mutex> lock(stateMutex);
+    tickScheduled = false;
+    tickLagMs = chrono::duration<double, milli>(Clock::now() - tickDue).count();
+    maxTickLagMs = max(maxTickLagMs, tickLagMs);
+    if (ended || !gameState.gameActive || !gameState.mechanicalReady || !gameState.electricalReady) return;
+    // Paused while a player is away; reattach() restarts the clock
+    if (!players[MECHANICAL].connected || !players[ELECTRICAL].connected) return;
+
+    if (lockstep) {
+        stepLockstepLocked();
+    } else {
+        updateGameStateLocked();
+        sendGameStateLocked();
+    }
+
+    if (gameState.gameActive) {
+        scheduleTickLocked(TICK_INTERVAL);
+        return;
+    }
+
+    if (gameState.gameWon) {
+        LOG(LogLevel::Info) << "[session " << sessionId << "] Game Won! Machine stabilized!";
+    } else if (gameState.gameFailed) {
+        LOG(LogLevel::Info) << "[session " << sessionId << "] Game Failed! Machine failure!";
+    } else {
+        LOG(LogLevel::Info) << "[session " << sessionId << "] Game Over! Time expired!";
+    }
+    setPhaseTimeoutLocked(REPLAY_TIMEOUT, "no replay decision");
+    LOG(LogLevel::Info) << "[session " << sessionId << "] Waiting for players to decide if they want to play again...";
+}
+
+void Session::watchLocked(Role role) {
+    shared_ptr<Session> self = shared_from_this();
+    uint64_t generation = players[role].generation;
+    players[role].watch = players[role].io->watchTransport(*players[role].conn,
+                                                           [self, role, generation] { self->onReadable(role, generation); });
+}
+
+void Session::detachLocked(Role role) {
+    Player& player = players[role];
+    player.io->unwatch(player.watch);
+    player.conn->shutdown();
+    player.connected = false;
+    ++player.generation;
+    LOG(LogLevel::Info) << "[session " << sessionId << "] " << roleName(role) << " player disconnected, holding the match for "
+                        << RESUME_GRACE.count() / 1000 << " s";
+    startGraceLocked(role);
+}
+
+void Session::startGraceLocked(Role role) {
+    Player& player = players[role];
+    uint64_t generation = player.generation;
+    weak_ptr<Session> weakSelf = shared_from_this();
+    player.graceTimer = reactor.runAfter(RESUME_GRACE, [weakSelf, role, generation] {
+        if (shared_ptr<Session> self = weakSelf.lock()) self->graceExpired(role, generation);
+    });
+}
+
+void Session::keepLocked(Role role, const string& line) {
+    if (line.empty()) return;
+    players[role].kept += line;
+    players[role].kept += '\n';
+}
+
+void Session::scheduleHeartbeatLocked() {
+    weak_ptr<Session> weakSelf = shared_from_this();
+    heartbeatTimer = reactor.runAfter(pingInterval(), [weakSelf] {
+        if (shared_ptr<Session> self = weakSelf.lock()) self->heartbeat();
+    });
+}
+
+void Session::setPhaseTimeoutLocked(chrono::milliseconds timeout, const char* reason) {
+    clearPhaseTimeoutLocked();
+    uint64_t expectedPhase = phase;
+    weak_ptr<Session> weakSelf = shared_from_this();
+    phaseDue = Clock::now() + timeout;
+    phaseTimer = reactor.runAfter(timeout, [weakSelf, expectedPhase, reason] {
+        if (shared_ptr<Session> self = weakSelf.lock()) self->phaseExpired(expectedPhase, reason);
+    });
+}
+
+void Session::clearPhaseTimeoutLocked() {
+    if (phaseTimer) reactor.cancel(phaseTimer);
+    phaseTimer = 0;
+    phase++;
+}
+
+void Session::endLocked(const string& reason) {
+    ended = true;
+    gameState.gameActive = false;
+    LOG(LogLevel::Info) << "[session " << sessionId << "] Match over: " << reason;
+
+    // Nothing scheduled matters any more
+    clearPhaseTimeoutLocked();
+    if (heartbeatTimer) reactor.cancel(heartbeatTimer);
+    for (Player& player : players) {
+        if (player.graceTimer) reactor.cancel(player.graceTimer);
+    }
+
+    // Wake the other player's client and stop watching both connections;
+    // the transports themselves close when the last task lets go of us
+    for (Player& player : players) {
+        if (!player.connected) continue;
+        player.io->unwatch(player.watch);
+        player.conn->shutdown();
+    }
+}
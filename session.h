@@ -0,0 +1,285 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "clock_sync.h"
+#include "handoff.h"
+#include "lockstep.h"
+#include "physics.h"
+#include "protocol.h"
+#include "rate_limit.h"
+#include "reactor.h"
+#include "sim_graph.h"
+#include "transport.h"
+
+using namespace std;
+
+struct GameState {
+    Mechanical mechanical;
+    Electrical electrical;
+    Machine machine;
+    double targetPressure;
+    double targetTemperature;
+    int timeLeft;
+    bool gameActive;
+    bool gameWon;
+    bool gameFailed;
+    bool mechanicalReady;
+    bool electricalReady;
+    bool playAgainRequested;
+    bool mechanicalWantsReplay;
+    bool electricalWantsReplay;
+};
+
+// One match between a mechanical and an electrical player. A session owns
+// both connections and has no thread of its own: input handling, ticks and
+// broadcasts all run as short tasks, scheduled by reactors. stateMutex
+// serializes them. Its timers run on the reactor it was created for (its
+// shard); each connection stays with the reactor that accepted it, which
+// is the same one unless the lobby had to pair across shards.
+//
+// Each player gets a resume token (WELCOME|<token>) when the match starts.
+// If a connection drops, the match pauses for RESUME_GRACE; a client that
+// comes back with RESUME|<token> in that time takes its seat again and gets
+// a fresh STATE, with the machine exactly as it was left.
+//
+// Every deadline is a reactor timer, cancelled as soon as it stops
+// mattering: the grace windows, the READY and PLAY_AGAIN timeouts, and a
+// heartbeat every pingInterval(). The heartbeat pings each player (see
+// clock_sync.h), which gives the player's RTT and clock offset for
+// stats(); a player silent for IDLE_TIMEOUT is treated as disconnected, so
+// a half-open connection cannot hold a match. Players' own PINGs are
+// answered too, and STATE carries the server time it was sent at.
+//
+// Each connection has a FloodGuard (rate_limit.h), checked before a line is
+// parsed or stateMutex is taken. Inputs over their limit are merged: only
+// the latest of them is applied, at the end of the read batch, which is all
+// that matters since every input carries the station's whole state. Other
+// messages over their limit are dropped, and a player that keeps it up is
+// disconnected. The guard belongs to the seat, not the connection: a RESUME
+// does not refill its strikes, and after a flood disconnect the seat refuses
+// RESUMEs for FLOOD_COOLDOWN, doubled for every further one. By the third
+// the cooldown outlasts RESUME_GRACE, so a repeat offender loses the seat.
+//
+// With FACTORY_LOCKSTEP=1 a running game is not sent as STATEs: ticks run on
+// a LockstepSim here and on both stations, and each tick only sends the
+// controls that changed and a STEP (see lockstep.h). Every STATE the
+// session still sends, at the start and the end of a game, on a RESUME or
+// when a station reports a DESYNC, reseeds the stations' sims.
+//
+// For the stations' prediction (see GameClient), every STATE echoes the seq
+// of the last MECH and ELEC it includes, and without lockstep each applied
+// input is passed on to the other station straight away, so that both know
+// both sets of controls. The stations also get both at the start, after a
+// reset and on a RESUME.
+//
+// For a zero-downtime restart (see handoff.h) a match moves to a new
+// process between two ticks: freeze() stops it where it stands, handOff()
+// writes it out and detaches both connections, and on the other side the
+// restoring constructor and resumeHandedOff() pick it up from there.
+class Session : public enable_shared_from_this<Session> {
+public:
+    typedef uint64_t Id;
+    typedef function<void(Id)> EndedCallback;
+    typedef array<string, 2> Tokens;
+
+    static const chrono::milliseconds TICK_INTERVAL;
+    static const chrono::milliseconds RESUME_GRACE;
+    static const chrono::milliseconds FLOOD_COOLDOWN;  // no RESUME after a flood disconnect
+    static const chrono::milliseconds IDLE_TIMEOUT;
+    static const chrono::milliseconds READY_TIMEOUT;   // both READY, from the start or a reset
+    static const chrono::milliseconds REPLAY_TIMEOUT;  // both answered PLAY_AGAIN, from game over
+
+    // mechanicalIo and electricalIo watch the connections (see Lobby::Player)
+    Session(Id id, unique_ptr<Transport> mechanical, Reactor& mechanicalIo, unique_ptr<Transport> electrical,
+            Reactor& electricalIo, Reactor& reactor, EndedCallback onEnded);
+    ~Session();
+
+    Session(const Session&) = delete;
+    Session& operator=(const Session&) = delete;
+
+    // Watches both connections and sends the initial state. Backlogs are
+    // lines the players sent before the session existed (see Lobby).
+    void start(const vector<string>& mechanicalBacklog = {}, const vector<string>& electricalBacklog = {});
+    // Shuts both connections down; the session then ends on its own
+    void close();
+
+    // Gives the seat that token belongs to a new connection; false if the
+    // token is not ours or the match is over
+    bool reattach(const string& token, unique_ptr<Transport>& conn, Reactor& io, const vector<string>& backlog);
+
+    // Handing the match over to another process. freeze() ends it here
+    // without a word to the players: no more reads, ticks or timers, and
+    // lines a read task had in hand are kept to go along. Once none of our
+    // tasks can still be running, handOff() fills in the match and detaches
+    // the connections of the players who are connected.
+    struct HandedOffPlayer {
+        bool connected;  // false if away, or if its transport could not be detached
+        DetachedTransport conn;
+        Reactor* io;
+    };
+    void freeze();
+    HandoffMatch handOff(HandedOffPlayer handedOff[2]);
+
+    // The new process's side: the match as handOff() described it, with the
+    // connections restored (null for a player who is away)
+    Session(const HandoffMatch& match, unique_ptr<Transport> mechanical, Reactor& mechanicalIo,
+            unique_ptr<Transport> electrical, Reactor& electricalIo, Reactor& reactor, EndedCallback onEnded);
+    // Watches the connections and carries on: what the players sent before
+    // the handoff is handled first, and timers resume with the time they had
+    // left. Away players get a fresh RESUME_GRACE.
+    void resumeHandedOff(const HandoffMatch& match);
+
+    Id id() const { return sessionId; }
+    const Tokens& resumeTokens() const { return tokens; }
+
+    struct PlayerStats {
+        bool connected;
+        int pongs;               // since the player (re)connected
+        double rttMs;            // smoothed; 0 until the first PONG
+        double rttVariationMs;
+        double clockOffsetMs;    // the client's clock minus ours
+        uint64_t throttled;      // messages over their rate limit, on this connection
+    };
+    struct Stats {
+        Id id;
+        const char* phase;  // "waiting for players", "playing", "won", ...
+        bool gameActive;
+        int timeLeft;
+        double tickLagMs;     // how late the latest tick ran; 0 before the first
+        double maxTickLagMs;  // since the match started
+        PlayerStats mechanical;
+        PlayerStats electrical;
+    };
+    Stats stats();
+
+    // Copy of the game state, for inspection from outside the session
+    GameState snapshot();
+
+    // Operator actions (see AdminSocket). Queued as tasks on the session's
+    // reactor like its ticks, so they wait their turn rather than cut in.
+    // Reset: back to waiting for both players, as after a replay vote.
+    void requestReset();
+    void requestEnd(const string& reason);
+
+    // Flood control over every session since the process started
+    struct FloodTotals {
+        uint64_t merged;       // inputs superseded by a later one before being applied
+        uint64_t dropped;      // other messages over their limit
+        uint64_t disconnects;  // players cut off for flooding
+    };
+    static FloodTotals floodTotals();
+
+    // DESYNCs answered with a reseed, over every session since the process
+    // started; always 0 unless lockstepEnabled()
+    static uint64_t desyncCount();
+
+private:
+    typedef chrono::steady_clock Clock;
+
+    enum Role { MECHANICAL = 0, ELECTRICAL = 1 };
+
+    struct Player {
+        // Shared with the read task of the connection, which may still be
+        // running when a reattach replaces it
+        shared_ptr<Transport> conn;
+        Reactor* io;  // watches conn
+        Reactor::WatchId watch;
+        bool connected;
+        uint64_t generation;  // bumped on every drop and reattach
+        Clock::time_point lastHeard;
+        Reactor::TimerId graceTimer;  // 0 unless away
+        ClockSync clock;              // fed by the heartbeat's PINGs
+        shared_ptr<FloodGuard> flood; // the seat's, used by its connections' read tasks
+        int timesFlooded;             // cut off for flooding so far
+        Clock::time_point floodCooldownEnd;  // no RESUME before this
+        string kept;                  // lines read after freeze(), newline-terminated
+    };
+
+    Id sessionId;
+    Reactor& reactor;
+    EndedCallback onEnded;
+    Player players[2];
+    Tokens tokens;
+
+    GameState gameState;
+    StateMessage stateMessage;  // gameState as sent, and its encoded line,
+    string stateLine;           // both reused for every STATE
+    MechanicalInputMessage mechanicalInput;  // the last input applied from each
+    ElectricalInputMessage electricalInput;  // station, seq included
+    MechanicalInputMessage receivedMechanical;  // decoded into, as a bad line
+    ElectricalInputMessage receivedElectrical;  // may leave it half-written
+    mutex stateMutex;
+    bool ended;
+    bool tickScheduled;
+    Clock::time_point tickDue;  // of the scheduled tick
+    double tickLagMs;
+    double maxTickLagMs;
+    Reactor::TimerId heartbeatTimer;
+    Reactor::TimerId phaseTimer;  // READY or PLAY_AGAIN timeout; 0 while playing
+    Clock::time_point phaseDue;   // of phaseTimer
+    uint64_t phase;               // bumped whenever phaseTimer changes
+
+    // Set by freeze(), with what was left of the tick and phase timers then
+    // (-1 for none)
+    bool frozen;
+    int64_t frozenTickInMs;
+    int64_t frozenPhaseLeftMs;
+
+    // Lockstep mode: the session's copy of the stations' sim, and which of
+    // mechanicalInput and electricalInput still have to go out before the
+    // next STEP
+    bool lockstep;
+    LockstepSim lockstepSim;
+    bool mechanicalChanged;
+    bool electricalChanged;
+
+    // The match runs on a one-machine plant: both stations drive machine 0
+    SimulationGraph plant;
+    SimulationGraph::StationId mechanicalStation;
+    SimulationGraph::StationId electricalStation;
+    SimulationGraph::NodeId mainMachine;
+
+    static const char* roleName(Role role) { return role == MECHANICAL ? "Mechanical" : "Electrical"; }
+
+    void onReadable(Role role, uint64_t generation);
+    // False if the connection was replaced or the match ended meanwhile
+    bool applyMergedInput(Role role, uint64_t generation, const string& input);
+    void graceExpired(Role role, uint64_t generation);
+    void heartbeat();
+    void phaseExpired(uint64_t expectedPhase, const char* reason);
+    void operatorReset();
+    void operatorEnd(const string& reason);
+
+    // The rest run with stateMutex held
+    void handleMessage(Role role, const string& message);
+    void handleMechanicalInput(const string& message);
+    void handleElectricalInput(const string& message);
+    void sendGameStateLocked();
+    // The stations' controls as MECH and ELEC lines, for seeding clients
+    void encodeControlsLocked(string& mechanicalLine, string& electricalLine);
+    void sendControlsLocked();
+    void resetGameLocked();
+    void updateGameStateLocked();
+    // Both of the above for a lockstep tick
+    void stepLockstepLocked();
+    void scheduleTickLocked(chrono::milliseconds delay);
+    void tick();
+    void watchLocked(Role role);
+    void detachLocked(Role role);
+    void startGraceLocked(Role role);
+    void keepLocked(Role role, const string& line);
+    void scheduleHeartbeatLocked();
+    void setPhaseTimeoutLocked(chrono::milliseconds timeout, const char* reason);
+    void clearPhaseTimeoutLocked();
+    void endLocked(const string& reason);
+};
+
+#endif // SESSION_H
@@ -0,0 +1,255 @@
+#include "sim_graph.h"
+#include <iostream>
+using namespace std;
+
+SimulationGraph::SimulationGraph(const PhysicsParams& physics)
+    : params(physics), topologyDirty(false), lastEvaluated(0), failed(false), targetsMet(false) {}
+
+SimulationGraph::StationId SimulationGraph::addMechanicalStation(const Mechanical& initial) {
+    mechanicalStations.push_back({initial, {}, {}});
+    return mechanicalStations.size() - 1;
+}
+
+SimulationGraph::StationId SimulationGraph::addElectricalStation(const Electrical& initial) {
+    electricalStations.push_back({initial, initial.button == "Pressed", {}, {}});
+    return electricalStations.size() - 1;
+}
+
+SimulationGraph::NodeId SimulationGraph::addMachine(const Machine& initial, StationId mechanical, StationId electrical) {
+    NodeId node = pressure.size();
+    pressure.push_back(initial.pressure);
+    temperature.push_back(initial.temperature);
+    ratePressure.push_back(0.0);
+    rateTemperature.push_back(0.0);
+    localPressure.push_back(0.0);
+    localTemperature.push_back(0.0);
+    initialState.push_back(initial);
+    mechanicalOf.push_back(mechanical);
+    electricalOf.push_back(electrical);
+    hasTarget.push_back(0);
+    targetPressure.push_back(0.0);
+    targetTemperature.push_back(0.0);
+    incoming.emplace_back();
+    outgoing.emplace_back();
+    topoRank.push_back(0);
+    localDirty.push_back(1);
+    queued.push_back(0);
+
+    if (mechanical != NO_STATION) mechanicalStations[mechanical].drives.push_back(node);
+    if (electrical != NO_STATION) electricalStations[electrical].drives.push_back(node);
+
+    topologyDirty = true;
+    return node;
+}
+
+void SimulationGraph::setTarget(NodeId node, double pressureTarget, double temperatureTarget) {
+    hasTarget[node] = 1;
+    targetPressure[node] = pressureTarget;
+    targetTemperature[node] = temperatureTarget;
+}
+
+bool SimulationGraph::addLink(NodeId from, NodeId to, double coefficient, Gate gate, StationId gateStation) {
+    NodeId count = pressure.size();
+    if (from < 0 || from >= count || to < 0 || to >= count || from == to) return false;
+    if (gate != Gate::None && gateStation == NO_STATION) return false;
+    if (reaches(to, from)) {
+        cout << "Refusing link " << from << " -> " << to << ": it would create a cycle\n";
+        return false;
+    }
+
+    int index = links.size();
+    links.push_back({from, to, coefficient, gate, gateStation});
+    outgoing[from].push_back(index);
+    incoming[to].push_back(index);
+    if (gate == Gate::Valve) mechanicalStations[gateStation].gates.push_back(index);
+    if (gate == Gate::Breaker) electricalStations[gateStation].gates.push_back(index);
+
+    topologyDirty = true;
+    return true;
+}
+
+void SimulationGraph::setMechanical(StationId station, const Mechanical& controls) {
+    MechanicalStation& entry = mechanicalStations[station];
+    if (entry.controls == controls) return;
+    entry.controls = controls;
+
+    for (NodeId node : entry.drives) markLocalDirty(node);
+    for (int link : entry.gates) enqueue(links[link].to);
+}
+
+void SimulationGraph::setElectrical(StationId station, const Electrical& controls) {
+    ElectricalStation& entry = electricalStations[station];
+    if (entry.controls == controls) return;
+
+    // The button only acts at tick time; only the switch changes rates
+    bool switchChanged = entry.controls.switchA != controls.switchA;
+    entry.controls = controls;
+    entry.pressed = controls.button == "Pressed";
+
+    if (switchChanged) {
+        for (NodeId node : entry.drives) markLocalDirty(node);
+        for (int link : entry.gates) enqueue(links[link].to);
+    }
+}
+
+void SimulationGraph::markLocalDirty(NodeId node) {
+    localDirty[node] = 1;
+    enqueue(node);
+}
+
+void SimulationGraph::enqueue(NodeId node) {
+    if (queued[node]) return;
+    queued[node] = 1;
+    pending.push({topoRank[node], node});
+}
+
+bool SimulationGraph::reaches(NodeId from, NodeId to) const {
+    vector<uint8_t> seen(pressure.size(), 0);
+    vector<NodeId> stack = {from};
+    while (!stack.empty()) {
+        NodeId node = stack.back();
+        stack.pop_back();
+        if (node == to) return true;
+        if (seen[node]) continue;
+        seen[node] = 1;
+        for (int link : outgoing[node]) stack.push_back(links[link].to);
+    }
+    return false;
+}
+
+void SimulationGraph::rebuildTopology() {
+    // Kahn's algorithm; ranks only need to increase along every link
+    size_t count = pressure.size();
+    vector<int> remaining(count);
+    vector<NodeId> ready;
+    for (size_t node = 0; node < count; node++) {
+        remaining[node] = incoming[node].size();
+        if (remaining[node] == 0) ready.push_back(node);
+    }
+
+    int rank = 0;
+    for (size_t i = 0; i < ready.size(); i++) {
+        NodeId node = ready[i];
+        topoRank[node] = rank++;
+        for (int link : outgoing[node]) {
+            if (--remaining[links[link].to] == 0) ready.push_back(links[link].to);
+        }
+    }
+
+    // Structure changes are build-time events; just re-evaluate everything
+    pending = decltype(pending)();
+    for (size_t node = 0; node < count; node++) {
+        queued[node] = 0;
+        markLocalDirty(node);
+    }
+    topologyDirty = false;
+}
+
+double SimulationGraph::gateFactor(const Link& link) const {
+    switch (link.gate) {
+        case Gate::Valve:
+            return valveMultiplier(mechanicalStations[link.gateStation].controls.valve, params) / params.valveOpen;
+        case Gate::Breaker:
+            return electricalStations[link.gateStation].controls.switchA == "On" ? 1.0 : 0.0;
+        default:
+            return 1.0;
+    }
+}
+
+void SimulationGraph::evaluateDirty() {
+    if (topologyDirty) rebuildTopology();
+
+    static const Electrical noElectrical = {"Off", "Idle"};
+    lastEvaluated = 0;
+
+    // Ranks only grow along links, so by the time a machine is popped every
+    // upstream change that could affect it has already been applied
+    while (!pending.empty()) {
+        NodeId node = pending.top().second;
+        pending.pop();
+        queued[node] = 0;
+        lastEvaluated++;
+
+        if (localDirty[node]) {
+            localDirty[node] = 0;
+            if (mechanicalOf[node] == NO_STATION) {
+                localPressure[node] = 0.0;
+                localTemperature[node] = 0.0;
+            } else {
+                const Electrical& electrical = electricalOf[node] == NO_STATION
+                    ? noElectrical : electricalStations[electricalOf[node]].controls;
+                pair<double, double> rates = controlRates(mechanicalStations[mechanicalOf[node]].controls, electrical, params);
+                localPressure[node] = rates.first;
+                localTemperature[node] = rates.second;
+            }
+        }
+
+        double newPressure = localPressure[node];
+        double newTemperature = localTemperature[node];
+        for (int index : incoming[node]) {
+            const Link& link = links[index];
+            double factor = link.coefficient * gateFactor(link);
+            newPressure += factor * ratePressure[link.from];
+            newTemperature += factor * rateTemperature[link.from];
+        }
+
+        if (newPressure != ratePressure[node] || newTemperature != rateTemperature[node]) {
+            ratePressure[node] = newPressure;
+            rateTemperature[node] = newTemperature;
+            for (int index : outgoing[node]) enqueue(links[index].to);
+        }
+    }
+}
+
+void SimulationGraph::tick() {
+    evaluateDirty();
+
+    size_t count = pressure.size();
+    for (size_t node = 0; node < count; node++) {
+        pressure[node] += ratePressure[node];
+        temperature[node] += rateTemperature[node];
+    }
+
+    // Apply button reset if pressed
+    for (const ElectricalStation& station : electricalStations) {
+        if (!station.pressed) continue;
+        for (NodeId node : station.drives) {
+            pressure[node] = params.safePressure;
+            temperature[node] = params.safeTemperature;
+        }
+    }
+
+    evaluateOutcome();
+}
+
+void SimulationGraph::evaluateOutcome() {
+    failed = false;
+    bool anyTarget = false;
+    bool allMet = true;
+
+    size_t count = pressure.size();
+    for (size_t node = 0; node < count; node++) {
+        Machine current = {pressure[node], temperature[node]};
+        if (machineFailed(current, params)) failed = true;
+        if (hasTarget[node]) {
+            anyTarget = true;
+            if (!machineOnTarget(current, targetPressure[node], targetTemperature[node], params)) allMet = false;
+        }
+    }
+    targetsMet = anyTarget && allMet;
+}
+
+void SimulationGraph::resetMachines() {
+    size_t count = pressure.size();
+    for (size_t node = 0; node < count; node++) {
+        pressure[node] = initialState[node].pressure;
+        temperature[node] = initialState[node].temperature;
+    }
+    failed = false;
+    targetsMet = false;
+}
+
+void SimulationGraph::setMachine(NodeId node, const Machine& values) {
+    pressure[node] = values.pressure;
+    temperature[node] = values.temperature;
+}
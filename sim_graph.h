@@ -0,0 +1,133 @@
+#ifndef SIM_GRAPH_H
+#define SIM_GRAPH_H
+
+#include <cstdint>
+#include <queue>
+#include <string>
+#include <vector>
+#include "physics.h"
+
+using namespace std;
+
+// A plant of machines whose pressure/temperature rates feed downstream
+// machines through links (plain pipes, valves or breakers), driven by any
+// number of mechanical and electrical stations.
+//
+// Each machine's per-tick rate is
+//     rate(m) = controlRates(its stations) + sum over links l into m of
+//               l.coefficient * gate(l) * rate(l.from)
+// Rates only change when a control changes, so they are cached and a
+// control change re-evaluates just the machines downstream of it, in
+// topological order. tick() then integrates every machine in one flat pass.
+// Links must form a DAG; addLink() refuses cycles.
+class SimulationGraph {
+public:
+    typedef int NodeId;
+    typedef int StationId;
+    static const StationId NO_STATION = -1;
+
+    enum class Gate {
+        None,     // plain pipe
+        Valve,    // scaled by a mechanical station's valve (Open = 1)
+        Breaker   // passes only while an electrical station's switch is On
+    };
+
+    explicit SimulationGraph(const PhysicsParams& params = DEFAULT_PHYSICS);
+
+    // Building the plant
+    StationId addMechanicalStation(const Mechanical& initial);
+    StationId addElectricalStation(const Electrical& initial);
+    NodeId addMachine(const Machine& initial, StationId mechanical, StationId electrical);
+    void setTarget(NodeId node, double targetPressure, double targetTemperature);
+    bool addLink(NodeId from, NodeId to, double coefficient, Gate gate = Gate::None, StationId gateStation = NO_STATION);
+
+    // Controls; unchanged settings cost nothing
+    void setMechanical(StationId station, const Mechanical& controls);
+    void setElectrical(StationId station, const Electrical& controls);
+    const Mechanical& mechanical(StationId station) const { return mechanicalStations[station].controls; }
+    const Electrical& electrical(StationId station) const { return electricalStations[station].controls; }
+
+    // Re-evaluates dirty rates, integrates, applies button resets
+    void tick();
+    // Machines back to their initial values (rates are kept)
+    void resetMachines();
+    // Overwrites one machine's values, as when a saved match is restored
+    void setMachine(NodeId node, const Machine& values);
+
+    Machine machine(NodeId node) const { return {pressure[node], temperature[node]}; }
+    double pressureRate(NodeId node) const { return ratePressure[node]; }
+    double temperatureRate(NodeId node) const { return rateTemperature[node]; }
+    size_t machineCount() const { return pressure.size(); }
+
+    bool anyFailed() const { return failed; }
+    bool allTargetsMet() const { return targetsMet; }
+
+    // Machines whose rate was recomputed during the last tick
+    size_t lastEvaluatedCount() const { return lastEvaluated; }
+
+private:
+    struct Link {
+        NodeId from;
+        NodeId to;
+        double coefficient;
+        Gate gate;
+        StationId gateStation;
+    };
+
+    struct MechanicalStation {
+        Mechanical controls;
+        vector<NodeId> drives;
+        vector<int> gates;  // link indices
+    };
+
+    struct ElectricalStation {
+        Electrical controls;
+        bool pressed;
+        vector<NodeId> drives;
+        vector<int> gates;
+    };
+
+    PhysicsParams params;
+
+    // Per-machine state, structure of arrays so tick() is one linear sweep
+    vector<double> pressure;
+    vector<double> temperature;
+    vector<double> ratePressure;
+    vector<double> rateTemperature;
+    vector<double> localPressure;      // controlRates() of the machine's own stations
+    vector<double> localTemperature;
+    vector<Machine> initialState;
+    vector<StationId> mechanicalOf;
+    vector<StationId> electricalOf;
+    vector<uint8_t> hasTarget;
+    vector<double> targetPressure;
+    vector<double> targetTemperature;
+
+    vector<Link> links;
+    vector<vector<int>> incoming;   // link indices per machine
+    vector<vector<int>> outgoing;
+
+    vector<MechanicalStation> mechanicalStations;
+    vector<ElectricalStation> electricalStations;
+
+    // Incremental evaluation
+    vector<int> topoRank;
+    bool topologyDirty;
+    vector<uint8_t> localDirty;
+    vector<uint8_t> queued;
+    priority_queue<pair<int, NodeId>, vector<pair<int, NodeId>>, greater<pair<int, NodeId>>> pending;
+    size_t lastEvaluated;
+
+    bool failed;
+    bool targetsMet;
+
+    void markLocalDirty(NodeId node);
+    void enqueue(NodeId node);
+    void rebuildTopology();
+    bool reaches(NodeId from, NodeId to) const;
+    double gateFactor(const Link& link) const;
+    void evaluateDirty();
+    void evaluateOutcome();
+};
+
+#endif // SIM_GRAPH_H
@@ -0,0 +1,72 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+using namespace std;
+
+// Bounded single-producer/single-consumer ring. Exactly one thread may push
+// and exactly one (other) thread may pop; neither side ever blocks or locks.
+// Capacity must be a power of two.
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+private:
+    static constexpr size_t CACHE_LINE = 64;
+
+    // Producer and consumer indices live on separate cache lines, each next
+    // to a cached copy of the other side's index so the common case touches
+    // only lines the thread already owns.
+    alignas(CACHE_LINE) atomic<size_t> head;   // next slot to pop
+    size_t cachedTail;
+    alignas(CACHE_LINE) atomic<size_t> tail;   // next slot to push
+    size_t cachedHead;
+    alignas(CACHE_LINE) T slots[Capacity];
+
+public:
+    SpscQueue() : head(0), cachedTail(0), tail(0), cachedHead(0) {}
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Producer side. Returns false when the ring is full.
+    template <typename Fill>
+    bool pushWith(Fill fill) {
+        size_t t = tail.load(memory_order_relaxed);
+        if (t - cachedHead == Capacity) {
+            cachedHead = head.load(memory_order_acquire);
+            if (t - cachedHead == Capacity) return false;
+        }
+        fill(slots[t & (Capacity - 1)]);
+        tail.store(t + 1, memory_order_release);
+        return true;
+    }
+
+    bool push(const T& value) {
+        return pushWith([&](T& slot) { slot = value; });
+    }
+
+    // Consumer side. Returns false when the ring is empty.
+    template <typename Drain>
+    bool popWith(Drain drain) {
+        size_t h = head.load(memory_order_relaxed);
+        if (h == cachedTail) {
+            cachedTail = tail.load(memory_order_acquire);
+            if (h == cachedTail) return false;
+        }
+        drain(slots[h & (Capacity - 1)]);
+        head.store(h + 1, memory_order_release);
+        return true;
+    }
+
+    bool pop(T& value) {
+        return popWith([&](T& slot) { value = slot; });
+    }
+
+    bool empty() const {
+        return head.load(memory_order_acquire) == tail.load(memory_order_acquire);
+    }
+};
+
+#endif // SPSC_QUEUE_H
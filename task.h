@@ -0,0 +1,131 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include <cstddef>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+using namespace std;
+
+// A void() callable for the executor, the reactor and the timers. Works
+// like function<void()>, except that a callable of up to INLINE_SIZE bytes
+// (a shared_ptr and a couple of ids, say) is kept inside the task instead
+// of on the heap, so queueing a wakeup, copying a watch's callback or
+// scheduling a timer does not allocate. Bigger callables still work, they
+// are boxed on the heap like function<void()> would.
+class InlineTask {
+public:
+    static const size_t INLINE_SIZE = 48;
+
+    InlineTask() noexcept : ops(nullptr) {}
+    InlineTask(nullptr_t) noexcept : ops(nullptr) {}
+
+    template <typename F, typename = typename enable_if<!is_same<typename decay<F>::type, InlineTask>::value>::type>
+    InlineTask(F&& callable) : ops(nullptr) {
+        typedef typename decay<F>::type Callable;
+        typedef typename conditional<fitsInline<Callable>(), Inline<Callable>, Boxed<Callable>>::type Storage;
+        Storage::create(storage, forward<F>(callable));
+        ops = &Storage::OPS;
+    }
+
+    InlineTask(const InlineTask& other) : ops(nullptr) {
+        if (other.ops) other.ops->copy(other.storage, storage);
+        ops = other.ops;
+    }
+
+    InlineTask(InlineTask&& other) noexcept : ops(other.ops) {
+        if (ops) ops->move(other.storage, storage);
+        other.ops = nullptr;
+    }
+
+    ~InlineTask() { reset(); }
+
+    InlineTask& operator=(const InlineTask& other) {
+        if (this != &other) {
+            InlineTask copy(other);
+            *this = move(copy);
+        }
+        return *this;
+    }
+
+    InlineTask& operator=(InlineTask&& other) noexcept {
+        if (this != &other) {
+            reset();
+            if (other.ops) other.ops->move(other.storage, storage);
+            ops = other.ops;
+            other.ops = nullptr;
+        }
+        return *this;
+    }
+
+    InlineTask& operator=(nullptr_t) noexcept {
+        reset();
+        return *this;
+    }
+
+    explicit operator bool() const noexcept { return ops != nullptr; }
+
+    void operator()() const {
+        if (!ops) throw bad_function_call();
+        ops->invoke(storage);
+    }
+
+private:
+    struct Ops {
+        void (*invoke)(void* storage);
+        void (*copy)(const void* from, void* to);
+        void (*move)(void* from, void* to) noexcept;  // and destroys from
+        void (*destroy)(void* storage) noexcept;
+    };
+
+    template <typename F>
+    static constexpr bool fitsInline() {
+        return sizeof(F) <= INLINE_SIZE && alignof(F) <= alignof(max_align_t) &&
+               is_nothrow_move_constructible<F>::value;
+    }
+
+    template <typename F>
+    struct Inline {
+        static F& get(void* storage) { return *static_cast<F*>(storage); }
+        template <typename Arg>
+        static void create(void* storage, Arg&& callable) { new (storage) F(forward<Arg>(callable)); }
+        static void invoke(void* storage) { get(storage)(); }
+        static void copy(const void* from, void* to) { new (to) F(*static_cast<const F*>(from)); }
+        static void move(void* from, void* to) noexcept {
+            new (to) F(std::move(get(from)));
+            get(from).~F();
+        }
+        static void destroy(void* storage) noexcept { get(storage).~F(); }
+        static const Ops OPS;
+    };
+
+    template <typename F>
+    struct Boxed {
+        static F*& get(void* storage) { return *static_cast<F**>(storage); }
+        template <typename Arg>
+        static void create(void* storage, Arg&& callable) { get(storage) = new F(forward<Arg>(callable)); }
+        static void invoke(void* storage) { (*get(storage))(); }
+        static void copy(const void* from, void* to) { get(to) = new F(**static_cast<F* const*>(from)); }
+        static void move(void* from, void* to) noexcept { get(to) = get(from); }
+        static void destroy(void* storage) noexcept { delete get(storage); }
+        static const Ops OPS;
+    };
+
+    const Ops* ops;
+    alignas(max_align_t) mutable unsigned char storage[INLINE_SIZE];
+
+    void reset() noexcept {
+        if (ops) ops->destroy(storage);
+        ops = nullptr;
+    }
+};
+
+template <typename F>
+const InlineTask::Ops InlineTask::Inline<F>::OPS = {&invoke, &copy, &move, &destroy};
+
+template <typename F>
+const InlineTask::Ops InlineTask::Boxed<F>::OPS = {&invoke, &copy, &move, &destroy};
+
+#endif // TASK_H
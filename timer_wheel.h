@@ -0,0 +1,238 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "task.h"
+
+using namespace std;
+
+// Hierarchical timing wheel over integer ticks. Four levels of 256 slots
+// each: level 0 holds timers due within 256 ticks, level 1 within 2^16,
+// level 2 within 2^24 and level 3 the rest. When the current tick crosses a
+// 256-tick boundary, the matching slot one level up is emptied into the
+// level below ("cascading"). Each timer is cascaded at most three times.
+//
+// Timers live in one slab of nodes linked into per-slot lists by index, so
+// schedule() and cancel() are O(1) and allocate nothing once the slab has
+// grown to its working size. advance() costs O(1) per timer fired or
+// cascaded, and skips stretches of empty slots.
+//
+// Not thread-safe; the Reactor guards it.
+class TimerWheel {
+public:
+    typedef uint64_t Id;  // never 0, so 0 can mean "no timer"
+    typedef InlineTask Task;
+
+    TimerWheel() : now(0), active(0), freeList(NIL) {
+        for (uint32_t& head : heads) head = NIL;
+        for (auto& level : occupied) {
+            for (uint64_t& word : level) word = 0;
+        }
+    }
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // Next tick advance() will process
+    uint64_t currentTick() const { return now; }
+    size_t size() const { return active; }
+
+    // Due at tick expiresAt; past ticks fire on the next advance()
+    Id schedule(uint64_t expiresAt, Task task) {
+        uint32_t index;
+        if (freeList != NIL) {
+            index = freeList;
+            freeList = nodes[index].next;
+        } else {
+            index = nodes.size();
+            nodes.emplace_back();
+            nodes[index].generation = 1;
+        }
+
+        Node& node = nodes[index];
+        node.expires = expiresAt < now ? now : expiresAt;
+        node.task = move(task);
+        node.armed = true;
+        link(index);
+        active++;
+        return (uint64_t(node.generation) << 32) | index;
+    }
+
+    // False if the timer already fired or was cancelled
+    bool cancel(Id id) {
+        uint32_t index = uint32_t(id);
+        uint32_t generation = uint32_t(id >> 32);
+        if (index >= nodes.size() || nodes[index].generation != generation || !nodes[index].armed) return false;
+
+        unlink(index);
+        release(index);
+        return true;
+    }
+
+    // Processes every tick up to and including tick, appending the tasks
+    // that came due in expiry order
+    void advance(uint64_t tick, vector<Task>& due) {
+        while (now <= tick) {
+            if (active == 0) {
+                now = tick + 1;
+                break;
+            }
+
+            uint32_t slot = now & SLOT_MASK;
+            if (slot == 0) cascadeAt(now);
+
+            // Nothing left in level 0 before the next boundary: jump there
+            if (nextOccupied(0, slot) < 0) {
+                now = min(tick + 1, (now | SLOT_MASK) + 1);
+                continue;
+            }
+
+            uint32_t index = heads[slot];
+            while (index != NIL) {
+                uint32_t next = nodes[index].next;
+                due.push_back(move(nodes[index].task));
+                release(index);
+                index = next;
+            }
+            heads[slot] = NIL;
+            clearOccupied(0, slot);
+            now++;
+        }
+
+        // Stopping on a boundary: cascade now rather than on the next call,
+        // so ticksUntilNext() sees the block's timers in the level below
+        if ((now & SLOT_MASK) == 0) cascadeAt(now);
+    }
+
+    // Ticks from currentTick() until advance() has work to do: a timer due
+    // in level 0 or a cascade of an occupied slot. Never later than the
+    // earliest expiry; -1 when no timers are pending.
+    int64_t ticksUntilNext() const {
+        if (active == 0) return -1;
+
+        uint32_t slot = now & SLOT_MASK;
+        int found = nextOccupied(0, slot);
+        if (found >= 0) return found - slot;
+
+        // Level 0 slots behind the current one hold the next lap
+        int64_t best = -1;
+        found = nextOccupied(0, 0);
+        if (found >= 0) best = SLOTS - slot + found;
+
+        for (int level = 1; level < LEVELS; level++) {
+            int shift = SLOT_BITS * level;
+            uint32_t current = (now >> shift) & SLOT_MASK;
+            // The current block's slot was cascaded when the block began (on
+            // the way out of advance() if it stopped there), so anything in
+            // it belongs to the next lap
+            int candidate = nextOccupied(level, (current + 1) & SLOT_MASK);
+            if (candidate < 0) candidate = nextOccupied(level, 0);
+            if (candidate < 0) continue;
+
+            uint64_t blocks = (uint32_t(candidate) - current - 1) % SLOTS + 1;
+            int64_t ticks = int64_t(blocks << shift) - int64_t(now & ((uint64_t(1) << shift) - 1));
+            if (best < 0 || ticks < best) best = ticks;
+        }
+        return best;
+    }
+
+private:
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 8;
+    static const uint32_t SLOTS = 1u << SLOT_BITS;
+    static const uint32_t SLOT_MASK = SLOTS - 1;
+    static const uint32_t NIL = UINT32_MAX;
+
+    struct Node {
+        uint64_t expires;
+        uint32_t prev;
+        uint32_t next;         // also links the free list
+        uint32_t generation;   // bumped on release, so stale ids miss
+        uint16_t bucket;       // level * SLOTS + slot
+        bool armed;
+        Task task;
+    };
+
+    vector<Node> nodes;
+    uint32_t heads[LEVELS * SLOTS];
+    uint64_t occupied[LEVELS][SLOTS / 64];
+    uint64_t now;
+    size_t active;
+    uint32_t freeList;
+
+    void link(uint32_t index) {
+        Node& node = nodes[index];
+        uint64_t delta = node.expires - now;
+        int level = delta < (uint64_t(1) << 8) ? 0 : delta < (uint64_t(1) << 16) ? 1 : delta < (uint64_t(1) << 24) ? 2 : 3;
+        // Beyond the top level's reach: park it as far out as possible, it
+        // gets placed again when that slot cascades
+        uint64_t placed = delta < (uint64_t(1) << 32) ? node.expires : now + (uint64_t(1) << 32) - 1;
+        uint32_t slot = (placed >> (SLOT_BITS * level)) & SLOT_MASK;
+
+        uint16_t bucket = level * SLOTS + slot;
+        node.bucket = bucket;
+        node.prev = NIL;
+        node.next = heads[bucket];
+        if (node.next != NIL) nodes[node.next].prev = index;
+        heads[bucket] = index;
+        occupied[level][slot / 64] |= uint64_t(1) << (slot % 64);
+    }
+
+    void unlink(uint32_t index) {
+        Node& node = nodes[index];
+        if (node.prev != NIL) nodes[node.prev].next = node.next;
+        else heads[node.bucket] = node.next;
+        if (node.next != NIL) nodes[node.next].prev = node.prev;
+        if (heads[node.bucket] == NIL) clearOccupied(node.bucket / SLOTS, node.bucket % SLOTS);
+    }
+
+    void release(uint32_t index) {
+        Node& node = nodes[index];
+        node.armed = false;
+        node.task = nullptr;
+        if (++node.generation == 0) node.generation = 1;
+        node.next = freeList;
+        freeList = index;
+        active--;
+    }
+
+    // Called at a 256-tick boundary: empties, top level first, every slot
+    // whose block starts at tick into the levels below. Calling it again for
+    // the same tick finds those slots empty: whatever is scheduled meanwhile
+    // for that block is close enough for a lower level.
+    void cascadeAt(uint64_t tick) {
+        for (int level = LEVELS - 1; level >= 1; level--) {
+            uint64_t span = uint64_t(1) << (SLOT_BITS * level);
+            if (tick & (span - 1)) continue;
+
+            uint32_t slot = (tick >> (SLOT_BITS * level)) & SLOT_MASK;
+            uint16_t bucket = level * SLOTS + slot;
+            uint32_t index = heads[bucket];
+            heads[bucket] = NIL;
+            clearOccupied(level, slot);
+            while (index != NIL) {
+                uint32_t next = nodes[index].next;
+                link(index);
+                index = next;
+            }
+        }
+    }
+
+    void clearOccupied(int level, uint32_t slot) {
+        occupied[level][slot / 64] &= ~(uint64_t(1) << (slot % 64));
+    }
+
+    // First occupied slot of level at or after from; -1 if none
+    int nextOccupied(int level, uint32_t from) const {
+        for (uint32_t word = from / 64; word < SLOTS / 64; word++) {
+            uint64_t bits = occupied[level][word];
+            if (word == from / 64) bits &= ~uint64_t(0) << (from % 64);
+            if (bits) return word * 64 + __builtin_ctzll(bits);
+        }
+        return -1;
+    }
+};
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,157 @@
+// Checks TimerWheel against a brute-force list of deadlines: every timer
+// fires on its own tick, and ticksUntilNext() never points past the earliest
+// pending one (the reactor sleeps that long). Run with "make test".
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include "timer_wheel.h"
+
+using namespace std;
+
+static int failures = 0;
+
+#define CHECK(condition, ...)                 \
+    do {                                      \
+        if (!(condition)) {                   \
+            fprintf(stderr, "FAIL: " __VA_ARGS__); \
+            fprintf(stderr, "\n");            \
+            failures++;                       \
+        }                                     \
+    } while (0)
+
+class Checked {
+public:
+    TimerWheel wheel;
+    multimap<uint64_t, TimerWheel::Id> pending;  // expiry -> id
+    uint64_t fired = 0;
+
+    void schedule(uint64_t expiresAt) {
+        uint64_t due = max(expiresAt, wheel.currentTick());
+        TimerWheel::Id id = wheel.schedule(expiresAt, [this, due] {
+            CHECK(firingTick == due, "timer due at %llu fired at %llu", (unsigned long long)due,
+                  (unsigned long long)firingTick);
+            fired++;
+        });
+        pending.emplace(due, id);
+    }
+
+    void cancelAny(mt19937_64& random) {
+        if (pending.empty()) return;
+        auto it = pending.begin();
+        advanceIterator(it, random() % pending.size());
+        CHECK(wheel.cancel(it->second), "cancel of a pending timer failed");
+        pending.erase(it);
+    }
+
+    // One tick at a time past the first, so each fire can be checked
+    // against the tick it happened on
+    void advance(uint64_t tick) {
+        vector<TimerWheel::Task> due;
+        while (wheel.currentTick() <= tick) {
+            uint64_t step = wheel.currentTick();
+            if (!pending.empty() && pending.begin()->first > step) step = min(tick, pending.begin()->first - 1);
+            firingTick = step;
+            wheel.advance(step, due);
+            for (TimerWheel::Task& task : due) task();
+            due.clear();
+            while (!pending.empty() && pending.begin()->first <= step) pending.erase(pending.begin());
+        }
+    }
+
+    // Same, but one advance() call for the whole stretch, the way the
+    // reactor calls it after a long sleep
+    void jump(uint64_t tick) {
+        CHECK(pending.empty() || pending.begin()->first > tick, "jump over a pending timer");
+        vector<TimerWheel::Task> due;
+        wheel.advance(tick, due);
+        CHECK(due.empty(), "jump fired %zu timers", due.size());
+    }
+
+    void checkNext(const char* context) {
+        int64_t next = wheel.ticksUntilNext();
+        if (pending.empty()) {
+            CHECK(next == -1, "%s: nothing pending, ticksUntilNext() = %lld", context, (long long)next);
+            return;
+        }
+        uint64_t earliest = pending.begin()->first - wheel.currentTick();
+        CHECK(next >= 0 && uint64_t(next) <= earliest, "%s: now %llu, earliest in %llu, ticksUntilNext() = %lld",
+              context, (unsigned long long)wheel.currentTick(), (unsigned long long)earliest, (long long)next);
+    }
+
+private:
+    uint64_t firingTick = 0;
+
+    template <typename It>
+    static void advanceIterator(It& it, size_t count) {
+        while (count--) ++it;
+    }
+};
+
+// advance() stopping right on a block boundary, before that block's cascade
+static void boundaries() {
+    const uint64_t spans[] = {1u << 8, 1u << 16, 1u << 24};
+    for (uint64_t span : spans) {
+        for (uint64_t past : {uint64_t(0), uint64_t(1), uint64_t(44), uint64_t(255)}) {
+            Checked checked;
+            checked.schedule(span + past);
+            checked.jump(span - 1);
+            checked.checkNext("deadline past a boundary");
+            checked.advance(span + past);
+            CHECK(checked.fired == 1, "deadline %llu did not fire", (unsigned long long)(span + past));
+        }
+    }
+
+    // The repro: due at 300, advance(255) leaves now at 256
+    Checked checked;
+    checked.schedule(300);
+    checked.jump(255);
+    CHECK(checked.wheel.ticksUntilNext() == 44, "schedule(300); advance(255): ticksUntilNext() = %lld",
+          (long long)checked.wheel.ticksUntilNext());
+}
+
+static void randomized() {
+    mt19937_64 random(12345);
+    for (int round = 0; round < 200; round++) {
+        Checked checked;
+        for (int step = 0; step < 400; step++) {
+            uint64_t now = checked.wheel.currentTick();
+            // Deadlines within each level's reach, some of them just across
+            // a level-1 or level-2 boundary
+            uint64_t reach = uint64_t(1) << (8 * (1 + random() % 3));
+            uint64_t boundary = (now | (reach - 1)) + 1;
+            uint64_t expiresAt = random() % 2 ? now + random() % reach : boundary - 8 + random() % 16;
+            switch (random() % 4) {
+            case 0:
+            case 1:
+                checked.schedule(expiresAt);
+                break;
+            case 2:
+                checked.cancelAny(random);
+                break;
+            default: {
+                // Up to the next deadline or a boundary, in one call
+                uint64_t limit = checked.pending.empty() ? boundary : min(boundary, checked.pending.begin()->first);
+                if (limit > now) checked.jump(now + random() % (limit - now));
+                break;
+            }
+            }
+            checked.checkNext("randomized");
+            int64_t next = checked.wheel.ticksUntilNext();
+            if (next > 0 && random() % 3 == 0) checked.advance(now + next);
+            else if (random() % 4 == 0) checked.advance(now + random() % 600);
+            checked.checkNext("randomized, after advance");
+        }
+    }
+}
+
+int main() {
+    boundaries();
+    randomized();
+    if (failures) {
+        fprintf(stderr, "%d checks failed\n", failures);
+        return 1;
+    }
+    printf("timer wheel: all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,677 @@
+#include "transport.h"
+#include "spsc_queue.h"
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/futex.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <unistd.h>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+using namespace std;
+
+// Anything longer than this without a newline is not our protocol
+const size_t MAX_LINE_LENGTH = 64 * 1024;
+
+bool Transport::receiveMessage(string& message) {
+    while (true) {
+        RecvStatus status = tryReceive(message);
+        if (status == RecvStatus::Message) return true;
+        if (status == RecvStatus::Closed) return false;
+
+        pollfd pfd = {readinessFd(), POLLIN, 0};
+        if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+            perror("poll failed");
+            return false;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// TCP
+
+SocketTransport::SocketTransport(int socketFd, const string& unread) : fd(socketFd), inbound(unread), consumed(0) {}
+
+SocketTransport::~SocketTransport() {
+    if (fd != -1) close(fd);
+}
+
+bool SocketTransport::sendMessage(const string& message) {
+    // Gather the newline instead of building a second string
+    char newline = '\n';
+    iovec parts[2] = {
+        {const_cast<char*>(message.data()), message.size()},
+        {&newline, 1}
+    };
+    msghdr msg = {};
+    msg.msg_iov = parts;
+    msg.msg_iovlen = 2;
+
+    size_t remaining = message.size() + 1;
+    while (remaining > 0) {
+        ssize_t sent = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        remaining -= sent;
+
+        // Partial send: skip what already went out
+        while (sent > 0 && msg.msg_iovlen > 0) {
+            size_t step = min((size_t)sent, msg.msg_iov->iov_len);
+            msg.msg_iov->iov_base = static_cast<char*>(msg.msg_iov->iov_base) + step;
+            msg.msg_iov->iov_len -= step;
+            sent -= step;
+            if (msg.msg_iov->iov_len == 0) {
+                msg.msg_iov++;
+                msg.msg_iovlen--;
+            }
+        }
+    }
+    return true;
+}
+
+RecvStatus SocketTransport::tryReceive(string& message) {
+    size_t newline = inbound.find('\n', consumed);
+    if (newline == string::npos) {
+        inbound.erase(0, consumed);
+        consumed = 0;
+
+        char buffer[4096];
+        ssize_t bytesReceived = recv(fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+        if (bytesReceived == 0) {
+            return RecvStatus::Closed;
+        }
+        if (bytesReceived < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return RecvStatus::WouldBlock;
+            }
+            perror("recv failed");
+            return RecvStatus::Closed;
+        }
+
+        inbound.append(buffer, bytesReceived);
+        newline = inbound.find('\n');
+        if (newline == string::npos) {
+            if (inbound.size() > MAX_LINE_LENGTH) {
+                cout << "Dropping connection: message exceeds " << MAX_LINE_LENGTH << " bytes\n";
+                return RecvStatus::Closed;
+            }
+            return RecvStatus::WouldBlock;
+        }
+    }
+
+    message.assign(inbound, consumed, newline - consumed);
+    consumed = newline + 1;
+    return RecvStatus::Message;
+}
+
+void SocketTransport::shutdown() {
+    if (fd != -1) ::shutdown(fd, SHUT_RDWR);
+}
+
+bool SocketTransport::detach(DetachedTransport& out) {
+    if (fd == -1) return false;
+    out.kind = "tcp";
+    out.fds.assign(1, fd);
+    out.unread.assign(inbound, consumed, string::npos);
+    fd = -1;
+    inbound.clear();
+    consumed = 0;
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Ring slots shared by the loopback and shared-memory transports
+
+// Fixed-size slots so a message never allocates on its way through a ring
+const size_t MESSAGE_SLOT_SIZE = 256;
+const size_t MESSAGE_QUEUE_DEPTH = 256;
+
+// How many times a blocked receiver re-checks its ring before sleeping
+const int RING_SPIN_TRIES = 2000;
+
+struct MessageSlot {
+    uint32_t length;
+    char data[MESSAGE_SLOT_SIZE - sizeof(uint32_t)];
+};
+
+typedef SpscQueue<MessageSlot, MESSAGE_QUEUE_DEPTH> MessageRing;
+
+static bool fitsInSlot(const string& message) {
+    if (message.size() > sizeof(MessageSlot::data)) {
+        cout << "Message too large for a ring slot (" << message.size() << " bytes)\n";
+        return false;
+    }
+    return true;
+}
+
+static bool popSlot(MessageRing& ring, string& message) {
+    return ring.popWith([&](MessageSlot& slot) {
+        message.assign(slot.data, slot.length);
+    });
+}
+
+// Pushes, yielding while the ring is full; gives up once the ring is closed
+template <typename ClosedFlag>
+static bool pushSlot(MessageRing& ring, const string& message, const ClosedFlag& closed) {
+    auto fill = [&](MessageSlot& slot) {
+        slot.length = message.size();
+        memcpy(slot.data, message.data(), message.size());
+    };
+    while (!ring.pushWith(fill)) {
+        // Ring full: the receiver is behind, give it the CPU
+        if (closed.load(memory_order_acquire)) return false;
+        sched_yield();
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// In-process loopback
+
+// One direction of a loopback pair. The receiver "arms" the eventfd before
+// going to sleep; the sender only pays for the eventfd write when armed.
+struct LoopbackDirection {
+    MessageRing queue;
+    atomic<bool> armed;
+    atomic<bool> closed;
+    int eventFd;
+
+    LoopbackDirection() : armed(false), closed(false) {
+        eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    }
+    ~LoopbackDirection() {
+        if (eventFd != -1) close(eventFd);
+    }
+
+    void wake() {
+        uint64_t one = 1;
+        ssize_t written = write(eventFd, &one, sizeof(one));
+        (void)written;
+    }
+};
+
+struct LoopbackChannel {
+    LoopbackDirection toFirst;
+    LoopbackDirection toSecond;
+};
+
+class LoopbackTransport : public Transport {
+private:
+    shared_ptr<LoopbackChannel> channel;
+    LoopbackDirection* inbound;
+    LoopbackDirection* outbound;
+
+    bool popMessage(string& message) {
+        return popSlot(inbound->queue, message);
+    }
+
+public:
+    LoopbackTransport(shared_ptr<LoopbackChannel> shared, LoopbackDirection* in, LoopbackDirection* out)
+        : channel(shared), inbound(in), outbound(out) {}
+
+    ~LoopbackTransport() override {
+        shutdown();
+    }
+
+    bool sendMessage(const string& message) override {
+        if (!fitsInSlot(message)) return false;
+        if (outbound->closed.load(memory_order_acquire)) return false;
+        if (!pushSlot(outbound->queue, message, outbound->closed)) return false;
+
+        // Pairs with the fence in tryReceive: either we see the receiver
+        // armed, or it sees our message on its second look
+        atomic_thread_fence(memory_order_seq_cst);
+        if (outbound->armed.exchange(false)) {
+            outbound->wake();
+        }
+        return true;
+    }
+
+    RecvStatus tryReceive(string& message) override {
+        // Read closed first: everything pushed before the close is already
+        // visible, so an empty ring afterwards really is the end
+        bool wasClosed = inbound->closed.load(memory_order_acquire);
+        if (popMessage(message)) return RecvStatus::Message;
+        if (wasClosed) return RecvStatus::Closed;
+
+        // Clear any stale wakeup, arm, then look once more so a message
+        // pushed between the pop and the arm is not slept through
+        uint64_t counter;
+        ssize_t drained = read(inbound->eventFd, &counter, sizeof(counter));
+        (void)drained;
+        inbound->armed.store(true);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (popMessage(message)) return RecvStatus::Message;
+        return RecvStatus::WouldBlock;
+    }
+
+    bool receiveMessage(string& message) override {
+        // Messages usually follow each other closely; catch them without a syscall
+        for (int i = 0; i < RING_SPIN_TRIES; i++) {
+            if (popMessage(message)) return true;
+            if (inbound->closed.load(memory_order_acquire)) break;
+        }
+        return Transport::receiveMessage(message);
+    }
+
+    int readinessFd() const override { return inbound->eventFd; }
+
+    void shutdown() override {
+        outbound->closed.store(true, memory_order_release);
+        outbound->wake();
+        inbound->closed.store(true, memory_order_release);
+        inbound->wake();
+    }
+
+    const char* kind() const override { return "loopback"; }
+};
+
+pair<unique_ptr<Transport>, unique_ptr<Transport>> makeLoopbackPair() {
+    shared_ptr<LoopbackChannel> channel(new LoopbackChannel);
+    unique_ptr<Transport> first(new LoopbackTransport(channel, &channel->toFirst, &channel->toSecond));
+    unique_ptr<Transport> second(new LoopbackTransport(channel, &channel->toSecond, &channel->toFirst));
+    return make_pair(move(first), move(second));
+}
+
+// ---------------------------------------------------------------------------
+// Shared memory between processes on one host
+//
+// Both ends start out on plain TCP. When the server accepts a connection
+// whose peer address is its own, it creates a segment in /dev/shm and offers
+// it in-band; the switch-over is ordered on each TCP direction:
+//
+//   server -> client   SHM_OFFER|/factory-<pid>-<n>
+//   client -> server   SHM_ACCEPT      (client sends on the ring from here on)
+//   server -> client   SHM_SWITCH      (server sends on the ring from here on)
+//
+// A client that cannot map the segment answers SHM_REJECT and both sides stay
+// on TCP. Once switched, the TCP socket only carries liveness: a peer that
+// dies without closing its ring still shows up as a closed socket, and an
+// event-driven receiver (watchReadiness()) is rung with an empty line on it.
+
+const uint32_t SHM_MAGIC = 0x464d5348;  // "HSMF"
+const uint32_t SHM_VERSION = 2;
+
+// Values of a direction's armed word: how the sender must wake the receiver
+const uint32_t SHM_AWAKE = 0;
+const uint32_t SHM_FUTEX = 1;     // asleep in futexWait()
+const uint32_t SHM_DOORBELL = 2;  // waiting on its TCP socket in an event loop
+
+const int SHM_LIVENESS_CHECK_MS = 100;
+
+struct ShmDirection {
+    MessageRing queue;
+    alignas(64) atomic<uint32_t> armed;
+    atomic<uint32_t> closed;
+};
+
+struct ShmSegment {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t segmentSize;
+    ShmDirection toServer;
+    ShmDirection toClient;
+};
+
+static_assert(sizeof(atomic<uint32_t>) == sizeof(uint32_t) && atomic<uint32_t>::is_always_lock_free,
+              "futex words must be plain lock-free 32-bit integers");
+
+static long futexWait(atomic<uint32_t>& word, uint32_t expected, int timeoutMs) {
+    timespec timeout = {timeoutMs / 1000, (timeoutMs % 1000) * 1000000L};
+    return syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+}
+
+static void futexWake(atomic<uint32_t>& word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+}
+
+// True when both ends of a connected socket share an address, i.e. the peer
+// runs on this host (127.0.0.1 or one of our own interface addresses)
+static bool peerIsLocal(int fd) {
+    sockaddr_in local, peer;
+    socklen_t localLen = sizeof(local), peerLen = sizeof(peer);
+    if (getsockname(fd, (sockaddr*)&local, &localLen) < 0 || getpeername(fd, (sockaddr*)&peer, &peerLen) < 0) {
+        return false;
+    }
+    if (local.sin_family != AF_INET || peer.sin_family != AF_INET) return false;
+    return local.sin_addr.s_addr == peer.sin_addr.s_addr;
+}
+
+// FACTORY_SHM=0 forces plain TCP even for local peers
+static bool sharedMemoryEnabled() {
+    const char* setting = getenv("FACTORY_SHM");
+    return !setting || string(setting) != "0";
+}
+
+class ShmTransport : public Transport {
+private:
+    SocketTransport tcp;
+    bool isServer;
+    string segmentName;
+    int segmentFd;  // server side, kept so a handoff can pass the segment on
+    ShmSegment* segment;
+    ShmDirection* inbound;
+    ShmDirection* outbound;
+
+    // Serializes senders with the switch-over, which happens on the receiving thread
+    mutex sendMutex;
+    bool sendViaShm;
+    bool recvViaShm;
+    bool doorbell;
+
+    bool mapSegment(int fd) {
+        void* mapping = mmap(nullptr, sizeof(ShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapping == MAP_FAILED) {
+            perror("mmap shared memory failed");
+            return false;
+        }
+        segment = static_cast<ShmSegment*>(mapping);
+        inbound = isServer ? &segment->toServer : &segment->toClient;
+        outbound = isServer ? &segment->toClient : &segment->toServer;
+        return true;
+    }
+
+    void unmapSegment() {
+        if (segment) munmap(segment, sizeof(ShmSegment));
+        segment = nullptr;
+        inbound = outbound = nullptr;
+    }
+
+    void unlinkSegment() {
+        if (isServer && !segmentName.empty()) {
+            shm_unlink(segmentName.c_str());
+            segmentName.clear();
+        }
+    }
+
+    bool openOffered(const string& name) {
+        int fd = shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+        if (fd < 0) {
+            perror("shm_open offered segment failed");
+            return false;
+        }
+        bool mapped = mapSegment(fd);
+        close(fd);
+        if (mapped && (segment->magic != SHM_MAGIC || segment->version != SHM_VERSION ||
+                       segment->segmentSize != sizeof(ShmSegment))) {
+            cout << "Shared memory segment " << name << " is from another build, staying on TCP\n";
+            unmapSegment();
+            return false;
+        }
+        return mapped;
+    }
+
+    // Handles the in-band switch-over lines; true if the line was one of them
+    bool handleControl(const string& line) {
+        if (isServer && line == "SHM_ACCEPT") {
+            recvViaShm = true;
+            lock_guard<mutex> lock(sendMutex);
+            tcp.sendMessage("SHM_SWITCH");
+            sendViaShm = true;
+            unlinkSegment();  // both sides have it mapped, nothing left to find by name
+            return true;
+        }
+        if (isServer && line == "SHM_REJECT") {
+            unlinkSegment();
+            unmapSegment();
+            close(segmentFd);
+            segmentFd = -1;
+            return true;
+        }
+        if (!isServer && line.compare(0, 10, "SHM_OFFER|") == 0) {
+            bool opened = openOffered(line.substr(10));
+            lock_guard<mutex> lock(sendMutex);
+            tcp.sendMessage(opened ? "SHM_ACCEPT" : "SHM_REJECT");
+            sendViaShm = opened;
+            return true;
+        }
+        if (!isServer && line == "SHM_SWITCH") {
+            recvViaShm = true;
+            return true;
+        }
+        return false;
+    }
+
+public:
+    ShmTransport(int fd, bool serverSide, const string& unread = string())
+        : tcp(fd, unread), isServer(serverSide), segmentFd(-1), segment(nullptr), inbound(nullptr), outbound(nullptr),
+          sendViaShm(false), recvViaShm(false), doorbell(false) {}
+
+    ~ShmTransport() override {
+        if (segment) shutdown();
+        unlinkSegment();
+        unmapSegment();
+        if (segmentFd != -1) close(segmentFd);
+    }
+
+    // Server side: create the segment and offer it to the client
+    bool offer() {
+        static atomic<unsigned> segmentCounter(0);
+        string name = "/factory-" + to_string(getpid()) + "-" + to_string(segmentCounter++);
+
+        int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            perror("shm_open failed");
+            return false;
+        }
+        segmentName = name;
+        if (ftruncate(fd, sizeof(ShmSegment)) < 0 || !mapSegment(fd)) {
+            perror("sizing shared memory failed");
+            close(fd);
+            unlinkSegment();
+            return false;
+        }
+        segmentFd = fd;
+
+        // The mapping is zero-filled; construct the rings in place
+        new (&segment->toServer.queue) MessageRing();
+        new (&segment->toClient.queue) MessageRing();
+        segment->toServer.armed = segment->toClient.armed = SHM_AWAKE;
+        segment->toServer.closed = segment->toClient.closed = 0;
+        segment->segmentSize = sizeof(ShmSegment);
+        segment->version = SHM_VERSION;
+        segment->magic = SHM_MAGIC;
+
+        lock_guard<mutex> lock(sendMutex);
+        return tcp.sendMessage("SHM_OFFER|" + name);
+    }
+
+    // Server side, in the process a connection was handed to along with its
+    // segment: switched, or with the offer still unanswered
+    bool adoptSegment(int fd, bool switched) {
+        segmentFd = fd;
+        if (!mapSegment(fd)) return false;
+        if (segment->magic != SHM_MAGIC || segment->version != SHM_VERSION ||
+            segment->segmentSize != sizeof(ShmSegment)) {
+            cout << "Handed-over shared memory segment is from another build\n";
+            unmapSegment();
+            return false;
+        }
+        recvViaShm = switched;
+        sendViaShm = switched;
+        return true;
+    }
+
+    bool sendMessage(const string& message) override {
+        lock_guard<mutex> lock(sendMutex);
+        if (!sendViaShm) return tcp.sendMessage(message);
+
+        if (!fitsInSlot(message)) return false;
+        if (outbound->closed.load(memory_order_acquire)) return false;
+        if (!pushSlot(outbound->queue, message, outbound->closed)) return false;
+
+        atomic_thread_fence(memory_order_seq_cst);
+        uint32_t waiting = outbound->armed.exchange(SHM_AWAKE);
+        if (waiting == SHM_FUTEX) futexWake(outbound->armed);
+        else if (waiting == SHM_DOORBELL) tcp.sendMessage("");
+        return true;
+    }
+
+    RecvStatus tryReceive(string& message) override {
+        while (!recvViaShm) {
+            RecvStatus status = tcp.tryReceive(message);
+            if (status != RecvStatus::Message || !handleControl(message)) return status;
+        }
+
+        bool wasClosed = inbound->closed.load(memory_order_acquire);
+        if (popSlot(inbound->queue, message)) return RecvStatus::Message;
+        if (wasClosed) return RecvStatus::Closed;
+
+        // Only doorbells arrive on TCP any more; EOF there means the peer died
+        string stray;
+        RecvStatus tcpStatus;
+        while ((tcpStatus = tcp.tryReceive(stray)) == RecvStatus::Message) {}
+        if (tcpStatus == RecvStatus::Closed) return RecvStatus::Closed;
+
+        inbound->armed.store(doorbell ? SHM_DOORBELL : SHM_FUTEX);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (popSlot(inbound->queue, message)) {
+            inbound->armed.store(SHM_AWAKE);
+            return RecvStatus::Message;
+        }
+        return RecvStatus::WouldBlock;
+    }
+
+    bool receiveMessage(string& message) override {
+        while (true) {
+            if (recvViaShm) {
+                for (int i = 0; i < RING_SPIN_TRIES; i++) {
+                    if (popSlot(inbound->queue, message)) return true;
+                    if (inbound->closed.load(memory_order_acquire)) break;
+                }
+            }
+
+            RecvStatus status = tryReceive(message);
+            if (status == RecvStatus::Message) return true;
+            if (status == RecvStatus::Closed) return false;
+
+            if (recvViaShm) {
+                // Time out now and then so a crashed peer is noticed via TCP
+                futexWait(inbound->armed, SHM_FUTEX, SHM_LIVENESS_CHECK_MS);
+            } else {
+                pollfd pfd = {tcp.readinessFd(), POLLIN, 0};
+                if (poll(&pfd, 1, -1) < 0 && errno != EINTR) {
+                    perror("poll failed");
+                    return false;
+                }
+            }
+        }
+    }
+
+    // Readable on handshake traffic and on peer death. Ring traffic is
+    // signalled through the futex in receiveMessage(), or after
+    // watchReadiness() through a doorbell line on this socket.
+    int readinessFd() const override { return tcp.readinessFd(); }
+
+    void watchReadiness() override { doorbell = true; }
+
+    void shutdown() override {
+        if (segment) {
+            outbound->closed.store(1, memory_order_release);
+            futexWake(outbound->armed);
+            inbound->closed.store(1, memory_order_release);
+            futexWake(inbound->armed);
+        }
+        tcp.shutdown();
+    }
+
+    const char* kind() const override { return recvViaShm ? "shm" : "tcp"; }
+
+    // A switched connection goes as "shm" with its segment. So does one
+    // whose offer is unanswered ("shm-offer"), after its name is withdrawn:
+    // a client that has not opened the segment yet then fails to and
+    // answers SHM_REJECT, one that has answers SHM_ACCEPT, and either way
+    // the answer reaches the new owner, who still has the segment. Only
+    // the moment inside handleControl() where the two directions disagree
+    // cannot move, and no receive is in progress during a detach.
+    bool detach(DetachedTransport& out) override {
+        lock_guard<mutex> lock(sendMutex);
+        bool switched = recvViaShm && sendViaShm;
+        bool offered = !recvViaShm && !sendViaShm;
+        if (segment && (segmentFd == -1 || !(switched || offered))) return false;
+        if (!tcp.detach(out)) return false;
+        if (segment) {
+            unlinkSegment();
+            out.kind = switched ? "shm" : "shm-offer";
+            out.fds.push_back(segmentFd);
+            segmentFd = -1;
+            unmapSegment();  // the rings stay open for the new owner
+        }
+        sendViaShm = false;
+        recvViaShm = false;
+        return true;
+    }
+};
+
+bool sharedMemoryCandidate(int fd) {
+    return sharedMemoryEnabled() && peerIsLocal(fd);
+}
+
+unique_ptr<Transport> acceptTransport(int fd) {
+    if (sharedMemoryCandidate(fd)) {
+        // If the segment cannot be created no offer goes out and the
+        // transport simply stays on TCP
+        ShmTransport* shm = new ShmTransport(fd, true);
+        unique_ptr<Transport> transport(shm);
+        shm->offer();
+        return transport;
+    }
+    return unique_ptr<Transport>(new SocketTransport(fd));
+}
+
+unique_ptr<Transport> restoreTransport(DetachedTransport& detached) {
+    if (detached.kind == "tcp" && detached.fds.size() == 1) {
+        return unique_ptr<Transport>(new SocketTransport(detached.fds[0], detached.unread));
+    }
+    if ((detached.kind == "shm" || detached.kind == "shm-offer") && detached.fds.size() == 2) {
+        ShmTransport* shm = new ShmTransport(detached.fds[0], true, detached.unread);
+        unique_ptr<Transport> transport(shm);
+        if (shm->adoptSegment(detached.fds[1], detached.kind == "shm")) return transport;
+        return nullptr;  // closes both
+    }
+    for (int fd : detached.fds) close(fd);
+    return nullptr;
+}
+
+unique_ptr<Transport> connectTcp(const string& serverIP, int port) {
+    int clientSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (clientSocket < 0) {
+        perror("socket creation failed");
+        return nullptr;
+    }
+
+    sockaddr_in serverAddr;
+    serverAddr.sin_family = AF_INET;
+    if (inet_pton(AF_INET, serverIP.c_str(), &serverAddr.sin_addr) <= 0) {
+        perror("invalid address");
+        close(clientSocket);
+        return nullptr;
+    }
+    serverAddr.sin_port = htons(port);
+
+    if (connect(clientSocket, (sockaddr*)&serverAddr, sizeof(serverAddr)) < 0) {
+        perror("connection failed");
+        close(clientSocket);
+        return nullptr;
+    }
+
+    if (sharedMemoryEnabled() && peerIsLocal(clientSocket)) {
+        // Waits for the server's SHM_OFFER; a server that never offers is fine
+        return unique_ptr<Transport>(new ShmTransport(clientSocket, false));
+    }
+    return unique_ptr<Transport>(new SocketTransport(clientSocket));
+}
@@ -0,0 +1,103 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+enum class RecvStatus {
+    Message,     // one complete message was returned
+    WouldBlock,  // nothing buffered; readinessFd() turns readable when that changes
+    Closed       // peer went away (or shutdown() was called)
+};
+
+// A connection on its way to another process (see Transport::detach())
+struct DetachedTransport {
+    string kind;      // "tcp", "shm", or "shm-offer" with the offer unanswered
+    vector<int> fds;  // the socket, then the segment for either shm kind
+    string unread;    // received but not yet returned by tryReceive()
+};
+
+// Message-oriented connection between the server and one client. Messages
+// are single protocol lines ("STATE|...", "MECH|...") without the trailing
+// newline; each transport adds whatever framing it needs.
+class Transport {
+public:
+    virtual ~Transport() {}
+
+    virtual bool sendMessage(const string& message) = 0;
+
+    // Never blocks
+    virtual RecvStatus tryReceive(string& message) = 0;
+
+    // Blocks until a message arrives; false once the connection is closed
+    virtual bool receiveMessage(string& message);
+
+    // Pollable fd that is readable whenever tryReceive() may make progress
+    virtual int readinessFd() const = 0;
+
+    // Called once by an event loop that waits on readinessFd() instead of
+    // calling receiveMessage(). Transports that normally wake a blocked
+    // receiver some other way switch to signalling through readinessFd().
+    virtual void watchReadiness() {}
+
+    // Wakes any blocked receiver on either end
+    virtual void shutdown() = 0;
+
+    virtual const char* kind() const = 0;
+
+    // Gives the connection up so that another process can carry on with it
+    // (restoreTransport()); false if this transport cannot, which leaves it
+    // as it was. Whatever was queued to send has gone out by the time it
+    // returns. Afterwards the transport is inert: sends fail, and neither
+    // shutdown() nor the destructor touches the descriptors, which now
+    // belong to the caller. No receive may be in progress.
+    virtual bool detach(DetachedTransport& out) {
+        (void)out;
+        return false;
+    }
+};
+
+// TCP connection, newline framed
+class SocketTransport : public Transport {
+private:
+    int fd;
+    string inbound;
+    size_t consumed;
+
+public:
+    // unread: bytes already received on the socket, read before it
+    explicit SocketTransport(int socketFd, const string& unread = string());
+    ~SocketTransport() override;
+
+    bool sendMessage(const string& message) override;
+    RecvStatus tryReceive(string& message) override;
+    int readinessFd() const override { return fd; }
+    void shutdown() override;
+    const char* kind() const override { return "tcp"; }
+    bool detach(DetachedTransport& out) override;
+};
+
+// Connects to a GameServer over TCP; nullptr on failure. If the server turns
+// out to be on this host the connection moves onto a /dev/shm ring.
+unique_ptr<Transport> connectTcp(const string& serverIP, int port);
+
+// Server side of an accepted TCP socket; offers the shared-memory ring to
+// local peers (disable with FACTORY_SHM=0)
+unique_ptr<Transport> acceptTransport(int fd);
+
+// True when acceptTransport() would offer this connection the ring
+bool sharedMemoryCandidate(int fd);
+
+// Server side of a connection another process detached; takes the fds.
+// Null (with the fds closed) for a kind this build does not know.
+unique_ptr<Transport> restoreTransport(DetachedTransport& detached);
+
+// Two in-process endpoints joined by a pair of lock-free SPSC rings. Each
+// endpoint must be used by at most one sending and one receiving thread.
+pair<unique_ptr<Transport>, unique_ptr<Transport>> makeLoopbackPair();
+
+#endif // TRANSPORT_H
@@ -0,0 +1,918 @@
+#include "uring_reactor.h"
+#include "log.h"
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <condition_variable>
+using namespace std;
+
+const unsigned RING_ENTRIES = 4096;
+const unsigned BUFFER_COUNT = 1024;  // power of two
+const unsigned BUFFER_SIZE = 4096;
+const uint16_t BUFFER_GROUP = 0;
+
+// Anything longer than this without a newline is not our protocol
+const size_t MAX_URING_LINE = 64 * 1024;
+
+// user_data: the operation in the top byte, a connection or watch id below
+enum Operation : uint64_t { OP_WAKE = 1, OP_RECV, OP_SEND, OP_POLL, OP_IGNORE };
+const int OP_SHIFT = 56;
+const uint64_t ID_MASK = (1ull << OP_SHIFT) - 1;
+
+static uint64_t tag(Operation op, uint64_t id) {
+    return (uint64_t(op) << OP_SHIFT) | id;
+}
+
+static int uringSetup(unsigned entries, io_uring_params* params) {
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags, void* arg, size_t argSize) {
+    return syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize);
+}
+
+static int uringRegister(int fd, unsigned opcode, void* arg, unsigned count) {
+    return syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+struct UringReactor::Connection {
+    uint64_t id;
+    int fd;
+
+    // Shared with the transport and with watch callbacks
+    mutex lock;
+    condition_variable arrived;
+    UringReactor* owner;        // null once the reactor is gone
+    string inbound;
+    size_t consumed = 0;
+    bool peerClosed = false;
+    bool fdClosed = false;
+    string outbox;
+    bool sendQueued = false;    // in the send queue or with a send in flight
+    bool closeWhenSent = false; // shut the write side once the outbox is empty
+    bool detached = false;      // the reactor is done with it; see detach()
+    WatchId watch = 0;
+    Task onReady;
+    bool armed = false;
+
+    // I/O thread only
+    string inflight;
+    size_t inflightSent = 0;
+    bool sending = false;
+    bool receiving = false;
+    bool released = false;
+    bool detaching = false;
+
+    // Caller holds lock
+    bool readyLocked() const {
+        return peerClosed || inbound.find('\n', consumed) != string::npos || inbound.size() - consumed > MAX_URING_LINE;
+    }
+};
+
+// A TCP connection whose I/O is done by the reactor's ring
+class UringTransport : public Transport {
+private:
+    shared_ptr<UringReactor::Connection> conn;
+
+public:
+    explicit UringTransport(shared_ptr<UringReactor::Connection> connection) : conn(connection) {}
+
+    ~UringTransport() override {
+        UringReactor* owner;
+        {
+            lock_guard<mutex> lock(conn->lock);
+            owner = conn->owner;
+            if (!owner && !conn->fdClosed) {
+                close(conn->fd);
+                conn->fdClosed = true;
+            }
+        }
+        if (owner) owner->release(conn);
+    }
+
+    const shared_ptr<UringReactor::Connection>& connection() const { return conn; }
+
+    bool sendMessage(const string& message) override {
+        UringReactor* owner;
+        {
+            lock_guard<mutex> lock(conn->lock);
+            if (conn->peerClosed || !conn->owner) return false;
+            conn->outbox.append(message);
+            conn->outbox.push_back('\n');
+            if (conn->sendQueued) return true;
+            conn->sendQueued = true;
+            owner = conn->owner;
+        }
+        owner->queueSend(conn);
+        return true;
+    }
+
+    RecvStatus tryReceive(string& message) override {
+        lock_guard<mutex> lock(conn->lock);
+        size_t newline = conn->inbound.find('\n', conn->consumed);
+        if (newline != string::npos) {
+            message.assign(conn->inbound, conn->consumed, newline - conn->consumed);
+            conn->consumed = newline + 1;
+            if (conn->consumed == conn->inbound.size()) {
+                conn->inbound.clear();
+                conn->consumed = 0;
+            }
+            return RecvStatus::Message;
+        }
+        if (conn->peerClosed) return RecvStatus::Closed;
+        if (conn->inbound.size() - conn->consumed > MAX_URING_LINE) {
+            LOG(LogLevel::Warn) << "Dropping connection: message exceeds " << MAX_URING_LINE << " bytes";
+            return RecvStatus::Closed;
+        }
+        return RecvStatus::WouldBlock;
+    }
+
+    bool receiveMessage(string& message) override {
+        while (true) {
+            RecvStatus status = tryReceive(message);
+            if (status != RecvStatus::WouldBlock) return status == RecvStatus::Message;
+            unique_lock<mutex> lock(conn->lock);
+            conn->arrived.wait(lock, [this] { return conn->readyLocked() || !conn->owner; });
+            if (!conn->owner && !conn->readyLocked()) return false;
+        }
+    }
+
+    // Only meaningful to the reactor that owns the connection
+    int readinessFd() const override { return conn->fd; }
+
+    // The pending multishot recv completes with EOF right away; the peer
+    // sees EOF once whatever was sent before has gone out
+    void shutdown() override {
+        UringReactor* owner;
+        {
+            lock_guard<mutex> lock(conn->lock);
+            if (conn->fdClosed) return;
+            ::shutdown(conn->fd, SHUT_RD);
+            owner = conn->owner;
+            if (!owner) {
+                ::shutdown(conn->fd, SHUT_WR);
+                return;
+            }
+            conn->closeWhenSent = true;
+            if (conn->sendQueued) return;
+            conn->sendQueued = true;
+        }
+        owner->queueSend(conn);
+    }
+
+    const char* kind() const override { return "uring"; }
+
+    // Blocks until the I/O thread has cancelled the recv and sent the outbox
+    bool detach(DetachedTransport& out) override {
+        UringReactor* owner;
+        {
+            lock_guard<mutex> lock(conn->lock);
+            if (conn->peerClosed || conn->fdClosed || conn->closeWhenSent || !conn->owner) return false;
+            owner = conn->owner;
+        }
+        owner->requestDetach(conn);
+
+        unique_lock<mutex> lock(conn->lock);
+        conn->arrived.wait(lock, [this] { return conn->detached || !conn->owner; });
+        if (!conn->detached) return false;
+        out.kind = "tcp";
+        out.fds.assign(1, conn->fd);
+        out.unread.assign(conn->inbound, conn->consumed, string::npos);
+        conn->inbound.clear();
+        conn->consumed = 0;
+        // Ours no more: nothing may shut it down or close it, and the
+        // reactor has already forgotten it
+        conn->fdClosed = true;
+        conn->peerClosed = true;
+        conn->owner = nullptr;
+        return true;
+    }
+};
+
+// ---------------------------------------------------------------------------
+
+UringReactor::UringReactor(Executor& pool)
+    : Reactor(pool), ringFd(-1), wakeFd(-1), wakeBuffer(0),
+      sqRing(nullptr), sqRingSize(0), cqRing(nullptr), cqRingSize(0), sqes(nullptr), sqesSize(0),
+      sqHead(nullptr), sqTail(nullptr), sqMask(0), sqEntries(0), sqArray(nullptr),
+      cqHead(nullptr), cqTail(nullptr), cqMask(0), cqes(nullptr), toSubmit(0),
+      bufferRing(nullptr), bufferPool(nullptr), bufferTail(0), legacyBuffers(false),
+      nextConnection(1), nextWatch(1), enterCalls(0), sqesSubmitted(0) {
+    utsname system;
+    int major = 0, minor = 0;
+    if (uname(&system) == 0) sscanf(system.release, "%d.%d", &major, &minor);
+    if (major < 6) {
+        failure = string("kernel ") + system.release + " has no multishot recv";
+        return;
+    }
+
+    wakeFd = eventfd(0, EFD_CLOEXEC);
+    if (wakeFd < 0) {
+        failure = string("eventfd: ") + strerror(errno);
+        return;
+    }
+
+    if (!setupRing() || !setupBuffers()) {
+        if (ringFd != -1) close(ringFd);
+        ringFd = -1;
+        return;
+    }
+    prepWakeRead();
+}
+
+UringReactor::~UringReactor() {
+    // Transports may outlive us; cut them loose so they close their own fds
+    vector<shared_ptr<Connection>> all;
+    for (auto& entry : connections) all.push_back(entry.second);
+    all.insert(all.end(), newConnections.begin(), newConnections.end());
+    vector<Task> callbacks;
+    for (const shared_ptr<Connection>& connection : all) {
+        lock_guard<mutex> lock(connection->lock);
+        connection->owner = nullptr;
+        callbacks.push_back(move(connection->onReady));
+        if (connection->released && !connection->fdClosed) {
+            close(connection->fd);
+            connection->fdClosed = true;
+        }
+        connection->arrived.notify_all();
+    }
+
+    // Watch callbacks may hold the last references to sessions (and thereby
+    // transports); release them outside any lock, before the ring goes away
+    callbacks.clear();
+    map<WatchId, Watch> leftover;
+    {
+        lock_guard<mutex> lock(watchMutex);
+        leftover.swap(watches);
+    }
+    leftover.clear();
+
+    if (ringFd != -1) close(ringFd);
+    if (sqes) munmap(sqes, sqesSize);
+    if (cqRing && cqRing != sqRing) munmap(cqRing, cqRingSize);
+    if (sqRing) munmap(sqRing, sqRingSize);
+    if (bufferRing) munmap(bufferRing, BUFFER_COUNT * sizeof(io_uring_buf));
+    if (bufferPool) munmap(bufferPool, (size_t)BUFFER_COUNT * BUFFER_SIZE);
+    if (wakeFd != -1) close(wakeFd);
+}
+
+bool UringReactor::setupRing() {
+    io_uring_params params = {};
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+    params.cq_entries = RING_ENTRIES * 4;  // multishot recvs post many completions per submission
+
+    ringFd = uringSetup(RING_ENTRIES, &params);
+    if (ringFd < 0) {
+        failure = string("io_uring_setup: ") + strerror(errno);
+        return false;
+    }
+    if (!(params.features & IORING_FEAT_EXT_ARG)) {
+        failure = "no timed waits (IORING_FEAT_EXT_ARG)";
+        return false;
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMmap) sqRingSize = cqRingSize = max(sqRingSize, cqRingSize);
+
+    void* mapping = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (mapping == MAP_FAILED) {
+        failure = string("mmap sq ring: ") + strerror(errno);
+        return false;
+    }
+    sqRing = mapping;
+
+    if (singleMmap) {
+        cqRing = sqRing;
+    } else {
+        mapping = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+        if (mapping == MAP_FAILED) {
+            failure = string("mmap cq ring: ") + strerror(errno);
+            return false;
+        }
+        cqRing = mapping;
+    }
+
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    mapping = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (mapping == MAP_FAILED) {
+        failure = string("mmap sqes: ") + strerror(errno);
+        return false;
+    }
+    sqes = static_cast<io_uring_sqe*>(mapping);
+
+    char* sq = static_cast<char*>(sqRing);
+    char* cq = static_cast<char*>(cqRing);
+    sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sqEntries = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_entries);
+    sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    return true;
+}
+
+bool UringReactor::setupBuffers() {
+    void* ring = mmap(nullptr, BUFFER_COUNT * sizeof(io_uring_buf), PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    void* pool = mmap(nullptr, (size_t)BUFFER_COUNT * BUFFER_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED || pool == MAP_FAILED) {
+        failure = string("mmap buffers: ") + strerror(errno);
+        if (ring != MAP_FAILED) munmap(ring, BUFFER_COUNT * sizeof(io_uring_buf));
+        if (pool != MAP_FAILED) munmap(pool, (size_t)BUFFER_COUNT * BUFFER_SIZE);
+        return false;
+    }
+    bufferRing = static_cast<io_uring_buf_ring*>(ring);
+    bufferPool = static_cast<char*>(pool);
+
+    io_uring_buf_reg registration = {};
+    registration.ring_addr = reinterpret_cast<uint64_t>(bufferRing);
+    registration.ring_entries = BUFFER_COUNT;
+    registration.bgid = BUFFER_GROUP;
+    if (uringRegister(ringFd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0) {
+        failure = string("provided buffer ring: ") + strerror(errno);
+        return false;
+    }
+    for (unsigned id = 0; id < BUFFER_COUNT; id++) recycleBuffer(id);
+
+    // A kernel that accepts the registration but hands out no buffer from
+    // the ring still supports buffers provided by SQE, so fall back to
+    // that: one more SQE per recycled buffer, batched like everything else.
+    if (!bufferRingWorks()) {
+        uringRegister(ringFd, IORING_UNREGISTER_PBUF_RING, &registration, 1);
+        legacyBuffers = true;
+        LOG(LogLevel::Info) << "io_uring buffer ring unusable, providing receive buffers by SQE";
+
+        io_uring_sqe* sqe = nextSqe();
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = BUFFER_COUNT;
+        sqe->addr = reinterpret_cast<uint64_t>(bufferPool);
+        sqe->len = BUFFER_SIZE;
+        sqe->buf_group = BUFFER_GROUP;
+        sqe->off = 0;
+        sqe->user_data = tag(OP_IGNORE, 0);
+    }
+    return true;
+}
+
+// Receives one byte over a socketpair through the buffer group
+bool UringReactor::bufferRingWorks() {
+    int pair[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, pair) < 0) return true;  // nothing to learn
+    ssize_t written = write(pair[1], "x", 1);
+    (void)written;
+
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = pair[0];
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = tag(OP_IGNORE, 0);
+
+    int result = 0;
+    if (enter(1, 1000) >= 0) {
+        unsigned head = *cqHead;
+        if (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+            io_uring_cqe cqe = cqes[head & cqMask];
+            __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+            result = cqe.res;
+            if (cqe.flags & IORING_CQE_F_BUFFER) recycleBuffer(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+        }
+    }
+    close(pair[0]);
+    close(pair[1]);
+    return result != -ENOBUFS;
+}
+
+// Hands buffer id back to the kernel. The ring tail shares its slot with
+// bufs[0].resv, so ring entries are filled field by field. Entries are
+// indexed from the ring base rather than through bufs: the kernel header
+// declares bufs as a flexible array behind an empty struct, which takes a
+// byte in C++, so bufs sits 8 bytes in and the last entry would land past
+// the mapping (on whatever the next mmap is, e.g. another ring's SQ head).
+void UringReactor::recycleBuffer(uint16_t id) {
+    if (legacyBuffers) {
+        io_uring_sqe* sqe = nextSqe();
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = 1;
+        sqe->addr = reinterpret_cast<uint64_t>(bufferPool + (size_t)id * BUFFER_SIZE);
+        sqe->len = BUFFER_SIZE;
+        sqe->buf_group = BUFFER_GROUP;
+        sqe->off = id;
+        sqe->user_data = tag(OP_IGNORE, 0);
+        return;
+    }
+
+    io_uring_buf& entry = reinterpret_cast<io_uring_buf*>(bufferRing)[bufferTail & (BUFFER_COUNT - 1)];
+    entry.addr = reinterpret_cast<uint64_t>(bufferPool + (size_t)id * BUFFER_SIZE);
+    entry.len = BUFFER_SIZE;
+    entry.bid = id;
+    bufferTail++;
+    __atomic_store_n(&bufferRing->tail, bufferTail, __ATOMIC_RELEASE);
+}
+
+// Without SQPOLL the kernel only reads SQEs inside io_uring_enter(), which
+// only this thread calls, so an SQE can be published before it is filled
+io_uring_sqe* UringReactor::nextSqe() {
+    unsigned tail = *sqTail;
+    while (tail - __atomic_load_n(sqHead, __ATOMIC_ACQUIRE) >= sqEntries) {
+        enter(0, 0);
+    }
+
+    io_uring_sqe* sqe = &sqes[tail & sqMask];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray[tail & sqMask] = tail & sqMask;
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+    toSubmit++;
+    return sqe;
+}
+
+void UringReactor::prepRecv(Connection& connection) {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = connection.fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = tag(OP_RECV, connection.id);
+}
+
+void UringReactor::prepSend(Connection& connection) {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = connection.fd;
+    sqe->addr = reinterpret_cast<uint64_t>(connection.inflight.data() + connection.inflightSent);
+    sqe->len = connection.inflight.size() - connection.inflightSent;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = tag(OP_SEND, connection.id);
+}
+
+void UringReactor::prepPoll(WatchId id, int fd) {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = tag(OP_POLL, id);
+}
+
+void UringReactor::prepWakeRead() {
+    io_uring_sqe* sqe = nextSqe();
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wakeFd;
+    sqe->addr = reinterpret_cast<uint64_t>(&wakeBuffer);
+    sqe->len = sizeof(wakeBuffer);
+    sqe->user_data = tag(OP_WAKE, 0);
+}
+
+// Submits everything prepared so far and, if waitFor > 0, waits for that
+// many completions or the timeout (-1 = none) in the same syscall
+int UringReactor::enter(unsigned waitFor, int timeoutMs) {
+    unsigned flags = 0;
+    io_uring_getevents_arg arg = {};
+    __kernel_timespec timeout = {};
+    if (waitFor > 0) {
+        flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        arg.sigmask_sz = _NSIG / 8;
+        if (timeoutMs >= 0) {
+            timeout.tv_sec = timeoutMs / 1000;
+            timeout.tv_nsec = (timeoutMs % 1000) * 1000000L;
+            arg.ts = reinterpret_cast<uint64_t>(&timeout);
+        }
+    }
+
+    int submitted = uringEnter(ringFd, toSubmit, waitFor, flags, waitFor > 0 ? &arg : nullptr,
+                               waitFor > 0 ? sizeof(arg) : 0);
+    enterCalls++;
+    if (submitted > 0) {
+        sqesSubmitted += submitted;
+        toSubmit -= submitted;
+    }
+    return submitted;
+}
+
+void UringReactor::wake() {
+    if (wakeFd == -1) return;
+    uint64_t one = 1;
+    ssize_t written = write(wakeFd, &one, sizeof(one));
+    (void)written;
+}
+
+unique_ptr<Transport> UringReactor::adoptConnection(int fd) {
+    // Local peers still move onto the shared-memory ring
+    if (sharedMemoryCandidate(fd)) return acceptTransport(fd);
+    return addConnection(fd, string());
+}
+
+unique_ptr<Transport> UringReactor::restoreConnection(DetachedTransport& detached) {
+    if (detached.kind != "tcp" || detached.fds.size() != 1) return Reactor::restoreConnection(detached);
+    return addConnection(detached.fds[0], move(detached.unread));
+}
+
+unique_ptr<Transport> UringReactor::addConnection(int fd, string unread) {
+    shared_ptr<Connection> connection = make_shared<Connection>();
+    connection->fd = fd;
+    connection->owner = this;
+    connection->inbound = move(unread);
+    {
+        lock_guard<mutex> lock(requestMutex);
+        connection->id = nextConnection++;
+        newConnections.push_back(connection);
+    }
+    wake();
+    return unique_ptr<Transport>(new UringTransport(connection));
+}
+
+void UringReactor::queueSend(const shared_ptr<Connection>& connection) {
+    bool first;
+    {
+        lock_guard<mutex> lock(requestMutex);
+        first = sendQueue.empty();
+        sendQueue.push_back(connection);
+    }
+    // Later senders ride on the same wakeup; the I/O thread takes the
+    // whole queue at once
+    if (first) wake();
+}
+
+void UringReactor::release(const shared_ptr<Connection>& connection) {
+    {
+        lock_guard<mutex> lock(requestMutex);
+        released.push_back(connection);
+    }
+    wake();
+}
+
+void UringReactor::requestDetach(const shared_ptr<Connection>& connection) {
+    {
+        lock_guard<mutex> lock(requestMutex);
+        detachRequests.push_back(connection);
+    }
+    wake();
+}
+
+Reactor::WatchId UringReactor::watch(int fd, Task onReady) {
+    WatchId id;
+    {
+        lock_guard<mutex> lock(watchMutex);
+        id = nextWatch++;
+        watches[id] = {fd, nullptr, move(onReady)};
+    }
+    {
+        lock_guard<mutex> lock(requestMutex);
+        pollRequests.push_back(id);
+    }
+    wake();
+    return id;
+}
+
+Reactor::WatchId UringReactor::watchTransport(Transport& transport, Task onReady) {
+    UringTransport* uring = dynamic_cast<UringTransport*>(&transport);
+    if (!uring) return Reactor::watchTransport(transport, move(onReady));
+
+    const shared_ptr<Connection>& connection = uring->connection();
+    WatchId id;
+    {
+        lock_guard<mutex> lock(watchMutex);
+        id = nextWatch++;
+        watches[id] = {-1, connection, nullptr};
+    }
+    {
+        lock_guard<mutex> lock(connection->lock);
+        connection->watch = id;
+        connection->onReady = move(onReady);
+        connection->armed = true;
+    }
+    dispatchIfReady(*connection);  // lines may already be buffered
+    return id;
+}
+
+void UringReactor::rearm(WatchId id) {
+    shared_ptr<Connection> connection;
+    {
+        lock_guard<mutex> lock(watchMutex);
+        auto found = watches.find(id);
+        if (found == watches.end()) return;  // unwatched meanwhile
+        connection = found->second.connection;
+    }
+
+    if (connection) {
+        {
+            lock_guard<mutex> lock(connection->lock);
+            if (connection->watch != id) return;
+            connection->armed = true;
+        }
+        dispatchIfReady(*connection);
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(requestMutex);
+        pollRequests.push_back(id);
+    }
+    wake();
+}
+
+void UringReactor::unwatch(WatchId id) {
+    Watch removed;
+    {
+        lock_guard<mutex> lock(watchMutex);
+        auto found = watches.find(id);
+        if (found == watches.end()) return;
+        removed = move(found->second);
+        watches.erase(found);
+    }
+
+    if (removed.connection) {
+        Task dropped;
+        {
+            lock_guard<mutex> lock(removed.connection->lock);
+            if (removed.connection->watch != id) return;
+            removed.connection->watch = 0;
+            removed.connection->armed = false;
+            dropped = move(removed.connection->onReady);
+        }
+        return;  // dropped (and whatever it holds) goes away outside the lock
+    }
+
+    {
+        lock_guard<mutex> lock(requestMutex);
+        pollRemovals.push_back(id);
+    }
+    wake();
+}
+
+void UringReactor::dispatchIfReady(Connection& connection) {
+    Task task;
+    {
+        lock_guard<mutex> lock(connection.lock);
+        if (!connection.armed || !connection.readyLocked()) return;
+        connection.armed = false;
+        task = connection.onReady;
+    }
+    executor.submit(move(task));
+}
+
+// Takes over everything other threads queued since the last loop
+void UringReactor::drainRequests() {
+    vector<shared_ptr<Connection>>& fresh = takenConnections;
+    vector<shared_ptr<Connection>>& sends = takenSends;
+    vector<shared_ptr<Connection>>& gone = takenReleases;
+    vector<shared_ptr<Connection>>& leaving = takenDetaches;
+    vector<WatchId>& polls = takenPolls;
+    vector<WatchId>& removals = takenRemovals;
+    {
+        lock_guard<mutex> lock(requestMutex);
+        fresh.swap(newConnections);
+        sends.swap(sendQueue);
+        gone.swap(released);
+        leaving.swap(detachRequests);
+        polls.swap(pollRequests);
+        removals.swap(pollRemovals);
+    }
+
+    for (const shared_ptr<Connection>& connection : fresh) {
+        connections[connection->id] = connection;
+        connection->receiving = true;
+        prepRecv(*connection);
+    }
+
+    for (WatchId id : polls) {
+        int fd = -1;
+        {
+            lock_guard<mutex> lock(watchMutex);
+            auto found = watches.find(id);
+            if (found != watches.end()) fd = found->second.fd;
+        }
+        if (fd >= 0) prepPoll(id, fd);
+    }
+
+    for (WatchId id : removals) {
+        io_uring_sqe* sqe = nextSqe();
+        sqe->opcode = IORING_OP_POLL_REMOVE;
+        sqe->addr = tag(OP_POLL, id);
+        sqe->user_data = tag(OP_IGNORE, 0);
+    }
+
+    for (const shared_ptr<Connection>& connection : sends) startSending(connection);
+
+    for (const shared_ptr<Connection>& connection : leaving) {
+        connection->detaching = true;
+        if (connection->receiving) {
+            // Ends the multishot recv without touching the socket, which
+            // another process is about to take over
+            io_uring_sqe* sqe = nextSqe();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = tag(OP_RECV, connection->id);
+            sqe->user_data = tag(OP_IGNORE, 0);
+        }
+        finishDetach(connection);
+    }
+
+    for (const shared_ptr<Connection>& connection : gone) {
+        connection->released = true;
+        if (connection->receiving) {
+            // Ends the multishot recv; the fd closes once nothing is in
+            // flight, so a last reply still goes out before the FIN
+            lock_guard<mutex> lock(connection->lock);
+            ::shutdown(connection->fd, connection->sending ? SHUT_RD : SHUT_RDWR);
+        }
+        closeIfIdle(connection);
+    }
+
+    fresh.clear();
+    sends.clear();
+    gone.clear();
+    leaving.clear();
+    polls.clear();
+    removals.clear();
+}
+
+void UringReactor::startSending(const shared_ptr<Connection>& connection) {
+    if (connection->sending) return;  // the completion picks up the rest
+    {
+        lock_guard<mutex> lock(connection->lock);
+        if (connection->outbox.empty() || connection->released || connection->fdClosed) {
+            connection->outbox.clear();
+            connection->sendQueued = false;
+            if (connection->closeWhenSent && !connection->fdClosed) ::shutdown(connection->fd, SHUT_WR);
+            return;
+        }
+        connection->inflight.swap(connection->outbox);
+        connection->outbox.clear();
+    }
+    connection->inflightSent = 0;
+    connection->sending = true;
+    prepSend(*connection);
+}
+
+void UringReactor::handleCompletion(const io_uring_cqe& cqe) {
+    Operation op = Operation(cqe.user_data >> OP_SHIFT);
+    uint64_t id = cqe.user_data & ID_MASK;
+
+    switch (op) {
+        case OP_WAKE:
+            if (!stopping.load()) prepWakeRead();
+            break;
+
+        case OP_RECV:
+        case OP_SEND: {
+            auto found = connections.find(id);
+            if (found == connections.end()) break;
+            shared_ptr<Connection> connection = found->second;
+            if (op == OP_RECV) handleRecv(*connection, cqe);
+            else handleSend(*connection, cqe);
+            closeIfIdle(connection);
+            finishDetach(connection);
+            break;
+        }
+
+        case OP_POLL: {
+            if (cqe.res < 0) break;  // removed
+            Task task;
+            {
+                lock_guard<mutex> lock(watchMutex);
+                auto found = watches.find(id);
+                if (found == watches.end()) break;
+                task = found->second.onReady;
+            }
+            executor.submit(move(task));
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+void UringReactor::handleRecv(Connection& connection, const io_uring_cqe& cqe) {
+    if (cqe.res > 0 && (cqe.flags & IORING_CQE_F_BUFFER)) {
+        uint16_t buffer = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+        {
+            lock_guard<mutex> lock(connection.lock);
+            connection.inbound.append(bufferPool + (size_t)buffer * BUFFER_SIZE, cqe.res);
+        }
+        recycleBuffer(buffer);
+    }
+
+    if (!(cqe.flags & IORING_CQE_F_MORE)) {
+        connection.receiving = false;
+        // Out of buffers (they are back now) or a final data completion:
+        // keep receiving. Anything else is EOF or an error, except the end
+        // of a recv cancelled for a detach.
+        bool moreToCome = cqe.res > 0 || cqe.res == -ENOBUFS;
+        if (moreToCome && !connection.released && !connection.detaching) {
+            connection.receiving = true;
+            prepRecv(connection);
+        } else if (!connection.detaching || (!moreToCome && cqe.res != -ECANCELED)) {
+            lock_guard<mutex> lock(connection.lock);
+            connection.peerClosed = true;
+        }
+    }
+
+    connection.arrived.notify_all();
+    dispatchIfReady(connection);
+}
+
+void UringReactor::handleSend(Connection& connection, const io_uring_cqe& cqe) {
+    connection.sending = false;
+
+    if (cqe.res < 0) {
+        if (cqe.res == -EINTR || cqe.res == -EAGAIN) {
+            connection.sending = true;
+            prepSend(connection);
+            return;
+        }
+        {
+            lock_guard<mutex> lock(connection.lock);
+            connection.peerClosed = true;
+            connection.outbox.clear();
+            connection.sendQueued = false;
+        }
+        connection.arrived.notify_all();
+        dispatchIfReady(connection);
+        return;
+    }
+
+    connection.inflightSent += cqe.res;
+    if (connection.inflightSent < connection.inflight.size()) {
+        connection.sending = true;
+        prepSend(connection);
+        return;
+    }
+
+    shared_ptr<Connection> self = connections[connection.id];
+    startSending(self);
+}
+
+void UringReactor::closeIfIdle(const shared_ptr<Connection>& connection) {
+    if (!connection->released || connection->receiving || connection->sending) return;
+    {
+        lock_guard<mutex> lock(connection->lock);
+        if (!connection->fdClosed) {
+            close(connection->fd);
+            connection->fdClosed = true;
+        }
+    }
+    connections.erase(connection->id);
+}
+
+// Once a detaching connection has nothing in flight and nothing left to
+// send, the reactor forgets it and wakes the transport waiting in detach()
+void UringReactor::finishDetach(const shared_ptr<Connection>& connection) {
+    if (!connection->detaching || connection->receiving || connection->sending) return;
+    {
+        lock_guard<mutex> lock(connection->lock);
+        if (!connection->outbox.empty()) return;  // queued; its send completes here again
+        connection->detached = true;
+    }
+    connection->detaching = false;
+    connections.erase(connection->id);
+    connection->arrived.notify_all();
+}
+
+void UringReactor::run() {
+    Clock::time_point lastReport = Clock::now();
+    uint64_t reportedEnters = 0, reportedSqes = 0;
+
+    while (!stopping.load()) {
+        drainRequests();
+
+        if (enter(1, msUntilNextTimer()) < 0 && errno != ETIME && errno != EINTR && errno != EBUSY) {
+            perror("io_uring_enter failed");
+            return;
+        }
+
+        unsigned head = *cqHead;
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            io_uring_cqe cqe = cqes[head & cqMask];
+            head++;
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+            handleCompletion(cqe);
+            if (head == tail) tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        }
+
+        fireDueTimers();
+
+        if (logEnabled(LogLevel::Debug) && Clock::now() - lastReport >= chrono::seconds(1)) {
+            LOG(LogLevel::Debug) << "io_uring: " << enterCalls - reportedEnters << " enters, "
+                                 << sqesSubmitted - reportedSqes << " SQEs, " << connections.size() << " connections";
+            lastReport = Clock::now();
+            reportedEnters = enterCalls;
+            reportedSqes = sqesSubmitted;
+        }
+    }
+}
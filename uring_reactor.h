@@ -0,0 +1,150 @@
+#ifndef URING_REACTOR_H
+#define URING_REACTOR_H
+
+#include <linux/io_uring.h>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "reactor.h"
+
+using namespace std;
+
+// io_uring backend, driven through the raw syscalls (no liburing).
+//
+// TCP connections adopted here never call recv/send themselves:
+//   - each has one multishot recv that fills buffers from a ring of
+//     provided buffers shared by all connections, so an idle connection
+//     pins no buffer;
+//   - sendMessage() appends to the connection's outbox and queues it; the
+//     I/O thread turns every queued outbox into a send SQE and submits them
+//     all, together with its wait, in a single io_uring_enter(). A tick
+//     that broadcasts to many sessions costs a few syscalls, not one per
+//     player.
+// Watches on those connections fire when a complete line is buffered. A
+// connection detached for a handoff first has its recv cancelled and its
+// outbox flushed, then its fd goes back to the transport.
+// Other fds (the listener, shared-memory and loopback transports) are
+// watched with one-shot poll requests on the same ring.
+//
+// Needs Linux 6.0 (multishot recv, provided buffer rings, EXT_ARG waits).
+class UringReactor : public Reactor {
+public:
+    explicit UringReactor(Executor& executor);
+    ~UringReactor() override;
+
+    bool valid() const { return ringFd != -1; }
+    // Why valid() is false, for the startup log
+    const string& unavailableReason() const { return failure; }
+
+    const char* backendName() const override { return "io_uring"; }
+    unique_ptr<Transport> adoptConnection(int fd) override;
+    unique_ptr<Transport> restoreConnection(DetachedTransport& detached) override;
+
+    WatchId watch(int fd, Task onReady) override;
+    WatchId watchTransport(Transport& transport, Task onReady) override;
+    void rearm(WatchId id) override;
+    void unwatch(WatchId id) override;
+    void run() override;
+
+    struct Connection;
+
+protected:
+    void wake() override;
+
+private:
+    friend class UringTransport;
+
+    struct Watch {
+        int fd;                            // polled fd, or -1 for a connection
+        shared_ptr<Connection> connection;
+        Task onReady;
+    };
+
+    int ringFd;
+    string failure;
+    int wakeFd;
+    uint64_t wakeBuffer;
+
+    // Submission and completion rings, mapped from the kernel
+    void* sqRing;
+    size_t sqRingSize;
+    void* cqRing;
+    size_t cqRingSize;
+    io_uring_sqe* sqes;
+    size_t sqesSize;
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned sqMask;
+    unsigned sqEntries;
+    unsigned* sqArray;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    io_uring_cqe* cqes;
+    unsigned toSubmit;
+
+    // Provided receive buffers
+    io_uring_buf_ring* bufferRing;
+    char* bufferPool;
+    uint16_t bufferTail;
+    bool legacyBuffers;  // provided with IORING_OP_PROVIDE_BUFFERS instead
+
+    // Owned by the I/O thread
+    map<uint64_t, shared_ptr<Connection>> connections;
+
+    // Handed over by other threads; see drainRequests()
+    mutex requestMutex;
+    vector<shared_ptr<Connection>> newConnections;
+    vector<shared_ptr<Connection>> sendQueue;
+    vector<shared_ptr<Connection>> released;
+    vector<shared_ptr<Connection>> detachRequests;
+    vector<WatchId> pollRequests;
+    vector<WatchId> pollRemovals;
+    uint64_t nextConnection;
+
+    // drainRequests() swaps the lists above with these and clears them
+    // after use, so both sets keep their capacity
+    vector<shared_ptr<Connection>> takenConnections, takenSends, takenReleases, takenDetaches;
+    vector<WatchId> takenPolls, takenRemovals;
+
+    mutex watchMutex;
+    map<WatchId, Watch> watches;
+    WatchId nextWatch;
+
+    // For the debug log
+    uint64_t enterCalls;
+    uint64_t sqesSubmitted;
+
+    bool setupRing();
+    bool setupBuffers();
+    bool bufferRingWorks();
+
+    io_uring_sqe* nextSqe();
+    void prepRecv(Connection& connection);
+    void prepSend(Connection& connection);
+    void prepPoll(WatchId id, int fd);
+    void prepWakeRead();
+    int enter(unsigned waitFor, int timeoutMs);
+
+    void drainRequests();
+    void startSending(const shared_ptr<Connection>& connection);
+    void handleCompletion(const io_uring_cqe& cqe);
+    void handleRecv(Connection& connection, const io_uring_cqe& cqe);
+    void handleSend(Connection& connection, const io_uring_cqe& cqe);
+    void recycleBuffer(uint16_t id);
+    void closeIfIdle(const shared_ptr<Connection>& connection);
+    void finishDetach(const shared_ptr<Connection>& connection);
+
+    unique_ptr<Transport> addConnection(int fd, string unread);
+    void queueSend(const shared_ptr<Connection>& connection);
+    void release(const shared_ptr<Connection>& connection);
+    // Stops receiving and lets the sends finish, then hands the fd back
+    // (see UringTransport::detach())
+    void requestDetach(const shared_ptr<Connection>& connection);
+    void dispatchIfReady(Connection& connection);
+};
+
+#endif // URING_REACTOR_H